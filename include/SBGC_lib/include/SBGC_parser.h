@@ -20,6 +20,9 @@
 
 #define SBGC_CMD_START_BYTE '>'
 
+// Size of the input buffer filled by a single read from the serial port
+#define SBGC_RX_BUFFER_SIZE 1024
+
 typedef enum {
     PARSER_NO_ERROR = 0,
     PARSER_ERROR_PROTOCOL = 1,
@@ -222,16 +225,25 @@ class SBGC_Parser {
     uint16_t len;
     uint8_t checksum;
     uint16_t parser_error_count;
+    uint8_t tx_buffer[SBGC_CMD_MAX_BYTES]; // the whole outgoing frame is assembled here and written at once
+    uint8_t rx_buffer[SBGC_RX_BUFFER_SIZE]; // received bytes not consumed by the parser yet
+    uint16_t rx_pos;
+    uint16_t rx_len;
+    uint32_t read_call_count;
 
 
 public:
     SerialCommand in_cmd; // received command is stored here
+    ros::Time in_cmd_stamp; // arrival of the last byte of in_cmd
 
     inline void init(serial_port::SerialPort *_com_obj) {
         std::scoped_lock lck(mtx);
         com_obj = _com_obj;
         state = STATE_WAIT;
         parser_error_count = 0;
+        rx_pos = 0;
+        rx_len = 0;
+        read_call_count = 0;
     }
 
     inline void onParseError(uint8_t error = PARSER_ERROR_PROTOCOL) {
@@ -295,13 +307,25 @@ public:
 
     /* Parse and fill SerialCommand object SBGC_Parser.in_cmd;
      * Returns 1 if command is parsed, 0 otherwise.
+     * Everything available is read from the port at once, bytes following
+     * a parsed command are kept for the next call.
      */
     inline int8_t read_cmd() {
-        uint8_t c;
-        while (com_obj->readChar(&c))
-            if (process_char(c))
-                return 1;
-        return 0;
+        while (true) {
+            while (rx_pos < rx_len)
+                if (process_char(rx_buffer[rx_pos++])) {
+                    in_cmd_stamp = com_obj->getByteStamp(rx_len - rx_pos);
+                    return 1;
+                }
+
+            read_call_count++;
+            const int bytes_read = com_obj->readSerial(rx_buffer, sizeof(rx_buffer));
+            rx_pos = 0;
+            rx_len = bytes_read > 0 ? bytes_read : 0;
+
+            if (rx_len == 0)
+                return 0;
+        }
     }
 
 
@@ -315,19 +339,25 @@ public:
         std::scoped_lock lck(mtx);
         if (com_obj != NULL && size <= (SBGC_CMD_MAX_BYTES - SBGC_CMD_NON_PAYLOAD_BYTES)) {
             if (wait) {
-                com_obj->sendChar(SBGC_CMD_START_BYTE); // protocol-specific start marker
-                com_obj->sendChar(cmd_id); // command id
-                com_obj->sendChar(size); // data body length
-                com_obj->sendChar(cmd_id + size); // header checksum
+                uint16_t it = 0;
+                tx_buffer[it++] = SBGC_CMD_START_BYTE; // protocol-specific start marker
+                tx_buffer[it++] = cmd_id; // command id
+                tx_buffer[it++] = size; // data body length
+                tx_buffer[it++] = cmd_id + size; // header checksum
 
                 // Write data
                 uint8_t checksum;
                 SerialCommand::init_checksum(checksum);
                 for (uint16_t i = 0; i < size; i++) {
-                    com_obj->sendChar(((uint8_t *) data)[i]);
+                    tx_buffer[it++] = ((uint8_t *) data)[i];
                     SerialCommand::update_checksum(checksum, ((uint8_t *) data)[i]);
                 }
-                com_obj->sendChar(checksum); // data checksum
+                tx_buffer[it++] = checksum; // data checksum
+
+                // a single write keeps the frame atomic on the wire
+                if (!com_obj->sendFrame(tx_buffer, it)) {
+                    return PARSER_ERROR_BUFFER_IS_FULL;
+                }
 
                 return 0;
             } else {
@@ -352,12 +382,20 @@ public:
     inline uint16_t get_parse_error_count() { return parser_error_count; }
 
 
+    /*
+    * Get the number of reads from the serial port (i.e. read() syscalls)
+    */
+    inline uint32_t get_read_call_count() { return read_call_count; }
+
+
     /*
     * Resets the state of a parser
     */
     inline void reset() {
         std::scoped_lock lck(mtx);
         state = STATE_WAIT;
+        rx_pos = 0;
+        rx_len = 0;
     }
 
 
@@ -0,0 +1,95 @@
+#ifndef BACA_BATCHER_H_
+#define BACA_BATCHER_H_
+
+#include <ros/ros.h>
+#include <mrs_serial/BacaProtocolArray.h>
+
+#include <algorithm>
+#include <mutex>
+
+#include "baca_framer.h"
+#include "message_pool.h"
+
+namespace baca_protocol {
+
+    /*
+     * Collects the frames of a high-rate stream into mrs_serial/BacaProtocolArray messages,
+     * a batch is published once it has max_frames frames or its first frame is max_window old.
+     * Every frame keeps its own receive stamp, so the timing of the stream can be reconstructed.
+     */
+    class BacaBatcher {
+    public:
+        void init(const ros::Publisher &publisher, int max_frames, const ros::Duration &max_window) {
+            std::scoped_lock lock(mtx_);
+            publisher_  = publisher;
+            max_frames_ = std::max(max_frames, 1);
+            max_window_ = max_window;
+        }
+
+        void add(const BacaFrame &frame, const ros::Time &stamp) {
+
+            std::scoped_lock lock(mtx_);
+
+            if (!batch_) {
+                batch_               = pool_.acquire();
+                batch_size_          = 0;
+                batch_->header.stamp = stamp;
+            }
+
+            // the frames of a recycled batch are overwritten in place, so that their payloads keep the capacity
+            if (batch_size_ == batch_->frames.size()) {
+                batch_->frames.emplace_back();
+            }
+
+            mrs_msgs::BacaProtocol &msg = batch_->frames[batch_size_++];
+            msg.stamp = stamp;
+            msg.payload.assign(frame.payload, frame.payload + frame.payload_size);
+            msg.checksum_received   = frame.checksum_received;
+            msg.checksum_calculated = frame.checksum_calculated;
+            msg.checksum_correct    = frame.checksum_correct;
+
+            if (int(batch_size_) >= max_frames_ || (stamp - batch_->header.stamp) >= max_window_) {
+                publish();
+            }
+        }
+
+        // publishes a batch whose window elapsed without more data coming, call it periodically
+        void flushStale(const ros::Time &now) {
+
+            std::scoped_lock lock(mtx_);
+
+            if (batch_ && (now - batch_->header.stamp) >= max_window_) {
+                publish();
+            }
+        }
+
+    private:
+        void publish() {
+
+            // drops the frames a previous use left behind the ones of this batch
+            batch_->frames.resize(batch_size_);
+
+            try {
+                publisher_.publish(mrs_serial::BacaProtocolArrayConstPtr(batch_));
+            }
+            catch (...) {
+                ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", publisher_.getTopic().c_str());
+            }
+
+            batch_.reset();
+        }
+
+        std::mutex mtx_;
+
+        ros::Publisher publisher_;
+        int            max_frames_ = 1;
+        ros::Duration  max_window_;
+
+        serial_port::MessagePool<mrs_serial::BacaProtocolArray> pool_;
+        boost::shared_ptr<mrs_serial::BacaProtocolArray>        batch_;
+        size_t                                                  batch_size_ = 0;  // frames of batch_ filled in
+    };
+
+}  // namespace baca_protocol
+
+#endif  // BACA_BATCHER_H_
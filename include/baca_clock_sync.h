@@ -0,0 +1,222 @@
+#ifndef BACA_CLOCK_SYNC_H_
+#define BACA_CLOCK_SYNC_H_
+
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "baca_framer.h"
+#include "baca_messages.h"
+
+/*
+ * Maps the free running microsecond clock of a device to ROS time. The host sends
+ * ClockSyncPing frames periodically, the device answers each with a ClockSyncPong holding
+ * its clock at the moment the ping arrived. The host time of that moment is estimated as
+ * the middle of the round trip, and a line host = offset + rate * device is fitted to the
+ * last window_size such pairs by least squares, so both the offset and the drift of the
+ * device crystal are tracked.
+ *
+ * Pairs with a round trip longer than max_rtt (the ping waited in a queue or the USB
+ * latency timer) are discarded, the error of a pair is at most half of its round trip.
+ * A pair far off the line (the device restarted) starts the estimation over.
+ */
+
+namespace baca_protocol {
+
+    struct ClockSyncState {
+        bool     valid           = false;  // enough pairs to convert the device time
+        uint32_t samples         = 0;      // pairs in the window
+        double   offset          = 0;      // [s] host time minus device time counted from the first pair
+        double   drift           = 0;      // [ppm] how much faster the device clock runs
+        double   residual        = 0;      // [s] newest pair minus its prediction from the previous ones
+        double   residual_rms    = 0;      // [s] of the pairs in the window around the fitted line
+        double   round_trip_time = 0;      // [s] of the newest pair
+    };
+
+    class ClockSync {
+    public:
+        void init(size_t window_size, size_t min_samples, double max_rtt, double reset_threshold = 0.1) {
+            std::scoped_lock lck(mtx_);
+            window_size_     = std::max(window_size, size_t(2));
+            min_samples_     = std::clamp(min_samples, size_t(2), window_size_);
+            max_rtt_         = max_rtt;
+            reset_threshold_ = reset_threshold;
+        }
+
+        // the next ping, to be written to the port right away
+        messages::ClockSyncPing::Frame makePing(const ros::Time &now) {
+
+            std::scoped_lock lck(mtx_);
+
+            auto payload = messages::ClockSyncPing::payload();
+            messages::ClockSyncPing::sequence::write(payload.data(), next_sequence_);
+
+            pings_[next_sequence_] = now;
+            next_sequence_++;
+
+            return messages::ClockSyncPing::frame(payload);
+        }
+
+        // call with every ClockSyncPong frame, returns true if the pair was used
+        bool handlePong(const BacaFrame &frame, const ros::Time &now) {
+
+            std::scoped_lock lck(mtx_);
+
+            ros::Time &ping = pings_[messages::ClockSyncPong::sequence::read(frame.payload)];
+            if (ping.isZero()) {
+                return false;
+            }
+
+            const ros::Time sent = ping;
+            const double    rtt  = (now - sent).toSec();
+            ping                 = ros::Time();
+
+            if (rtt < 0 || rtt > max_rtt_) {
+                return false;
+            }
+
+            const uint32_t tick = messages::ClockSyncPong::tick::read(frame.payload);
+
+            if (samples_.empty()) {
+                restart(tick, sent, rtt);
+                return true;
+            }
+
+            device_us_ += int32_t(tick - last_tick_);
+            last_tick_ = tick;
+
+            const Sample sample{device_us_ * 1e-6, (sent - host_ref_).toSec() + rtt / 2.0, rtt};
+            const double residual = sample.host - predict(sample.device);
+
+            // the device clock jumped, e.g. the device was restarted
+            if (std::abs(residual) > reset_threshold_) {
+                restart(tick, sent, rtt);
+                return true;
+            }
+
+            samples_.push_back(sample);
+            if (samples_.size() > window_size_) {
+                samples_.pop_front();
+            }
+
+            fit();
+            state_.residual        = residual;
+            state_.round_trip_time = rtt;
+
+            return true;
+        }
+
+        // the ROS time of a device tick, false until enough pairs arrived
+        bool toHostTime(uint32_t tick, ros::Time &stamp) {
+
+            std::scoped_lock lck(mtx_);
+
+            if (!state_.valid) {
+                return false;
+            }
+
+            // ticks within 35 minutes from the newest pair unwrap correctly
+            const int64_t device_us = device_us_ + int32_t(tick - last_tick_);
+
+            stamp = host_ref_ + ros::Duration(predict(device_us * 1e-6));
+            return true;
+        }
+
+        ClockSyncState getState() {
+            std::scoped_lock lck(mtx_);
+            return state_;
+        }
+
+    private:
+        struct Sample {
+            double device;  // [s] since the first pair
+            double host;    // [s] since host_ref_
+            double rtt;
+        };
+
+        // the first pair of a new estimation, expects mtx_ locked
+        void restart(uint32_t tick, const ros::Time &sent, double rtt) {
+
+            host_ref_  = sent;
+            last_tick_ = tick;
+            device_us_ = 0;
+
+            samples_.clear();
+            samples_.push_back(Sample{0, rtt / 2.0, rtt});
+
+            state_ = ClockSyncState{};
+            fit();
+            state_.round_trip_time = rtt;
+        }
+
+        double predict(double device) const {
+            return intercept_ + rate_ * device;
+        }
+
+        // least squares line through the window, expects mtx_ locked
+        void fit() {
+
+            const double n = samples_.size();
+
+            double device_mean = 0;
+            double host_mean   = 0;
+            for (const Sample &s : samples_) {
+                device_mean += s.device / n;
+                host_mean += s.host / n;
+            }
+
+            double sxx = 0;
+            double sxy = 0;
+            for (const Sample &s : samples_) {
+                sxx += (s.device - device_mean) * (s.device - device_mean);
+                sxy += (s.device - device_mean) * (s.host - host_mean);
+            }
+
+            // a single pair, or all of them at once, gives no rate
+            rate_      = sxx > 1e-12 ? sxy / sxx : 1.0;
+            intercept_ = host_mean - rate_ * device_mean;
+
+            double sum_sq = 0;
+            for (const Sample &s : samples_) {
+                const double r = s.host - predict(s.device);
+                sum_sq += r * r;
+            }
+
+            const Sample &newest = samples_.back();
+
+            state_.valid        = samples_.size() >= min_samples_;
+            state_.samples      = samples_.size();
+            state_.offset       = (host_ref_ + ros::Duration(predict(newest.device))).toSec() - newest.device;
+            state_.drift        = (rate_ - 1.0) * 1e6;
+            state_.residual_rms = std::sqrt(sum_sq / n);
+        }
+
+        std::mutex mtx_;
+
+        size_t window_size_     = 32;
+        size_t min_samples_     = 4;
+        double max_rtt_         = 0.01;
+        double reset_threshold_ = 0.1;
+
+        std::array<ros::Time, 256> pings_{};
+        uint8_t                    next_sequence_ = 0;
+
+        std::deque<Sample> samples_;
+        ros::Time          host_ref_;
+        uint32_t           last_tick_ = 0;
+        int64_t            device_us_ = 0;  // unwrapped device clock at the newest pair, since the first one
+
+        double rate_      = 1.0;
+        double intercept_ = 0;
+
+        ClockSyncState state_;
+    };
+
+}  // namespace baca_protocol
+
+#endif  // BACA_CLOCK_SYNC_H_
@@ -0,0 +1,93 @@
+#ifndef BACA_DISPATCHER_H_
+#define BACA_DISPATCHER_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "baca_framer.h"
+
+/*
+ * Routes decoded Baca frames to handlers registered for their (payload_size, message_id)
+ * pair, see the list of reserved messages in the README. The lookup is two array
+ * indexations regardless of how many messages are registered. Tables of payload sizes
+ * are allocated only for the message ids that have a handler.
+ */
+
+namespace baca_protocol {
+
+    class BacaDispatcher {
+    public:
+        using Handler = std::function<void(const BacaFrame &frame)>;
+
+        // replaces the handler registered for the same pair before
+        void registerHandler(uint8_t payload_size, uint8_t message_id, Handler handler) {
+
+            std::unique_ptr<SizeTable> &sizes = table_[message_id];
+            if (!sizes) {
+                sizes = std::make_unique<SizeTable>();
+                sizes->fill(NO_HANDLER);
+            }
+
+            uint16_t &index = (*sizes)[payload_size];
+            if (index == NO_HANDLER) {
+                index = handlers_.size();
+                handlers_.push_back(std::move(handler));
+            } else {
+                handlers_[index] = std::move(handler);
+            }
+        }
+
+        // registers the handler for every id of the message schema (see baca_schema.h),
+        // frames with the id but a different payload size never reach it
+        template<typename Message>
+        void registerHandler(const Handler &handler) {
+            for (const uint8_t id : Message::ids) {
+                registerHandler(Message::payload_size, id, handler);
+            }
+        }
+
+        // gets all the frames without a registered handler, and the ones with a wrong checksum
+        void setDefaultHandler(Handler handler) {
+            default_handler_ = std::move(handler);
+        }
+
+        // returns false if no handler was called
+        bool dispatch(const BacaFrame &frame) const {
+
+            // the id and size of a corrupted frame cannot be trusted
+            if (frame.checksum_correct) {
+                const std::unique_ptr<SizeTable> &sizes = table_[frame.messageId()];
+                if (sizes) {
+                    const uint16_t index = (*sizes)[frame.payload_size];
+                    if (index != NO_HANDLER) {
+                        handlers_[index](frame);
+                        return true;
+                    }
+                }
+            }
+
+            if (default_handler_) {
+                default_handler_(frame);
+                return true;
+            }
+
+            return false;
+        }
+
+    private:
+        static constexpr uint16_t NO_HANDLER = 0xFFFF;
+
+        // handler index for every payload size
+        using SizeTable = std::array<uint16_t, 256>;
+
+        std::array<std::unique_ptr<SizeTable>, 256> table_;
+        std::vector<Handler> handlers_;
+        Handler default_handler_;
+    };
+
+}  // namespace baca_protocol
+
+#endif  // BACA_DISPATCHER_H_
@@ -0,0 +1,365 @@
+#ifndef BACA_FRAMER_H_
+#define BACA_FRAMER_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// BACA_FRAMER_SCALAR builds only the scalar loops, to compare them with the vector ones, see baca_framer_benchmark
+#if defined(__AVX2__) && !defined(BACA_FRAMER_SCALAR)
+#define BACA_FRAMER_AVX2
+#endif
+
+#if defined(__SSE2__) && !defined(BACA_FRAMER_SCALAR)
+#define BACA_FRAMER_SSE2
+#endif
+
+#if defined(BACA_FRAMER_AVX2) || defined(BACA_FRAMER_SSE2)
+#include <immintrin.h>
+#endif
+
+/*
+ * Streaming decoder of the Baca protocol frames:
+ *
+ *   ['b'][payload_size][payload_0(=message_id)]...[payload_n][checksum]
+ *
+ * Every instance keeps its own state, so any number of ports can be decoded
+ * in one process. The decoder does not allocate, a decoded frame points into
+ * the decoder's buffer and is valid only inside the frame callback.
+ */
+
+namespace baca_protocol {
+
+    namespace simd {
+
+        // the widest vectors the scans and sums use in this build
+        constexpr const char *instructionSet() {
+#if defined(BACA_FRAMER_AVX2)
+            return "AVX2";
+#elif defined(BACA_FRAMER_SSE2)
+            return "SSE2";
+#else
+            return "scalar";
+#endif
+        }
+
+        /* findStartByte() //{ */
+
+        // returns the first 'b' (or 'a' if accept_legacy) in [it, end), or end
+        inline const uint8_t *findStartByte(const uint8_t *it, const uint8_t *end, bool accept_legacy) {
+
+            // frames usually follow each other back to back
+            if (it < end && (*it == 'b' || (accept_legacy && *it == 'a'))) {
+                return it;
+            }
+
+            if (!accept_legacy) {
+                const void *found = std::memchr(it, 'b', end - it);
+                return found ? static_cast<const uint8_t *>(found) : end;
+            }
+
+#if defined(BACA_FRAMER_AVX2)
+            const __m256i b32 = _mm256_set1_epi8('b');
+            const __m256i a32 = _mm256_set1_epi8('a');
+            for (; end - it >= 32; it += 32) {
+                const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(it));
+                const uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, b32), _mm256_cmpeq_epi8(chunk, a32)));
+                if (mask) {
+                    return it + __builtin_ctz(mask);
+                }
+            }
+#endif
+
+#if defined(BACA_FRAMER_SSE2)
+            const __m128i b16 = _mm_set1_epi8('b');
+            const __m128i a16 = _mm_set1_epi8('a');
+            for (; end - it >= 16; it += 16) {
+                const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(it));
+                const uint32_t mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, b16), _mm_cmpeq_epi8(chunk, a16)));
+                if (mask) {
+                    return it + __builtin_ctz(mask);
+                }
+            }
+#endif
+
+            for (; it < end; it++) {
+                if (*it == 'b' || *it == 'a') {
+                    return it;
+                }
+            }
+
+            return end;
+        }
+
+        //}
+
+        /* sumBytes() //{ */
+
+        // modulo-256 sum of the bytes, i.e. the Baca checksum of a payload
+        inline uint8_t sumBytes(const uint8_t *data, size_t len) {
+
+            size_t i = 0;
+            uint64_t sum = 0;
+
+#if defined(BACA_FRAMER_AVX2)
+            // sum of absolute differences against zero adds 8 bytes into each 64-bit lane
+            if (len >= 32) {
+                __m256i acc32 = _mm256_setzero_si256();
+                for (; i + 32 <= len; i += 32) {
+                    const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+                    acc32 = _mm256_add_epi64(acc32, _mm256_sad_epu8(chunk, _mm256_setzero_si256()));
+                }
+                uint64_t lanes32[4];
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes32), acc32);
+                sum += lanes32[0] + lanes32[1] + lanes32[2] + lanes32[3];
+            }
+#endif
+
+#if defined(BACA_FRAMER_SSE2)
+            if (len - i >= 16) {
+                __m128i acc16 = _mm_setzero_si128();
+                for (; i + 16 <= len; i += 16) {
+                    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                    acc16 = _mm_add_epi64(acc16, _mm_sad_epu8(chunk, _mm_setzero_si128()));
+                }
+                uint64_t lanes16[2];
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes16), acc16);
+                sum += lanes16[0] + lanes16[1];
+            }
+#endif
+
+            for (; i < len; i++) {
+                sum += data[i];
+            }
+
+            return uint8_t(sum);
+        }
+
+        //}
+
+    }  // namespace simd
+
+    struct BacaFrame {
+        const uint8_t *payload;
+        uint8_t payload_size;
+        uint8_t checksum_calculated;
+        uint8_t checksum_received;
+        bool checksum_correct;
+        uint32_t bytes_after;  // bytes of the decoded chunk that follow the frame, see SerialPort::getByteStamp()
+
+        uint8_t messageId() const {
+            return payload[0];
+        }
+    };
+
+    struct BacaFramerStats {
+        uint64_t bytes = 0;
+        uint64_t frames_ok = 0;
+        uint64_t frames_bad_checksum = 0;
+        uint64_t frames_zero_size = 0;
+        uint64_t frames_recovered = 0;
+    };
+
+    class BacaFramer {
+    public:
+        // the 'a' start byte is there for backwards-compatibility, going forwards all messages should start with 'b'
+        explicit BacaFramer(bool accept_legacy_start = true) : accept_legacy_start_(accept_legacy_start) {
+        }
+
+        /*
+         * Decodes a chunk of the stream, on_frame(const BacaFrame &) is called for every
+         * complete frame, including the ones with a wrong checksum (see checksum_correct).
+         * A frame split between chunks is finished by the following call.
+         */
+        template<typename FrameCallback>
+        void decode(const uint8_t *data, size_t len, FrameCallback &&on_frame) {
+
+            stats_.bytes += len;
+
+            const uint8_t *it = data;
+            const uint8_t *end = data + len;
+
+            while (it < end) {
+
+                it = consume(it, end, false, on_frame);
+
+                if (resync_pending_) {
+                    chunk_rest_ = end - it;
+                    rescan(on_frame);
+                }
+            }
+        }
+
+        /*
+         * With resync enabled, the bytes of a frame that failed its checksum are scanned
+         * again from the byte after its start byte. When the start byte was a false 'b'
+         * in noise, the genuine frame that began inside the rejected one is recovered.
+         */
+        void setResync(bool enable) {
+            resync_ = enable;
+        }
+
+        void reset() {
+            state_ = WAITING_FOR_MESSAGE;
+            resync_pending_ = false;
+        }
+
+        const BacaFramerStats &stats() const {
+            return stats_;
+        }
+
+    private:
+        enum State : uint8_t {
+            WAITING_FOR_MESSAGE,
+            EXPECTING_SIZE,
+            EXPECTING_PAYLOAD,
+            EXPECTING_CHECKSUM
+        };
+
+        /* consume() //{ */
+
+        // runs the state machine over [it, end), returns early after a bad frame when a resync is due
+        template<typename FrameCallback>
+        const uint8_t *consume(const uint8_t *it, const uint8_t *end, bool in_window, FrameCallback &on_frame) {
+
+            while (it < end) {
+
+                switch (state_) {
+
+                    case WAITING_FOR_MESSAGE: {
+
+                        // skip the noise between frames in bulk
+                        it = simd::findStartByte(it, end, accept_legacy_start_);
+                        if (it == end) {
+                            break;
+                        }
+
+                        checksum_ = *it;
+                        raw_[0] = *it++;
+                        raw_len_ = 1;
+                        frame_in_window_ = in_window;
+                        state_ = EXPECTING_SIZE;
+                        break;
+                    }
+
+                    case EXPECTING_SIZE: {
+
+                        const uint8_t c = *it++;
+                        if (c == 0) {
+                            stats_.frames_zero_size++;
+                            state_ = WAITING_FOR_MESSAGE;
+                        } else {
+                            payload_size_ = c;
+                            checksum_ += c;
+                            raw_[raw_len_++] = c;
+                            state_ = EXPECTING_PAYLOAD;
+                        }
+                        break;
+                    }
+
+                    case EXPECTING_PAYLOAD: {
+
+                        // copy as much of the payload as this chunk contains at once
+                        const size_t n = std::min(size_t(end - it), size_t(payload_size_ + 2 - raw_len_));
+                        std::memcpy(raw_ + raw_len_, it, n);
+                        checksum_ += simd::sumBytes(it, n);
+                        it += n;
+                        raw_len_ += n;
+
+                        if (raw_len_ >= payload_size_ + 2) {
+                            state_ = EXPECTING_CHECKSUM;
+                        }
+                        break;
+                    }
+
+                    case EXPECTING_CHECKSUM: {
+
+                        const uint8_t c = *it++;
+                        raw_[raw_len_++] = c;
+                        // the rest of a window precedes the rest of the chunk in the stream
+                        const uint32_t bytes_after = (end - it) + (in_window ? chunk_rest_ : 0);
+                        const BacaFrame frame{raw_ + 2, payload_size_, checksum_, c, checksum_ == c, bytes_after};
+
+                        if (frame.checksum_correct) {
+                            stats_.frames_ok++;
+                            if (frame_in_window_) {
+                                stats_.frames_recovered++;
+                            }
+                        } else {
+                            stats_.frames_bad_checksum++;
+                        }
+
+                        state_ = WAITING_FOR_MESSAGE;
+                        on_frame(frame);
+
+                        if (!frame.checksum_correct && resync_) {
+                            resync_pending_ = true;
+                            return it;
+                        }
+                        break;
+                    }
+                }
+            }
+
+            return it;
+        }
+
+        //}
+
+        /* rescan() //{ */
+
+        // feeds the rejected frame without its start byte back into the state machine
+        template<typename FrameCallback>
+        void rescan(FrameCallback &on_frame) {
+
+            window_len_ = raw_len_ - 1;
+            std::memcpy(window_, raw_ + 1, window_len_);
+            resync_pending_ = false;
+
+            const uint8_t *it = window_;
+            const uint8_t *end = window_ + window_len_;
+
+            while (it < end) {
+
+                it = consume(it, end, true, on_frame);
+
+                if (resync_pending_) {
+                    // the new rejected frame lies within the window, continue right after its start byte
+                    const size_t rest = end - it;
+                    std::memmove(window_ + raw_len_ - 1, it, rest);
+                    std::memcpy(window_, raw_ + 1, raw_len_ - 1);
+                    window_len_ = raw_len_ - 1 + rest;
+                    resync_pending_ = false;
+
+                    it = window_;
+                    end = window_ + window_len_;
+                }
+            }
+        }
+
+        //}
+
+        State state_ = WAITING_FOR_MESSAGE;
+        uint8_t payload_size_ = 0;
+        uint8_t checksum_ = 0;
+
+        // the current frame including the start, size and checksum bytes
+        uint8_t raw_[258];
+        uint16_t raw_len_ = 0;
+
+        // lookback window of a rejected frame that is being scanned again
+        uint8_t window_[258];
+        uint16_t window_len_ = 0;
+        bool frame_in_window_ = false;
+        size_t chunk_rest_ = 0;  // bytes of the chunk after the window
+        bool resync_pending_ = false;
+
+        bool accept_legacy_start_;
+        bool resync_ = false;
+        BacaFramerStats stats_;
+    };
+
+}  // namespace baca_protocol
+
+#endif  // BACA_FRAMER_H_
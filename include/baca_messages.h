@@ -0,0 +1,116 @@
+#ifndef BACA_MESSAGES_H_
+#define BACA_MESSAGES_H_
+
+#include "baca_schema.h"
+
+/*
+ * Layouts of the reserved Baca messages decoded or sent by the nodelets, see the README.
+ */
+
+namespace baca_protocol {
+
+    namespace messages {
+
+        // Garmin rangefinder, 0x00 down and 0x01 up
+        struct GarminRange : Schema<3, 0x00, 0x01> {
+            using range = Field<int16_t, 1, std::centi>;  // [cm] raw, [m] scaled
+        };
+
+        // ultrasound rangefinder
+        struct UltrasoundRange : Schema<3, 0x33> {
+            using range = Field<int16_t, 1, std::centi>;  // [cm] raw, [m] scaled
+        };
+
+        // 0x30 is published on the imu topic, 0x31 also on the sync topic
+        struct VioImuData : Schema<13, 0x30, 0x31> {
+            using acc_x  = Field<int16_t, 1, std::ratio<1, 4096>>;  // [g]
+            using acc_y  = Field<int16_t, 3, std::ratio<1, 4096>>;
+            using acc_z  = Field<int16_t, 5, std::ratio<1, 4096>>;
+            using gyro_x = Field<int16_t, 7, std::ratio<1000, 65536>>;  // [deg/s]
+            using gyro_y = Field<int16_t, 9, std::ratio<1000, 65536>>;
+            using gyro_z = Field<int16_t, 11, std::ratio<1000, 65536>>;
+        };
+
+        // Garmin range with the device clock when it was measured, see ClockSyncPong
+        struct GarminRangeStamped : Schema<7, 0x00, 0x01> {
+            using range = GarminRange::range;
+            using tick  = Field<uint32_t, 3>;  // [us]
+        };
+
+        struct UltrasoundRangeStamped : Schema<7, 0x33> {
+            using range = UltrasoundRange::range;
+            using tick  = Field<uint32_t, 3>;  // [us]
+        };
+
+        struct VioImuDataStamped : Schema<17, 0x30, 0x31> {
+            using acc_x  = VioImuData::acc_x;
+            using acc_y  = VioImuData::acc_y;
+            using acc_z  = VioImuData::acc_z;
+            using gyro_x = VioImuData::gyro_x;
+            using gyro_y = VioImuData::gyro_y;
+            using gyro_z = VioImuData::gyro_z;
+            using tick   = Field<uint32_t, 13>;  // [us]
+        };
+
+        // state reported by the Tarot gimbal
+        struct TarotGimbalState : Schema<6, 0x1A> {
+            using tilt  = Field<int16_t, 1>;
+            using pan   = Field<int16_t, 3>;
+            using mode  = Flag<5, 0x01>;  // status byte
+            using is_on = Flag<5, 0x02>;
+        };
+
+        // command sent to the Tarot gimbal, same layout as the state
+        struct TarotGimbalCommand : Schema<6, 0x1B> {
+            using tilt  = TarotGimbalState::tilt;
+            using pan   = TarotGimbalState::pan;
+            using mode  = TarotGimbalState::mode;
+            using is_on = TarotGimbalState::is_on;
+        };
+
+        struct ServoPosition : Schema<3, 0x86> {
+            using position = Field<uint16_t, 1>;  // 0 - 1023
+        };
+
+        // A, B, C and D outputs: 0 - turn off, 1 - turn on, 2 - do not change
+        struct LedOutputs : Schema<5, 0x66> {
+            static constexpr uint8_t OFF       = 0;
+            static constexpr uint8_t ON        = 1;
+            static constexpr uint8_t NO_CHANGE = 2;
+
+            using a = Field<uint8_t, 1>;
+            using b = Field<uint8_t, 2>;
+            using c = Field<uint8_t, 3>;
+            using d = Field<uint8_t, 4>;
+        };
+
+        // clock synchronization request, answered by ClockSyncPong with the same sequence
+        struct ClockSyncPing : Schema<2, 0x72> {
+            using sequence = Field<uint8_t, 1>;
+        };
+
+        // the device clock when the ping arrived
+        struct ClockSyncPong : Schema<6, 0x73> {
+            using sequence = Field<uint8_t, 1>;
+            using tick     = Field<uint32_t, 2>;  // [us] free running, wraps around
+        };
+
+        // reliable command: [0x70][sequence][message_id][data...], the size depends on the wrapped message
+        constexpr uint8_t RELIABLE_COMMAND_ID = 0x70;
+
+        // acknowledgement of a reliable command, sent back by the device
+        struct ReliableAck : Schema<3, 0x71> {
+            using sequence   = Field<uint8_t, 1>;
+            using message_id = Field<uint8_t, 2>;  // of the wrapped message
+        };
+
+        // messages that must not wait behind other outbound traffic: netgun (0x37 - 0x39) and parachute (0x50 - 0x52)
+        inline bool isSafetyMessage(uint8_t message_id) {
+            return (message_id >= 0x37 && message_id <= 0x39) || (message_id >= 0x50 && message_id <= 0x52);
+        }
+
+    }  // namespace messages
+
+}  // namespace baca_protocol
+
+#endif  // BACA_MESSAGES_H_
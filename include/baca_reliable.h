@@ -0,0 +1,379 @@
+#ifndef BACA_RELIABLE_H_
+#define BACA_RELIABLE_H_
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "baca_framer.h"
+#include "baca_messages.h"
+#include "serial_transmitter.h"
+
+/*
+ * Acknowledged delivery of Baca commands. A command is wrapped into
+ *
+ *   ['b'][payload_size + 2][0x70][sequence][message_id][data...][checksum]
+ *
+ * and the device answers with ['b'][3][0x71][sequence][message_id][checksum] once it
+ * executed it. Without the acknowledgement the frame is sent again after the timeout,
+ * up to max_attempts times. Up to 256 commands may be in flight, one per sequence number.
+ *
+ * The round trip time is measured from the last transmission of the command, so an
+ * acknowledgement of an earlier attempt arriving late makes it look shorter. The
+ * latency is measured from the first transmission.
+ */
+
+namespace baca_protocol {
+
+    struct ReliableResult {
+        uint8_t sequence        = 0;
+        uint8_t message_id      = 0;
+        bool    acknowledged    = false;
+        int     attempts        = 0;
+        double  round_trip_time = 0;  // [s]
+        double  latency         = 0;  // [s]
+    };
+
+    // upper bounds of the round trip time histogram buckets [ms], the last bucket is unbounded
+    constexpr std::array<double, 9> RELIABLE_RTT_BUCKETS{1, 2, 5, 10, 20, 50, 100, 200, 500};
+
+    struct ReliableStats {
+        uint64_t sent         = 0;  // commands, not frames
+        uint64_t acknowledged = 0;
+        uint64_t failed       = 0;
+        uint64_t retransmits  = 0;
+        double   rtt_sum      = 0;  // [s]
+        double   rtt_min      = std::numeric_limits<double>::infinity();
+        double   rtt_max      = 0;
+
+        std::array<uint64_t, RELIABLE_RTT_BUCKETS.size() + 1> rtt_histogram{};
+
+        // upper bound of the bucket holding the given fraction of the round trip times [ms], inf for the last one
+        double rttPercentile(double fraction) const {
+            uint64_t count = 0;
+            for (size_t i = 0; i < rtt_histogram.size(); i++) {
+                count += rtt_histogram[i];
+                if (count >= fraction * acknowledged) {
+                    return i < RELIABLE_RTT_BUCKETS.size() ? RELIABLE_RTT_BUCKETS[i] : std::numeric_limits<double>::infinity();
+                }
+            }
+            return std::numeric_limits<double>::infinity();
+        }
+    };
+
+    class ReliableSender {
+    public:
+        using ResultCallback = std::function<void(const ReliableResult &result)>;
+
+        // results of the commands passed to send() go to the callback
+        void init(serial_port::SerialTransmitter *transmitter, double timeout, int max_attempts, ResultCallback callback) {
+            std::scoped_lock lck(mtx_);
+            transmitter_  = transmitter;
+            timeout_      = timeout;
+            max_attempts_ = std::max(max_attempts, 1);
+            callback_     = std::move(callback);
+        }
+
+        // payload starts with the message id, timeout and max_attempts <= 0 use the defaults from init(),
+        // returns false if the payload does not fit into a frame or all sequence numbers are taken
+        bool send(const uint8_t *payload, int size, double timeout = 0, int max_attempts = 0) {
+            std::scoped_lock lck(mtx_);
+            return start(payload, size, timeout, max_attempts, true) >= 0;
+        }
+
+        // blocks until the command is acknowledged or all the attempts time out, the acknowledgement has to
+        // be delivered to handleAck() from another thread
+        ReliableResult sendAndWait(const uint8_t *payload, int size, double timeout = 0, int max_attempts = 0) {
+
+            std::unique_lock lck(mtx_);
+
+            const int sequence = start(payload, size, timeout, max_attempts, false);
+            if (sequence < 0) {
+                return ReliableResult{};
+            }
+
+            Command &command = commands_[sequence];
+
+            while (!command.done) {
+                if (cv_.wait_until(lck, command.deadline) == std::cv_status::timeout) {
+                    expire(command, Clock::now());
+                }
+            }
+
+            const ReliableResult result = command.result;
+            command.active              = false;
+
+            return result;
+        }
+
+        // call with every ReliableAck frame, returns false when it does not acknowledge any pending command,
+        // the frame may then be a message of the device that happens to share the id
+        bool handleAck(const BacaFrame &frame) {
+
+            ResultCallback callback;
+            ReliableResult result;
+
+            {
+                std::scoped_lock lck(mtx_);
+
+                Command &command = commands_[messages::ReliableAck::sequence::read(frame.payload)];
+
+                if (!command.active || command.done || command.result.message_id != messages::ReliableAck::message_id::read(frame.payload)) {
+                    unmatched_acks_++;
+                    return false;
+                }
+
+                const Clock::time_point now = Clock::now();
+                finish(command, true, std::chrono::duration<double>(now - command.last_sent).count(),
+                       std::chrono::duration<double>(now - command.first_sent).count());
+
+                if (!command.blocking) {
+                    result         = command.result;
+                    callback       = callback_;
+                    command.active = false;
+                } else {
+                    cv_.notify_all();
+                }
+            }
+
+            if (callback) {
+                callback(result);
+            }
+
+            return true;
+        }
+
+        // retransmits or gives up the timed out commands passed to send(), call it periodically
+        void checkTimeouts() {
+
+            std::vector<ReliableResult> results;
+            ResultCallback              callback;
+
+            {
+                std::scoped_lock lck(mtx_);
+
+                const Clock::time_point now = Clock::now();
+
+                for (Command &command : commands_) {
+                    if (command.active && !command.blocking && now >= command.deadline) {
+                        expire(command, now);
+                        if (command.done) {
+                            results.push_back(command.result);
+                            command.active = false;
+                        }
+                    }
+                }
+
+                callback = callback_;
+            }
+
+            if (callback) {
+                for (const ReliableResult &result : results) {
+                    callback(result);
+                }
+            }
+        }
+
+        // [s] until the first of the commands passed to send() times out, negative when none is pending,
+        // so that checkTimeouts() can be scheduled instead of polled
+        double timeUntilDeadline() {
+
+            std::scoped_lock lck(mtx_);
+
+            bool              pending = false;
+            Clock::time_point first   = Clock::time_point::max();
+
+            for (const Command &command : commands_) {
+                if (command.active && !command.blocking) {
+                    first   = std::min(first, command.deadline);
+                    pending = true;
+                }
+            }
+
+            if (!pending) {
+                return -1.0;
+            }
+
+            return std::max(std::chrono::duration<double>(first - Clock::now()).count(), 0.0);
+        }
+
+        ReliableStats getStats(uint8_t message_id) {
+            std::scoped_lock lck(mtx_);
+            return stats_[message_id];
+        }
+
+        // one line per message id that was sent, for logging
+        std::string getStatsSummary() {
+
+            std::scoped_lock lck(mtx_);
+
+            std::string summary;
+
+            for (size_t id = 0; id < stats_.size(); id++) {
+
+                const ReliableStats &s = stats_[id];
+                if (s.sent == 0) {
+                    continue;
+                }
+
+                char line[256];
+                snprintf(line, sizeof(line), "%s0x%02X: %lu sent, %lu acknowledged, %lu failed, %lu retransmits, rtt %.2f/%.2f/%.2f ms avg/min/max, p50 <= %.0f ms, p99 <= %.0f ms",
+                         summary.empty() ? "" : "\n", unsigned(id), (unsigned long)s.sent, (unsigned long)s.acknowledged, (unsigned long)s.failed,
+                         (unsigned long)s.retransmits, s.acknowledged > 0 ? s.rtt_sum / s.acknowledged * 1e3 : 0.0, s.acknowledged > 0 ? s.rtt_min * 1e3 : 0.0,
+                         s.rtt_max * 1e3, s.rttPercentile(0.5), s.rttPercentile(0.99));
+                summary += line;
+            }
+
+            if (unmatched_acks_ > 0) {
+                summary += (summary.empty() ? "" : "\n") + std::to_string(unmatched_acks_) + " acknowledgements did not match any command";
+            }
+
+            return summary;
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Command {
+            bool active   = false;
+            bool blocking = false;
+            bool done     = false;
+
+            std::vector<uint8_t>          frame;
+            serial_port::TxPriority       priority = serial_port::TX_CONTROL;
+            std::chrono::duration<double> timeout;
+            int                           max_attempts = 1;
+
+            Clock::time_point first_sent;
+            Clock::time_point last_sent;
+            Clock::time_point deadline;
+
+            ReliableResult result;
+        };
+
+        // returns the sequence number, -1 on failure, expects mtx_ locked
+        int start(const uint8_t *payload, int size, double timeout, int max_attempts, bool notify) {
+
+            // the wrapper adds the reliable command id and the sequence
+            if (size < 1 || size > 253 || !transmitter_) {
+                return -1;
+            }
+
+            int sequence = -1;
+            for (int i = 0; i < 256; i++) {
+                const uint8_t candidate = uint8_t(next_sequence_ + i);
+                if (!commands_[candidate].active) {
+                    sequence = candidate;
+                    break;
+                }
+            }
+
+            if (sequence < 0) {
+                return -1;
+            }
+
+            next_sequence_ = uint8_t(sequence + 1);
+
+            Command &command     = commands_[sequence];
+            command.active       = true;
+            command.blocking     = !notify;
+            command.done         = false;
+            command.priority     = messages::isSafetyMessage(payload[0]) ? serial_port::TX_SAFETY : serial_port::TX_CONTROL;
+            command.timeout      = std::chrono::duration<double>(timeout > 0 ? timeout : timeout_);
+            command.max_attempts = max_attempts > 0 ? max_attempts : max_attempts_;
+            command.result       = ReliableResult{};
+
+            command.result.sequence   = uint8_t(sequence);
+            command.result.message_id = payload[0];
+
+            command.frame.resize(size + 5);
+            command.frame[0] = 'b';
+            command.frame[1] = uint8_t(size + 2);
+            command.frame[2] = messages::RELIABLE_COMMAND_ID;
+            command.frame[3] = uint8_t(sequence);
+            std::copy(payload, payload + size, command.frame.begin() + 4);
+            command.frame[size + 4] = simd::sumBytes(command.frame.data(), size + 4);
+
+            stats_[command.result.message_id].sent++;
+
+            command.first_sent = Clock::now();
+            transmit(command, command.first_sent);
+
+            return sequence;
+        }
+
+        // expects mtx_ locked
+        void transmit(Command &command, const Clock::time_point &now) {
+
+            command.result.attempts++;
+            command.last_sent = now;
+            command.deadline  = now + std::chrono::duration_cast<Clock::duration>(command.timeout);
+
+            transmitter_->send(command.frame.data(), command.frame.size(), command.priority);
+        }
+
+        // retransmits the timed out command or gives it up, expects mtx_ locked
+        void expire(Command &command, const Clock::time_point &now) {
+
+            if (command.done || now < command.deadline) {
+                return;
+            }
+
+            if (command.result.attempts < command.max_attempts) {
+                stats_[command.result.message_id].retransmits++;
+                transmit(command, now);
+            } else {
+                finish(command, false, 0, std::chrono::duration<double>(now - command.first_sent).count());
+            }
+        }
+
+        // expects mtx_ locked
+        void finish(Command &command, bool acknowledged, double round_trip_time, double latency) {
+
+            command.done                   = true;
+            command.result.acknowledged    = acknowledged;
+            command.result.round_trip_time = round_trip_time;
+            command.result.latency         = latency;
+
+            ReliableStats &s = stats_[command.result.message_id];
+
+            if (!acknowledged) {
+                s.failed++;
+                return;
+            }
+
+            s.acknowledged++;
+            s.rtt_sum += round_trip_time;
+            s.rtt_min = std::min(s.rtt_min, round_trip_time);
+            s.rtt_max = std::max(s.rtt_max, round_trip_time);
+
+            const size_t bucket =
+                std::lower_bound(RELIABLE_RTT_BUCKETS.begin(), RELIABLE_RTT_BUCKETS.end(), round_trip_time * 1e3) - RELIABLE_RTT_BUCKETS.begin();
+            s.rtt_histogram[bucket]++;
+        }
+
+        std::mutex              mtx_;
+        std::condition_variable cv_;
+
+        serial_port::SerialTransmitter *transmitter_  = nullptr;
+        double                          timeout_      = 0.05;
+        int                             max_attempts_ = 3;
+        ResultCallback                  callback_;
+
+        std::array<Command, 256>       commands_;
+        uint8_t                        next_sequence_  = 0;
+        std::array<ReliableStats, 256> stats_;
+        uint64_t                       unmatched_acks_ = 0;
+    };
+
+}  // namespace baca_protocol
+
+#endif  // BACA_RELIABLE_H_
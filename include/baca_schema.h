@@ -0,0 +1,157 @@
+#ifndef BACA_SCHEMA_H_
+#define BACA_SCHEMA_H_
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <ratio>
+#include <type_traits>
+
+#include "baca_framer.h"
+
+/*
+ * Compile-time description of the payload of a Baca message:
+ *
+ *   struct Foo : baca_protocol::Schema<4, 0x42> {     // payload_size, message id(s)
+ *     using value = Field<int16_t, 1, std::centi>;    // big-endian, payload[1..2], 0.01 per LSB
+ *     using flag  = Flag<3, 0x01>;                     // bit 0 of payload[3]
+ *   };
+ *
+ *   const double v = Foo::value::get(frame.payload);
+ *
+ * Fields are checked against the payload size at compile time and the accessors compile
+ * down to a load and a byte swap. Offset 0 is always the message id.
+ */
+
+namespace baca_protocol {
+
+    /* byteSwap() //{ */
+
+    template<typename U>
+    constexpr U byteSwap(U value) {
+        static_assert(std::is_unsigned_v<U>, "only unsigned integers can be swapped");
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return value;
+#else
+        if constexpr (sizeof(U) == 1) {
+            return value;
+        } else if constexpr (sizeof(U) == 2) {
+            return __builtin_bswap16(value);
+        } else if constexpr (sizeof(U) == 4) {
+            return __builtin_bswap32(value);
+        } else {
+            static_assert(sizeof(U) == 8, "unsupported integer size");
+            return __builtin_bswap64(value);
+        }
+#endif
+    }
+
+    //}
+
+    /* Field //{ */
+
+    // big-endian integer at a fixed offset of the payload, Scale converts it to physical units
+    template<uint8_t PayloadSize, typename T, uint8_t Offset, typename Scale = std::ratio<1>>
+    struct Field {
+        static_assert(std::is_integral_v<T>, "fields are integers, use Scale for fixed point values");
+        static_assert(Offset >= 1, "offset 0 is the message id");
+        static_assert(Offset + sizeof(T) <= PayloadSize, "the field does not fit into the payload");
+
+        using type = T;
+
+        // the raw value
+        static T read(const uint8_t *payload) {
+            std::make_unsigned_t<T> raw;
+            std::memcpy(&raw, payload + Offset, sizeof(raw));
+            return T(byteSwap(raw));
+        }
+
+        static void write(uint8_t *payload, T value) {
+            const std::make_unsigned_t<T> raw = byteSwap(std::make_unsigned_t<T>(value));
+            std::memcpy(payload + Offset, &raw, sizeof(raw));
+        }
+
+        // the value multiplied by Scale
+        static double get(const uint8_t *payload) {
+            return read(payload) * (double(Scale::num) / double(Scale::den));
+        }
+    };
+
+    //}
+
+    /* Flag //{ */
+
+    // bits of a status byte, several flags may share the byte
+    template<uint8_t PayloadSize, uint8_t Offset, uint8_t Mask>
+    struct Flag {
+        static_assert(Offset >= 1, "offset 0 is the message id");
+        static_assert(Offset < PayloadSize, "the flag does not fit into the payload");
+        static_assert(Mask != 0, "the flag needs at least one bit");
+
+        static bool read(const uint8_t *payload) {
+            return payload[Offset] & Mask;
+        }
+
+        static void write(uint8_t *payload, bool value) {
+            payload[Offset] = value ? (payload[Offset] | Mask) : (payload[Offset] & ~Mask);
+        }
+    };
+
+    //}
+
+    /* Schema //{ */
+
+    template<uint8_t PayloadSize, uint8_t... Ids>
+    struct Schema {
+        static_assert(PayloadSize >= 1, "the payload contains at least the message id");
+        static_assert(sizeof...(Ids) >= 1, "the message needs an id");
+
+        static constexpr uint8_t payload_size = PayloadSize;
+
+        // messages sharing one layout, e.g. the same sensor mounted twice
+        static constexpr std::array<uint8_t, sizeof...(Ids)> ids{Ids...};
+
+        using Payload = std::array<uint8_t, PayloadSize>;
+        using Frame   = std::array<uint8_t, PayloadSize + 3>;
+
+        template<typename T, uint8_t Offset, typename Scale = std::ratio<1>>
+        using Field = baca_protocol::Field<PayloadSize, T, Offset, Scale>;
+
+        template<uint8_t Offset, uint8_t Mask>
+        using Flag = baca_protocol::Flag<PayloadSize, Offset, Mask>;
+
+        static bool matches(const BacaFrame &frame) {
+            if (frame.payload_size != PayloadSize) {
+                return false;
+            }
+            for (const uint8_t id : ids) {
+                if (frame.messageId() == id) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // zeroed payload with the id filled in
+        static Payload payload(uint8_t id = ids[0]) {
+            Payload p{};
+            p[0] = id;
+            return p;
+        }
+
+        // wraps the payload into a complete frame: ['b'][payload_size][payload][checksum]
+        static Frame frame(const Payload &payload) {
+            Frame f;
+            f[0] = 'b';
+            f[1] = PayloadSize;
+            std::memcpy(f.data() + 2, payload.data(), PayloadSize);
+            f[PayloadSize + 2] = uint8_t('b' + PayloadSize + simd::sumBytes(payload.data(), PayloadSize));
+            return f;
+        }
+    };
+
+    //}
+
+}  // namespace baca_protocol
+
+#endif  // BACA_SCHEMA_H_
@@ -0,0 +1,116 @@
+#ifndef CONNECTION_MANAGER_H_
+#define CONNECTION_MANAGER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+namespace serial_port {
+
+    /*
+     * (Re)opens a serial port from a worker thread, so that open() and tcsetattr() blocking
+     * on a flaky usb adapter never stall the ROS callbacks or the read path.
+     * Failed attempts are retried with exponential backoff, jittered so that the nodes of
+     * a re-enumerated hub do not all retry at the same moment.
+     *
+     *   DISCONNECTED -> OPENING -> CONFIGURED -> STREAMING
+     *        ^            |            |            |
+     *        +------------+------------+-- STALE <--+
+     */
+    class ConnectionManager {
+    public:
+        enum State : uint8_t {
+            DISCONNECTED = 0,  // the port is closed, the next attempt is scheduled
+            OPENING      = 1,  // the port is being opened and configured
+            CONFIGURED   = 2,  // the port is open, no data received yet
+            STREAMING    = 3,  // data are being received
+            STALE        = 4,  // no data within the timeout, the port is being reopened
+        };
+
+        struct StateChange {
+            State state;
+            State previous;
+            std::string reason;
+            uint32_t failed_attempts;  // since the last successful open
+            double retry_in;           // [s] until the next attempt, in DISCONNECTED
+        };
+
+        // opens and configures the port, returns false on failure
+        using ConnectFunction = std::function<bool()>;
+        using DisconnectFunction = std::function<void()>;
+        // called from the worker thread
+        using StateCallback = std::function<void(const StateChange &change)>;
+
+        ConnectionManager();
+
+        virtual ~ConnectionManager();
+
+        // [s] delay after the first failed attempt, doubled with every further one up to max
+        void setBackoff(double min, double max);
+
+        // the first attempt is made right away
+        bool start(ConnectFunction connect, DisconnectFunction disconnect, StateCallback callback);
+
+        void stop();
+
+        State getState() const;
+
+        static const char *stateName(State state);
+
+        // lock-free, to be called from the read path
+        void dataReceived();
+
+        // the port failed, it is closed and reopened
+        void connectionLost(const std::string &reason);
+
+        // no data within the timeout, the port is closed and reopened
+        void connectionStale(const std::string &reason);
+
+        // skips the backoff, e.g. when the device node appeared
+        void reconnectNow();
+
+    private:
+        void loop();
+
+        void setState(State state, const std::string &reason, double retry_in = 0.0);
+
+        void wakeUp();
+
+        // [s] jittered delay after failed_attempts_ failures
+        double backoffDelay();
+
+        ConnectFunction connect_;
+        DisconnectFunction disconnect_;
+        StateCallback callback_;
+
+        double backoff_min_ = 0.1;
+        double backoff_max_ = 5.0;
+
+        // accessed by the worker only
+        State published_state_ = DISCONNECTED;
+        uint32_t failed_attempts_ = 0;
+        std::mt19937 random_engine_{std::random_device{}()};
+
+        // STREAMING is set by the read path, all other states by the worker
+        std::atomic<State> state_ = DISCONNECTED;
+
+        // requests from the other threads
+        std::mutex mutex_requests_;
+        bool lost_pending_ = false;
+        bool stale_pending_ = false;
+        bool reconnect_pending_ = false;
+        std::string lost_reason_;
+
+        int wakeup_fd_ = -1;
+        std::thread thread_;
+        std::atomic<bool> running_ = false;
+    };
+
+}  // namespace serial_port
+
+#endif  // CONNECTION_MANAGER_H_
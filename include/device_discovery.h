@@ -0,0 +1,47 @@
+#ifndef DEVICE_DISCOVERY_H_
+#define DEVICE_DISCOVERY_H_
+
+#include <string>
+#include <vector>
+
+namespace serial_port {
+
+    // a tty provided by a usb adapter, as found in sysfs
+    struct UsbSerialDevice {
+        std::string devnode;  // e.g. /dev/ttyUSB0
+        std::string vid;      // idVendor, lowercase hex
+        std::string pid;      // idProduct, lowercase hex
+        std::string serial;   // empty when the adapter has no serial number
+        std::string manufacturer;
+        std::string product;
+        std::string usb_path;   // physical port of the device, e.g. 1-1.2
+        std::string interface;  // interface of the tty, e.g. 1-1.2:1.0, differs between the ports of a multi-port adapter
+    };
+
+    /*
+     * Selects a usb serial adapter by its identity instead of by /dev/ttyUSBx, whose number
+     * follows the enumeration order. Empty fields match anything, usb_path matches either
+     * the device (1-1.2) or one of its interfaces (1-1.2:1.1).
+     */
+    struct UsbDeviceFilter {
+        std::string vid;
+        std::string pid;
+        std::string serial;
+        std::string usb_path;
+
+        bool empty() const;
+
+        bool matches(const UsbSerialDevice &device) const;
+
+        std::string toString() const;
+    };
+
+    // all usb serial ttys, sorted by their device node
+    std::vector<UsbSerialDevice> listUsbSerialDevices(const std::string &sysfs = "/sys");
+
+    // the node of the only device matching the filter, empty with the reason in error when there is none or more than one
+    std::string findUsbSerialDevice(const UsbDeviceFilter &filter, std::string &error, const std::string &sysfs = "/sys");
+
+}  // namespace serial_port
+
+#endif  // DEVICE_DISCOVERY_H_
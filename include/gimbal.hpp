@@ -92,7 +92,7 @@ namespace gimbal {
 
         void receiving_loop([[maybe_unused]] const ros::TimerEvent &evt);
 
-        void process_custom_data_msg(const SBGC_cmd_realtime_data_custom_t &data);
+        void process_custom_data_msg(const SBGC_cmd_realtime_data_custom_t &data, const ros::Time &stamp);
 
         quat_t pry2quat(double pitch, [[maybe_unused]] double roll, double yaw);
 
@@ -0,0 +1,59 @@
+#ifndef HOTPLUG_MONITOR_H_
+#define HOTPLUG_MONITOR_H_
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace serial_port {
+
+    /*
+     * Watches the device node of a serial port with inotify, so that a USB adapter that
+     * disappears (brown-out, re-enumeration) is noticed right away and the port can be
+     * reopened the moment the node comes back, instead of at the next 1 Hz check.
+     * The directory of the path is watched (e.g. /dev or /dev/serial/by-id); while the
+     * directory does not exist, as udev removes by-id together with its last link, its
+     * deepest existing parent is watched until it is created again.
+     * A path ending with a slash (e.g. /dev/) reports every change in the directory,
+     * for devices whose node is not known in advance.
+     */
+    class HotplugMonitor {
+    public:
+        // present is false when the node was removed, true when it appeared or udev changed its permissions
+        using Callback = std::function<void(bool present)>;
+
+        HotplugMonitor();
+
+        virtual ~HotplugMonitor();
+
+        // the callback is called from the thread of the monitor
+        bool start(const std::string &path, Callback callback);
+
+        void stop();
+
+        bool isRunning() const;
+
+    private:
+        void loop();
+
+        // (re)adds the watch of the directory of the node, or of its deepest existing parent
+        void watchDirectory();
+
+        std::string path_;
+        std::string directory_;
+        std::string name_;
+        Callback callback_;
+
+        int inotify_fd_ = -1;
+        int wakeup_fd_ = -1;
+        int directory_wd_ = -1;
+        int parent_wd_ = -1;
+
+        std::thread thread_;
+        std::atomic<bool> running_ = false;
+    };
+
+}  // namespace serial_port
+
+#endif  // HOTPLUG_MONITOR_H_
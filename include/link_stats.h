@@ -0,0 +1,345 @@
+#ifndef LINK_STATS_H_
+#define LINK_STATS_H_
+
+#include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include <diagnostic_msgs/KeyValue.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "serial_port.h"
+
+namespace serial_port {
+
+    /* LatencyHistogram //{ */
+
+    /*
+     * HDR-style histogram of latencies in microseconds: 32 linear buckets below 32 us, then
+     * 16 buckets per power of two, i.e. at most 6 % relative error up to ~18 minutes.
+     * record() is lock-free and may be called from any thread, the percentiles are taken
+     * over the values recorded since the previous call of snapshot().
+     */
+    class LatencyHistogram {
+    public:
+        static constexpr int BUCKETS = 448;
+
+        struct Snapshot {
+            uint64_t count = 0;
+            double   p50   = 0;  // [us] upper bounds of the buckets
+            double   p99   = 0;
+            double   max   = 0;  // [us] exact, since the start
+        };
+
+        void record(double seconds) {
+
+            const uint64_t us = seconds > 0 ? uint64_t(seconds * 1e6) : 0;
+
+            counts_[index(us)].fetch_add(1, std::memory_order_relaxed);
+
+            uint64_t max = max_.load(std::memory_order_relaxed);
+            while (us > max && !max_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+            }
+        }
+
+        // only one thread may take snapshots
+        Snapshot snapshot() {
+
+            std::array<uint64_t, BUCKETS> counts;
+            Snapshot s;
+
+            for (int i = 0; i < BUCKETS; i++) {
+                const uint64_t total = counts_[i].load(std::memory_order_relaxed);
+                counts[i]            = total - previous_[i];
+                previous_[i]         = total;
+                s.count += counts[i];
+            }
+
+            s.p50 = percentile(counts, s.count, 0.5);
+            s.p99 = percentile(counts, s.count, 0.99);
+            s.max = double(max_.load(std::memory_order_relaxed));
+
+            return s;
+        }
+
+    private:
+        static int index(uint64_t us) {
+
+            if (us < 32) {
+                return int(us);
+            }
+
+            // us >> shift lies in [16, 32)
+            const int shift = 63 - __builtin_clzll(us) - 4;
+            return std::min(shift * 16 + int(us >> shift), BUCKETS - 1);
+        }
+
+        static double upperBound(int index) {
+
+            if (index < 32) {
+                return index;
+            }
+
+            const int shift = index / 16 - 1;
+            return double(((uint64_t(index % 16 + 16) + 1) << shift) - 1);
+        }
+
+        static double percentile(const std::array<uint64_t, BUCKETS> &counts, uint64_t total, double fraction) {
+
+            if (total == 0) {
+                return 0;
+            }
+
+            uint64_t count = 0;
+            for (int i = 0; i < BUCKETS; i++) {
+                count += counts[i];
+                if (count >= fraction * total) {
+                    return upperBound(i);
+                }
+            }
+
+            return upperBound(BUCKETS - 1);
+        }
+
+        std::array<std::atomic<uint64_t>, BUCKETS> counts_{};
+        std::atomic<uint64_t>                      max_ = 0;
+
+        std::array<uint64_t, BUCKETS> previous_{};
+    };
+
+    //}
+
+    /* LinkStats //{ */
+
+    /*
+     * Health of a serial link: received bytes, frames per message id, framing errors, the error
+     * counters of the UART driver and the latencies of the frames, reported as a
+     * diagnostic_msgs/DiagnosticStatus. The counters are
+     * lock-free 64-bit atomics updated by the thread decoding the port, fillDiagnostics() is
+     * called periodically from one other thread and reports the rates since its previous call.
+     */
+    class LinkStats {
+    public:
+        // a bad checksum rate above this fraction of the frames makes the status a warning
+        explicit LinkStats(double bad_checksum_warn = 0.01) : bad_checksum_warn_(bad_checksum_warn) {
+        }
+
+        // totals kept by the decoder, e.g. BacaFramerStats, call after each decoded chunk
+        void setDecoderTotals(uint64_t bytes, uint64_t frames_ok, uint64_t frames_bad_checksum, uint64_t frames_zero_size, uint64_t frames_recovered) {
+            bytes_.store(bytes, std::memory_order_relaxed);
+            frames_ok_.store(frames_ok, std::memory_order_relaxed);
+            frames_bad_checksum_.store(frames_bad_checksum, std::memory_order_relaxed);
+            frames_zero_size_.store(frames_zero_size, std::memory_order_relaxed);
+            frames_recovered_.store(frames_recovered, std::memory_order_relaxed);
+        }
+
+        // a valid frame was handled, the latencies are from its parsing and its arrival to the end of its handler
+        void recordFrame(uint8_t message_id, double parse_to_publish, double arrival_to_publish) {
+            frames_by_id_[message_id].fetch_add(1, std::memory_order_relaxed);
+            parse_to_publish_.record(parse_to_publish);
+            arrival_to_publish_.record(arrival_to_publish);
+        }
+
+        // kernel counters of the port, call from the thread calling fillDiagnostics() right before it
+        void setUartCounters(const UartCounters &counters) {
+            uart_ = counters;
+        }
+
+        // what the port applied of the low latency options, reported with every status
+        void setLowLatencyState(const LowLatencyState &state) {
+            low_latency_ = state;
+        }
+
+        void fillDiagnostics(diagnostic_msgs::DiagnosticStatus &status, const ros::Time &now) {
+
+            const double period = previous_stamp_.isZero() ? 0.0 : (now - previous_stamp_).toSec();
+            previous_stamp_     = now;
+
+            const uint64_t bytes     = bytes_.load(std::memory_order_relaxed);
+            const uint64_t ok        = frames_ok_.load(std::memory_order_relaxed);
+            const uint64_t bad       = frames_bad_checksum_.load(std::memory_order_relaxed);
+            const uint64_t zero_size = frames_zero_size_.load(std::memory_order_relaxed);
+            const uint64_t recovered = frames_recovered_.load(std::memory_order_relaxed);
+
+            const uint64_t period_bytes = bytes - previous_bytes_;
+            const uint64_t period_ok    = ok - previous_ok_;
+            const uint64_t period_bad   = bad - previous_bad_;
+
+            previous_bytes_ = bytes;
+            previous_ok_    = ok;
+            previous_bad_   = bad;
+
+            status.values.clear();
+            addValue(status, "bytes/s", period > 0 ? period_bytes / period : 0.0);
+            addValue(status, "frames/s", period > 0 ? period_ok / period : 0.0);
+            addValue(status, "bytes", bytes);
+            addValue(status, "frames ok", ok);
+            addDelta(status, "frames bad checksum", period_bad, bad);
+            addValue(status, "frames zero size", zero_size);
+            addValue(status, "frames recovered by resync", recovered);
+
+            for (size_t id = 0; id < frames_by_id_.size(); id++) {
+                const uint64_t frames = frames_by_id_[id].load(std::memory_order_relaxed);
+                if (frames > 0) {
+                    char key[32];
+                    snprintf(key, sizeof(key), "frames id 0x%02X", unsigned(id));
+                    addValue(status, key, frames);
+                }
+            }
+
+            addLatency(status, "parse to publish", parse_to_publish_.snapshot());
+            addLatency(status, "arrival to publish", arrival_to_publish_.snapshot());
+
+            // the kernel side: bytes lost before the decoder saw them, or corrupted on the line
+            UartCounters uart_delta;
+            if (uart_.supported) {
+                uart_delta.rx          = counterDelta(uart_.rx, previous_uart_.rx);
+                uart_delta.tx          = counterDelta(uart_.tx, previous_uart_.tx);
+                uart_delta.frame       = counterDelta(uart_.frame, previous_uart_.frame);
+                uart_delta.overrun     = counterDelta(uart_.overrun, previous_uart_.overrun);
+                uart_delta.parity      = counterDelta(uart_.parity, previous_uart_.parity);
+                uart_delta.brk         = counterDelta(uart_.brk, previous_uart_.brk);
+                uart_delta.buf_overrun = counterDelta(uart_.buf_overrun, previous_uart_.buf_overrun);
+                previous_uart_         = uart_;
+
+                addDelta(status, "uart rx bytes", uart_delta.rx, uart_.rx);
+                addDelta(status, "uart tx bytes", uart_delta.tx, uart_.tx);
+                addDelta(status, "uart frame errors", uart_delta.frame, uart_.frame);
+                addDelta(status, "uart overruns", uart_delta.overrun, uart_.overrun);
+                addDelta(status, "uart parity errors", uart_delta.parity, uart_.parity);
+                addDelta(status, "uart breaks", uart_delta.brk, uart_.brk);
+                addDelta(status, "uart buffer overruns", uart_delta.buf_overrun, uart_.buf_overrun);
+            } else {
+                addText(status, "uart counters", "not supported by the driver");
+            }
+
+            if (low_latency_.requested) {
+                addText(status, "async low latency",
+                        low_latency_.async_low_latency_supported ? (low_latency_.async_low_latency ? "on" : "off") : "not supported by the driver");
+                addText(status, "latency timer [ms]", low_latency_.latency_timer >= 0 ? std::to_string(low_latency_.latency_timer) : "not present");
+                if (!low_latency_.error.empty()) {
+                    addText(status, "low latency error", low_latency_.error);
+                }
+            }
+
+            if (period > 0 && period_bytes == 0) {
+                status.level   = diagnostic_msgs::DiagnosticStatus::WARN;
+                status.message = "no data received";
+            } else if (uart_delta.overrun > 0 || uart_delta.buf_overrun > 0) {
+                status.level   = diagnostic_msgs::DiagnosticStatus::WARN;
+                status.message = "kernel overruns, data lost";
+            } else if (uart_delta.frame > 0 || uart_delta.parity > 0) {
+                status.level   = diagnostic_msgs::DiagnosticStatus::WARN;
+                status.message = "line errors";
+            } else if (period_bad > bad_checksum_warn_ * (period_ok + period_bad)) {
+                status.level   = diagnostic_msgs::DiagnosticStatus::WARN;
+                status.message = "bad checksums";
+            } else {
+                status.level   = diagnostic_msgs::DiagnosticStatus::OK;
+                status.message = "ok";
+            }
+        }
+
+        // a whole message for /diagnostics, an error while the port is disconnected
+        diagnostic_msgs::DiagnosticArray makeDiagnostics(const std::string &name, const std::string &hardware_id, bool connected, const ros::Time &now) {
+
+            diagnostic_msgs::DiagnosticStatus status;
+            status.name        = name;
+            status.hardware_id = hardware_id;
+            fillDiagnostics(status, now);
+
+            if (!connected) {
+                status.level   = diagnostic_msgs::DiagnosticStatus::ERROR;
+                status.message = "disconnected";
+            }
+
+            diagnostic_msgs::DiagnosticArray diagnostics;
+            diagnostics.header.stamp = now;
+            diagnostics.status.push_back(status);
+
+            return diagnostics;
+        }
+
+    private:
+        // the kernel counters are 32-bit, a counter going back by less than half of its range was reset, e.g. the device reappeared
+        static uint64_t counterDelta(uint64_t now, uint64_t previous) {
+            if (now >= previous) {
+                return now - previous;
+            }
+            return previous - now > (uint64_t(1) << 31) ? now + (uint64_t(1) << 32) - previous : now;
+        }
+
+        static void addDelta(diagnostic_msgs::DiagnosticStatus &status, const std::string &key, uint64_t delta, uint64_t total) {
+            diagnostic_msgs::KeyValue kv;
+            kv.key   = key;
+            kv.value = std::to_string(delta) + " (" + std::to_string(total) + " total)";
+            status.values.push_back(kv);
+        }
+
+        static void addText(diagnostic_msgs::DiagnosticStatus &status, const std::string &key, const std::string &value) {
+            diagnostic_msgs::KeyValue kv;
+            kv.key   = key;
+            kv.value = value;
+            status.values.push_back(kv);
+        }
+
+        static void addValue(diagnostic_msgs::DiagnosticStatus &status, const std::string &key, uint64_t value) {
+            diagnostic_msgs::KeyValue kv;
+            kv.key   = key;
+            kv.value = std::to_string(value);
+            status.values.push_back(kv);
+        }
+
+        static void addValue(diagnostic_msgs::DiagnosticStatus &status, const std::string &key, double value) {
+            char text[32];
+            snprintf(text, sizeof(text), "%.1f", value);
+            diagnostic_msgs::KeyValue kv;
+            kv.key   = key;
+            kv.value = text;
+            status.values.push_back(kv);
+        }
+
+        static void addLatency(diagnostic_msgs::DiagnosticStatus &status, const std::string &name, const LatencyHistogram::Snapshot &s) {
+            char value[96];
+            snprintf(value, sizeof(value), "p50 %.0f, p99 %.0f, max %.0f (%lu frames)", s.p50, s.p99, s.max, (unsigned long)s.count);
+            diagnostic_msgs::KeyValue kv;
+            kv.key   = name + " [us]";
+            kv.value = value;
+            status.values.push_back(kv);
+        }
+
+        double bad_checksum_warn_;
+
+        std::atomic<uint64_t> bytes_               = 0;
+        std::atomic<uint64_t> frames_ok_           = 0;
+        std::atomic<uint64_t> frames_bad_checksum_ = 0;
+        std::atomic<uint64_t> frames_zero_size_    = 0;
+        std::atomic<uint64_t> frames_recovered_    = 0;
+
+        std::array<std::atomic<uint64_t>, 256> frames_by_id_{};
+
+        LatencyHistogram parse_to_publish_;
+        LatencyHistogram arrival_to_publish_;
+
+        // values at the previous fillDiagnostics()
+        ros::Time previous_stamp_;
+        uint64_t  previous_bytes_ = 0;
+        uint64_t  previous_ok_    = 0;
+        uint64_t  previous_bad_   = 0;
+
+        UartCounters uart_;
+        UartCounters previous_uart_;
+
+        LowLatencyState low_latency_;
+    };
+
+    //}
+
+}  // namespace serial_port
+
+#endif  // LINK_STATS_H_
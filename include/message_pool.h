@@ -0,0 +1,65 @@
+#ifndef MESSAGE_POOL_H_
+#define MESSAGE_POOL_H_
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace serial_port {
+
+    /*
+     * Recycled ROS messages of one topic. Publishing a boost::shared_ptr<const Msg> lets
+     * subscribers in the same nodelet manager get the message without serialization, and
+     * they may keep it as long as they like. The pool hands out a message again only once
+     * nobody else holds it, i.e. the pool owns the last reference. After warming up, no
+     * message or shared_ptr control block is allocated per frame.
+     *
+     * acquire() may be called only from one thread.
+     */
+    template<typename Msg>
+    class MessagePool {
+    public:
+        explicit MessagePool(size_t size = 8, size_t max_size = 64) : max_size_(max_size) {
+            pool_.reserve(size);
+            for (size_t i = 0; i < size; i++) {
+                pool_.push_back(boost::make_shared<Msg>());
+            }
+        }
+
+        // the fields keep the values of the previous use, overwrite all of them
+        boost::shared_ptr<Msg> acquire() {
+
+            for (size_t i = 0; i < pool_.size(); i++) {
+
+                boost::shared_ptr<Msg> &msg = pool_[next_];
+                next_ = (next_ + 1) % pool_.size();
+
+                if (msg.use_count() == 1) {
+                    return msg;
+                }
+            }
+
+            // every message is still held by a subscriber, e.g. in its queue
+            if (pool_.size() >= max_size_) {
+                return boost::make_shared<Msg>();
+            }
+
+            pool_.push_back(boost::make_shared<Msg>());
+            return pool_.back();
+        }
+
+        size_t size() const {
+            return pool_.size();
+        }
+
+    private:
+        std::vector<boost::shared_ptr<Msg>> pool_;
+        size_t max_size_;
+        size_t next_ = 0;
+    };
+
+}  // namespace serial_port
+
+#endif  // MESSAGE_POOL_H_
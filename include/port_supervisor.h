@@ -0,0 +1,104 @@
+#ifndef PORT_SUPERVISOR_H_
+#define PORT_SUPERVISOR_H_
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include <ros/ros.h>
+
+#include "connection_manager.h"
+#include "device_discovery.h"
+#include "hotplug_monitor.h"
+#include "serial_port.h"
+#include "serial_reactor.h"
+
+namespace serial_port {
+
+    /*
+     * Keeps the serial port of a nodelet open: the connection manager (re)opens the port from
+     * its worker, the supervisor registers it with the reactor after every connect and publishes
+     * the state of the connection (latched) on connection_state. A hotplug monitor reports a
+     * removed device node right away and skips the backoff when it comes back. The nodelet hands
+     * over its data callback, reports the received data with dataReceived() and runs
+     * checkConnection() from its 1 Hz maintainer timer.
+     */
+    class PortSupervisor {
+    public:
+        struct Options {
+            std::string portname;
+            UsbDeviceFilter device_filter;  // looks the port up by the usb identity of the device instead, when set
+            int baudrate = 115200;
+            int buffer_size = 1024;         // of the reads of the reactor
+            bool use_timeout = true;
+            double timeout = 1.0;           // [s] without data, after which the port is reopened
+            double backoff_min = 0.1;       // [s] see ConnectionManager::setBackoff()
+            double backoff_max = 5.0;
+            bool use_hotplug = true;        // reopens the port as soon as its device node reappears
+        };
+
+        explicit PortSupervisor(SerialPort *port);
+
+        virtual ~PortSupervisor();
+
+        // without a reactor, the nodelet reads the port from its own timer; the first attempt is made right away
+        bool start(ros::NodeHandle &nh, const Options &options, SerialReactor *reactor, SerialReactor::DataCallback data_callback);
+
+        void stop();
+
+        bool isConnected() const;
+
+        // the port that was opened last, or that is being opened, replaced on reconnect when the device is looked up
+        std::string getPortname() const;
+
+        // lock-free, to be called from the read path
+        void dataReceived(const ros::Time &now);
+
+        /*
+         * The checks of the maintainer timer: a port that fails tcgetattr() is closed and reopened,
+         * so is a port that did not receive anything within the timeout. The worker holds the lock
+         * while it (re)opens the port, the checks then wait for the next tick instead of blocking the callbacks.
+         */
+        void checkConnection();
+
+        // the port failed, it is closed and reopened
+        void connectionLost(const std::string &reason);
+
+        // skips the backoff, e.g. when the device node appeared
+        void reconnectNow();
+
+    private:
+        // called by the worker of the connection manager
+        bool connect();
+
+        void disconnect();
+
+        void publishState(const ConnectionManager::StateChange &change);
+
+        // called from the thread of the hotplug monitor
+        void callbackHotplug(bool present);
+
+        SerialPort *port_;
+        SerialReactor *reactor_ = nullptr;
+        SerialReactor::DataCallback data_callback_;
+        Options options_;
+
+        std::atomic<bool> connected_ = false;
+        std::atomic<double> last_received_ = 0.0;  // [s] ROS time
+
+        ros::Publisher state_publisher_;
+
+        // the port is opened and closed only by the worker of the connection manager, mutex_portname_ guards the port resolved by the discovery
+        std::mutex mutex_connection_;
+        mutable std::mutex mutex_portname_;
+        std::string portname_;
+        ConnectionManager connection_manager_;
+
+        // declared last, so that its thread stops before the connection manager
+        HotplugMonitor hotplug_monitor_;
+    };
+
+}  // namespace serial_port
+
+#endif  // PORT_SUPERVISOR_H_
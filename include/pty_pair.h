@@ -0,0 +1,55 @@
+#ifndef PTY_PAIR_H_
+#define PTY_PAIR_H_
+
+#include <string>
+
+namespace serial_port {
+
+    /*
+     * Pseudo terminal standing in for a serial device: the port side is opened by
+     * SerialPort::connect() like any tty, the device side (the pty master) is written
+     * and read by whoever plays the device, e.g. the virtual_device tool.
+     * The pair keeps its own handle of the port side open, so the device side sees
+     * no hangup while the port is closed or being reopened, as with a real UART.
+     * Closing the pair hangs up the port, as a removed usb adapter does.
+     */
+    class PtyPair {
+    public:
+        PtyPair();
+
+        virtual ~PtyPair();
+
+        PtyPair(const PtyPair &) = delete;
+
+        PtyPair &operator=(const PtyPair &) = delete;
+
+        /*
+         * With a link, a symlink of that path points to the port side (replacing an existing
+         * symlink, never a regular file), so that a node can keep a fixed portname while
+         * the pty gets a new /dev/pts number with every open. False with errno set on failure.
+         */
+        bool open(const std::string &link = "");
+
+        // hangs up the port side and removes the link
+        void close();
+
+        bool isOpen() const;
+
+        // the pty master, blocking unless the caller changes it
+        int getDeviceFd() const;
+
+        // the link if there is one, the /dev/pts node otherwise
+        std::string getPortPath() const;
+
+        std::string getPtsPath() const;
+
+    private:
+        int device_fd_ = -1;
+        int hold_fd_ = -1;
+        std::string pts_path_;
+        std::string link_;
+    };
+
+}  // namespace serial_port
+
+#endif  // PTY_PAIR_H_
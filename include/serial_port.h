@@ -1,7 +1,10 @@
 #ifndef SERIAL_PORT_H_
 #define SERIAL_PORT_H_
 
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <ros/package.h>
 #include <ros/ros.h>
 #include <stdio.h>    // Standard input/output definitions
@@ -14,32 +17,242 @@
 #include <aio.h>
 
 #include <string>
+#include <vector>
+#include <sys/uio.h>
+
+#include "spsc_ring.h"
 
 namespace serial_port {
 
+    struct RxRingStats {
+        size_t capacity = 0;
+        size_t used = 0;
+        size_t high_water = 0;     // the most bytes that have been waiting in the ring
+        uint64_t received = 0;     // bytes read from the fd by the reader thread
+        uint64_t dropped = 0;      // bytes that did not fit into the ring
+    };
+
+    // interrupt counters of the UART driver (TIOCGICOUNT), totals since the device appeared
+    struct UartCounters {
+        bool supported = false;    // the driver implements TIOCGICOUNT, e.g. not a pty
+        uint64_t rx = 0;           // bytes received by the UART
+        uint64_t tx = 0;
+        uint64_t frame = 0;        // framing errors, usually a wrong baudrate or noise
+        uint64_t overrun = 0;      // the UART FIFO overflowed before the driver read it
+        uint64_t parity = 0;
+        uint64_t brk = 0;          // break conditions
+        uint64_t buf_overrun = 0;  // the tty flip buffer overflowed, the ldisc did not keep up
+    };
+
+    // what connect() managed to apply of the options requested by setLowLatency()
+    struct LowLatencyState {
+        bool requested = false;
+        bool async_low_latency_supported = false;  // the driver implements TIOCGSERIAL/TIOCSSERIAL
+        bool async_low_latency = false;            // the flag as read back from the driver
+        int latency_timer = -1;                    // [ms] read back from sysfs, -1 if the device has none (not an FTDI)
+        std::string latency_timer_path;
+        std::string error;                         // why a requested value could not be applied
+    };
+
+    // end of a chunk read by the reader thread in the stream of bytes pushed into the ring
+    struct RxChunkMark {
+        uint64_t end = 0;
+        ros::Time stamp;    // when the read() of the chunk returned
+    };
+
+    // system calls and bytes of the data path, to compare the I/O backends
+    struct IoStats {
+        bool rx_io_uring = false;   // the reader thread reads through io_uring
+        bool tx_io_uring = false;   // sendFrames() writes through io_uring
+        uint64_t rx_syscalls = 0;   // of readSerial() and of the reader thread
+        uint64_t rx_bytes = 0;
+        uint64_t tx_syscalls = 0;
+        uint64_t tx_bytes = 0;
+    };
+
+    class UringQueue;
+
+    class PtyPair;
+
     class SerialPort {
     public:
         SerialPort();
 
         virtual ~SerialPort();
 
+        // any baudrate is accepted, the ones without a Bxxx constant are set through termios2/BOTHER
         bool connect(const std::string port, int baudrate);
 
+        // opens the pair if it is not open yet and connects to its port side, to run without the hardware
+        bool connectPty(PtyPair &pty, int baudrate);
+
+        // the rate the kernel actually applied and its relative error against the requested one
+        int getAppliedBaudrate() const;
+
+        double getBaudrateError() const;
+
         void disconnect();
 
+        /*
+         * Low latency mode, applied by every following connect(): sets ASYNC_LOW_LATENCY through
+         * TIOCSSERIAL and, for FTDI adapters, writes latency_timer_ms to the latency_timer of the
+         * device in sysfs (16 ms by default, which holds back small frames for that long). Settings
+         * the driver does not have or the user may not change are skipped, see getLowLatencyState().
+         */
+        void setLowLatency(bool enable, int latency_timer_ms);
+
+        LowLatencyState getLowLatencyState() const;
+
+        /*
+         * io_uring backend, applied by every following connect(). The reader thread (the reads go
+         * through io_uring only with it, see enableReaderThread()) gets the data from a multishot
+         * read into provided buffers, or from a poll linked to a read into a registered buffer on
+         * kernels before 6.7, and handles all completions of a wake up at once.
+         * sendFrames() submits the frames as linked writes with a single system call, from the
+         * thread that called it first after the connect (the transmitter's). Where the
+         * kernel has no io_uring or it is disabled, the port stays with poll() and plain
+         * read()/write(), see getIoStats(). So does a build against kernel headers without io_uring.
+         */
+        void setIoUring(bool enable);
+
+        IoStats getIoStats() const;
+
         virtual bool sendChar(const char c);
 
         virtual bool sendCharArray(uint8_t *buffer, int len);
 
+        // writes the whole frame with a single write() (retried only on a partial write), without flushing the output
+        virtual bool sendFrame(const uint8_t *buffer, int len);
+
+        // writes the frames in order, as linked writes with one system call through io_uring, otherwise with sendFrame() each,
+        // returns how many were written in full, it stops at the first frame that fails
+        virtual int sendFrames(const struct iovec *frames, int count);
+
+        // bytes written but not yet sent out by the UART, -1 if unknown
+        int getOutputQueueBytes() const;
+
         void setBlocking(int fd, int should_block);
 
+        // false when the port is gone, the port is left open for the caller to disconnect()
         bool checkConnected();
 
+        // supported is false if the port is closed or the driver does not count the interrupts
+        UartCounters getUartCounters() const;
+
         virtual bool readChar(uint8_t *c);
 
         virtual int readSerial(uint8_t *arr, int arr_max_size);
 
-        int serial_port_fd_;
+        /*
+         * Arrival time of a byte returned by the last readSerial(), given how many bytes of the
+         * returned chunk came after it. The last byte arrived when the read() of the chunk returned
+         * (in the reader thread if it is enabled), the bytes before it are assumed to have come
+         * back to back, one character time apart. Call it from the thread calling readSerial().
+         */
+        ros::Time getByteStamp(size_t bytes_after) const;
+
+        // [s] of one character on the wire, start, 8 data and 1 stop bit
+        double getByteTime() const;
+
+        /*
+         * Reader-thread mode: a dedicated thread blocks on the fd and pushes the data into
+         * a lock-free SPSC ring of ring_size bytes, readSerial() then consumes from the ring.
+         * Call it before connect(), the thread follows the port through reconnects.
+         */
+        bool enableReaderThread(size_t ring_size);
+
+        bool isReaderThreadEnabled() const;
+
+        RxRingStats getRxRingStats() const;
+
+        // fd that becomes readable when readSerial() has data (the fd of the port or a ring notification eventfd)
+        int getReadableFd() const;
+
+        int serial_port_fd_ = -1;
+
+    private:
+        bool setCustomBaudrate(int baudrate);
+
+        void checkAppliedBaudrate(int requested_baudrate);
+
+        void applyLowLatency(const std::string &port);
+
+        void startReaderThread();
+
+        void stopReaderThread();
+
+        void readerLoop(int fd);
+
+        // false if io_uring is not available, the reader thread then uses readerLoop()
+        bool setupRxUring(int fd);
+
+        void readerLoopUring(int fd);
+
+        // queues giving the buffer back to the multishot read, submitted with the next wait
+        void provideRxBuffers(uint16_t first, uint16_t count);
+
+        // reader thread only, pushes a chunk and its mark into the rings
+        void pushChunk(const uint8_t *data, int len, const ros::Time &stamp);
+
+        void notifyRxRing();
+
+        // with tx_uring_mtx_ held, in the thread that will submit to the ring
+        bool setupTxUring();
+
+        int sendFramesUring(const struct iovec *frames, int count);
+
+        // sendFrame() with fd_mtx_ held, false when the tty buffer stays full for longer than the frame takes to send
+        bool writeFrame(const uint8_t *buffer, int len);
+
+        /*
+         * Held by connect(), disconnect(), checkConnected(), the reads without the reader thread
+         * and the send paths: the port is reopened by the connection manager's worker while the
+         * transmitter's thread may be writing to it and the reactor or a timer reading from it.
+         */
+        mutable std::mutex fd_mtx_;
+
+        int applied_baudrate_ = 0;
+        double baudrate_error_ = 0.0;
+        double byte_time_ = 0.0;
+
+        ros::Time last_read_stamp_;   // without the reader thread
+
+        bool low_latency_ = false;
+        int latency_timer_ms_ = 1;
+        mutable std::mutex low_latency_mtx_;
+        LowLatencyState low_latency_state_;
+
+        std::unique_ptr<SpscRing<uint8_t>> rx_ring_;
+        std::thread reader_thread_;
+        std::atomic<bool> reader_running_ = false;
+        int reader_wakeup_fd_ = -1;
+        int rx_notify_fd_ = -1;
+
+        // arrival times of the chunks in the ring, pushed by the reader thread
+        std::unique_ptr<SpscRing<RxChunkMark>> rx_marks_;
+        uint64_t rx_pushed_ = 0;      // reader thread only
+        uint64_t rx_popped_ = 0;      // consumer only
+        RxChunkMark rx_mark_;         // the newest mark popped
+        std::vector<RxChunkMark> rx_chunk_marks_;  // of the bytes returned by the last readSerial()
+
+        std::atomic<size_t> rx_ring_high_water_ = 0;
+        std::atomic<uint64_t> rx_ring_received_ = 0;
+        std::atomic<uint64_t> rx_ring_dropped_ = 0;
+
+        bool use_io_uring_ = false;
+        std::unique_ptr<UringQueue> rx_uring_;      // set up by startReaderThread(), then used by the reader thread only
+        bool rx_uring_multishot_ = false;
+        std::atomic<bool> rx_uring_active_ = false;
+        std::vector<uint8_t> rx_uring_buffers_;     // provided to the multishot read, the first one registered for the fixed read
+        std::unique_ptr<UringQueue> tx_uring_;     // of the first thread calling sendFrames() after connect()
+        std::thread::id tx_uring_owner_;
+        bool tx_uring_pending_ = false;
+        mutable std::mutex tx_uring_mtx_;
+
+        std::atomic<uint64_t> rx_syscalls_ = 0;
+        std::atomic<uint64_t> rx_bytes_ = 0;        // without the reader thread
+        std::atomic<uint64_t> tx_syscalls_ = 0;
+        std::atomic<uint64_t> tx_bytes_ = 0;
     };
 
     class SerialPortThreadsafe : public SerialPort {
@@ -54,6 +267,16 @@ namespace serial_port {
             return SerialPort::sendCharArray(buffer, len);
         };
 
+        virtual bool sendFrame(const uint8_t *buffer, int len) override {
+            std::scoped_lock lck(mtx_);
+            return SerialPort::sendFrame(buffer, len);
+        };
+
+        virtual int sendFrames(const struct iovec *frames, int count) override {
+            std::scoped_lock lck(mtx_);
+            return SerialPort::sendFrames(frames, count);
+        };
+
         virtual bool readChar(uint8_t *c) override {
             std::scoped_lock lck(mtx_);
             return SerialPort::readChar(c);
@@ -0,0 +1,111 @@
+#ifndef SERIAL_REACTOR_H_
+#define SERIAL_REACTOR_H_
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <ros/callback_queue_interface.h>
+
+#include "serial_port.h"
+
+namespace serial_port {
+
+    /*
+     * Event-driven replacement of the polling serial timers.
+     * A single thread sleeps in epoll_wait() on all registered ports and
+     * calls the port's callback with every chunk of data as soon as the
+     * file descriptor becomes readable.
+     *
+     * With startShared(), the reactor is only a handle of one reactor shared by
+     * all nodelets of the process, so that a nodelet manager runs one I/O thread
+     * instead of one per device. With a callback queue set, the reactor thread
+     * does not read the data itself: it queues one callback per burst into the
+     * queue (e.g. the nodelet's), which drains the port and re-arms it, so that a
+     * slow nodelet cannot hold back the ports of the others and the chunks of a
+     * port are still handled in order, by one thread at a time.
+     */
+    class SerialReactor {
+    public:
+        using DataCallback = std::function<void(const uint8_t *data, int len)>;
+
+        SerialReactor();
+
+        virtual ~SerialReactor();
+
+        bool start();
+
+        // attaches to the reactor shared within the process instead of running an own thread, call it instead of start()
+        bool startShared();
+
+        void stop();
+
+        bool isRunning() const;
+
+        // the ports added afterwards are read in this queue instead of in the reactor thread, nullptr reads them in the thread
+        void setCallbackQueue(ros::CallbackQueueInterface *queue);
+
+        // (re)registers the port's readable fd, call it after every successful connect()
+        bool addPort(SerialPort *port, DataCallback callback, int buffer_size = 1024);
+
+        // blocks until a callback of the port that is being dispatched returns
+        void removePort(SerialPort *port);
+
+    private:
+        struct Port {
+            uint64_t id;
+            SerialPort *port;
+            int fd;
+            DataCallback callback;
+            std::vector<uint8_t> buffer;
+            ros::CallbackQueueInterface *queue;
+
+            // held while the data are read in the queue, removePort() waits for it
+            std::recursive_mutex busy;
+            bool removed = false;
+        };
+
+        class ReadCallback;
+
+        static std::shared_ptr<SerialReactor> getShared();
+
+        bool registerPort(SerialPort *port, DataCallback callback, int buffer_size, ros::CallbackQueueInterface *queue);
+
+        void loop();
+
+        void dispatch(uint64_t id, uint32_t events);
+
+        // reads the fd until it would block, returns false if it failed
+        bool drain(Port &p);
+
+        // called from the callback queue
+        void drainQueued(const std::shared_ptr<Port> &p);
+
+        void markRemoved(const std::vector<std::shared_ptr<Port>> &ports);
+
+        int epoll_fd_ = -1;
+        int wakeup_fd_ = -1;
+
+        std::thread thread_;
+        std::atomic<bool> running_ = false;
+
+        // recursive, so that callbacks may remove their own port
+        std::recursive_mutex mtx_;
+        std::map<uint64_t, std::shared_ptr<Port>> ports_;
+        uint64_t next_id_ = 1;
+
+        ros::CallbackQueueInterface *queue_ = nullptr;
+
+        // of a handle of the shared reactor, the ports are removed from it with the handle
+        std::shared_ptr<SerialReactor> shared_;
+        std::set<SerialPort *> shared_ports_;
+    };
+
+}  // namespace serial_port
+
+#endif  // SERIAL_REACTOR_H_
@@ -0,0 +1,92 @@
+#ifndef SERIAL_TRANSMITTER_H_
+#define SERIAL_TRANSMITTER_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "serial_port.h"
+
+namespace serial_port {
+
+    // lower value is sent first
+    enum TxPriority : uint8_t {
+        TX_SAFETY  = 0,  // parachute, e-stop, netgun, ...
+        TX_CONTROL = 1,  // servo and gimbal commands, generic messages
+        TX_BULK    = 2,  // LEDs, raw data
+        TX_PRIORITY_COUNT
+    };
+
+    struct TxClassStats {
+        size_t   depth      = 0;  // frames waiting now
+        size_t   peak_depth = 0;
+        uint64_t sent       = 0;
+        uint64_t failed     = 0;  // the port did not take the frame, see SerialPort::sendFrames()
+        uint64_t dropped    = 0;  // the queue of the class was full
+        double   wait_avg   = 0;  // [s] from send() until the frame was written, of the sent ones
+        double   wait_max   = 0;  // [s]
+    };
+
+    /*
+     * Outbound scheduler of a serial port. Frames are queued by priority class and written
+     * by a single thread, the highest class first. Frames of one class keep their order.
+     * Lower classes are written only while the kernel holds less than kernel_queue_limit
+     * unsent bytes, so a safety frame waits at most for the frames being written plus that
+     * many bytes on the wire. The frames that may be written at once are handed to the port
+     * together, see SerialPort::sendFrames().
+     */
+    class SerialTransmitter {
+    public:
+        explicit SerialTransmitter(SerialPort *port);
+
+        virtual ~SerialTransmitter();
+
+        void start(size_t max_depth = 64, int kernel_queue_limit = 64);
+
+        void stop();
+
+        // copies the frame into the queue, false if the queue of the class is full
+        bool send(const uint8_t *frame, int len, TxPriority priority);
+
+        TxClassStats getStats(TxPriority priority);
+
+        // one line with the stats of all classes, for logging
+        std::string getStatsSummary();
+
+    private:
+        struct Frame {
+            std::vector<uint8_t>                  data;
+            std::chrono::steady_clock::time_point enqueued;
+            TxPriority                            priority;
+        };
+
+        struct TxClass {
+            std::deque<Frame> queue;
+            TxClassStats      stats;
+            double            wait_sum = 0;
+        };
+
+        void writerLoop();
+
+        SerialPort *port_;
+
+        size_t max_depth_          = 64;
+        int    kernel_queue_limit_ = 64;
+
+        std::mutex                             mtx_;
+        std::condition_variable                cv_;
+        std::array<TxClass, TX_PRIORITY_COUNT> classes_;
+
+        std::thread       thread_;
+        std::atomic<bool> running_ = false;
+    };
+
+}  // namespace serial_port
+
+#endif  // SERIAL_TRANSMITTER_H_
@@ -0,0 +1,78 @@
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+namespace serial_port {
+
+    /*
+     * Lock-free single-producer/single-consumer ring buffer of trivially copyable elements.
+     * push() may be called only from one thread and pop() only from one (other) thread.
+     * The capacity is rounded up to a power of two.
+     */
+    template<typename T>
+    class SpscRing {
+    public:
+        explicit SpscRing(size_t capacity) {
+            capacity_ = 1;
+            while (capacity_ < capacity) {
+                capacity_ <<= 1;
+            }
+            mask_ = capacity_ - 1;
+            buffer_ = std::make_unique<T[]>(capacity_);
+        }
+
+        // returns the number of elements actually stored, the rest did not fit
+        size_t push(const T *data, size_t len) {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            const size_t tail = tail_.load(std::memory_order_acquire);
+            const size_t n = std::min(len, capacity_ - (head - tail));
+
+            const size_t first = std::min(n, capacity_ - (head & mask_));
+            std::memcpy(&buffer_[head & mask_], data, first * sizeof(T));
+            std::memcpy(&buffer_[0], data + first, (n - first) * sizeof(T));
+
+            head_.store(head + n, std::memory_order_release);
+            return n;
+        }
+
+        // returns the number of elements copied to data
+        size_t pop(T *data, size_t max_len) {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            const size_t head = head_.load(std::memory_order_acquire);
+            const size_t n = std::min(max_len, head - tail);
+
+            const size_t first = std::min(n, capacity_ - (tail & mask_));
+            std::memcpy(data, &buffer_[tail & mask_], first * sizeof(T));
+            std::memcpy(data + first, &buffer_[0], (n - first) * sizeof(T));
+
+            tail_.store(tail + n, std::memory_order_release);
+            return n;
+        }
+
+        // only approximate when called concurrently with push() or pop()
+        size_t size() const {
+            return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+        }
+
+        size_t capacity() const {
+            return capacity_;
+        }
+
+    private:
+        // producer and consumer indices live on separate cache lines
+        alignas(64) std::atomic<size_t> head_ = 0;
+        alignas(64) std::atomic<size_t> tail_ = 0;
+
+        alignas(64) size_t capacity_;
+        size_t mask_;
+        std::unique_ptr<T[]> buffer_;
+    };
+
+}  // namespace serial_port
+
+#endif  // SPSC_RING_H_
@@ -0,0 +1,133 @@
+#ifndef URING_QUEUE_H_
+#define URING_QUEUE_H_
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <vector>
+
+// set by CMake where the kernel headers have io_uring (5.1+), otherwise the stub below is built
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+namespace serial_port {
+
+#ifdef HAVE_IO_URING
+
+    /*
+     * Newer than the kernel headers of some of the supported distributions (5.4 on Ubuntu 20.04),
+     * the kernel is probed for the operations and init() falls back without the setup flags.
+     * The values are the kernel ABI.
+     */
+    constexpr uint8_t URING_OP_ASYNC_CANCEL = 14;       // 5.5
+    constexpr uint8_t URING_OP_WRITE = 23;              // 5.6
+    constexpr uint8_t URING_OP_PROVIDE_BUFFERS = 31;    // 5.7
+    constexpr uint8_t URING_OP_READ_MULTISHOT = 49;     // 6.7
+    constexpr uint8_t URING_SQE_BUFFER_SELECT = 1 << 5; // 5.7, the buffer group goes to buf_index (buf_group in newer headers)
+    constexpr uint32_t URING_CQE_F_MORE = 1 << 1;       // 5.13
+    constexpr unsigned URING_CQE_BUFFER_SHIFT = 16;     // 5.7
+
+    // struct __kernel_timespec of IORING_OP_TIMEOUT, its header differs between the kernel versions
+    struct UringTimespec {
+        int64_t tv_sec;
+        long long tv_nsec;
+    };
+
+    // poll32_events in newer headers, it shares the union with rw_flags, which 5.4 has already
+    inline void setUringPollEvents(struct io_uring_sqe *sqe, uint32_t events) {
+        sqe->rw_flags = events;
+    }
+
+    /*
+     * Minimal io_uring instance on top of the raw system calls (no liburing), just what
+     * the serial port needs: one submission queue used by a single thread at a time and
+     * registered buffers, the operations are filled in by the caller. Completions are reaped
+     * in batches, the shared head is updated once per batch.
+     */
+    class UringQueue {
+    public:
+        UringQueue();
+
+        virtual ~UringQueue();
+
+        /*
+         * False with errno set where the kernel has no io_uring or it is disabled (kernel.io_uring_disabled,
+         * seccomp of containers). With single_issuer only the calling thread may submit, the kernel then
+         * runs the completion work only while the thread waits (6.1+), otherwise it flags the thread as
+         * if a signal was pending and a tty write issued meanwhile fails with EINTR.
+         */
+        bool init(unsigned entries, bool single_issuer = false);
+
+        void close();
+
+        bool isOpen() const;
+
+        // the opcode is known to the kernel (the probe of 5.6), false on kernels without the probe
+        bool supportsOp(uint8_t op) const;
+
+        // zeroed entry of the submission queue, nullptr if the queue is full
+        struct io_uring_sqe *getSqe();
+
+        // submits the queued entries and waits for at least wait_nr completions, in a single system call
+        int submit(unsigned wait_nr = 0);
+
+        /*
+         * Calls f(const io_uring_cqe &) for every completion available now, returns how many.
+         * The completions are released to the kernel together after the last one.
+         */
+        template <typename F>
+        unsigned reap(F &&f) {
+
+            const unsigned head = *cq_head_;
+            const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+
+            for (unsigned i = head; i != tail; i++) {
+                f(cqes_[i & *cq_mask_]);
+            }
+
+            if (head != tail) {
+                __atomic_store_n(cq_head_, tail, __ATOMIC_RELEASE);
+            }
+
+            return tail - head;
+        }
+
+        // for IORING_OP_READ_FIXED
+        bool registerBuffers(const struct iovec *iovecs, unsigned count);
+
+    private:
+        int ring_fd_ = -1;
+
+        void *sq_ptr_ = nullptr;
+        size_t sq_size_ = 0;
+        void *cq_ptr_ = nullptr;
+        size_t cq_size_ = 0;
+        struct io_uring_sqe *sqes_ = nullptr;
+        size_t sqes_size_ = 0;
+
+        unsigned *sq_head_ = nullptr;
+        unsigned *sq_tail_ = nullptr;
+        unsigned *sq_mask_ = nullptr;
+        unsigned *sq_array_ = nullptr;
+        unsigned sq_entries_ = 0;
+        unsigned sq_local_tail_ = 0;
+        unsigned to_submit_ = 0;
+
+        unsigned *cq_head_ = nullptr;
+        unsigned *cq_tail_ = nullptr;
+        unsigned *cq_mask_ = nullptr;
+        struct io_uring_cqe *cqes_ = nullptr;
+
+        std::vector<bool> supported_ops_;
+    };
+
+#else
+
+    // built without io_uring (kernel headers before 5.1), SerialPort::setIoUring() has no effect
+    class UringQueue {};
+
+#endif
+
+}  // namespace serial_port
+
+#endif  // URING_QUEUE_H_
@@ -3,24 +3,39 @@
 #include <stdlib.h>
 #include <ros/ros.h>
 #include <sensor_msgs/Range.h>
+#include <mrs_serial/ClockSyncStatus.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <std_msgs/Char.h>
 #include <std_srvs/Trigger.h>
 #include <std_srvs/SetBool.h>
 #include <std_msgs/Empty.h>
 #include <mutex>
+#include <chrono>
 
 #include <string>
 #include <mrs_msgs/BacaProtocol.h>
 #include <mrs_msgs/SerialRaw.h>
 #include <mrs_msgs/SetInt.h>
+#include <mrs_serial/SendReliable.h>
+#include <mrs_serial/ReliableCommandResult.h>
 
 #include <serial_port.h>
+#include <serial_reactor.h>
+#include <device_discovery.h>
+#include <port_supervisor.h>
+#include <serial_transmitter.h>
+#include <message_pool.h>
+#include <baca_framer.h>
+#include <baca_dispatcher.h>
+#include <baca_messages.h>
+#include <baca_clock_sync.h>
+#include <baca_batcher.h>
+#include <baca_reliable.h>
+#include <link_stats.h>
 
 #include <nodelet/nodelet.h>
 #include <pluginlib/class_list_macros.h>
 
-#define BUFFER_SIZE 256
-
 #define MAXIMAL_TIME_INTERVAL 1
 
 // for garmin
@@ -38,26 +53,27 @@ public:
   virtual void onInit();
 
 private:
-  enum serial_receiver_state
-  {
-    WAITING_FOR_MESSSAGE,
-    EXPECTING_SIZE,
-    EXPECTING_PAYLOAD,
-    EXPECTING_CHECKSUM
-  };
-
-
   ros::Timer serial_timer_;
   ros::Timer fake_timer_;
   ros::Timer maintainer_timer_;
+  ros::Timer clock_sync_timer_;
+  ros::Timer batch_timer_;
+  ros::Timer reliable_timer_;
+  ros::Timer diagnostics_timer_;
 
   ros::ServiceServer ser_send_int;
   ros::ServiceServer ser_send_int_raw;
+  ros::ServiceServer ser_send_reliable;
 
-  void interpretSerialData(uint8_t data);
+  void interpretFrame(const baca_protocol::BacaFrame &frame);
+  void callbackSerialData(const uint8_t *data, int len);
   void callbackSerialTimer(const ros::TimerEvent &event);
   void callbackFakeTimer(const ros::TimerEvent &event);
   void callbackMaintainerTimer(const ros::TimerEvent &event);
+  void callbackClockSyncTimer(const ros::TimerEvent &event);
+  void callbackBatchTimer(const ros::TimerEvent &event);
+  void callbackReliableTimer(const ros::TimerEvent &event);
+  void callbackDiagnosticsTimer(const ros::TimerEvent &event);
 
   bool callbackNetgunSafe(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res);
   bool callbackNetgunArm(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res);
@@ -65,13 +81,18 @@ private:
   void callbackSendMessage(const mrs_msgs::BacaProtocolConstPtr &msg);
   void callbackSendRawMessage(const mrs_msgs::SerialRawConstPtr &msg);
   void callbackMagnet(const std_msgs::EmptyConstPtr &msg);
+  void callbackSendReliableMessage(const mrs_msgs::BacaProtocolConstPtr &msg);
 
   bool callbackSendInt([[maybe_unused]] mrs_msgs::SetInt::Request &req, mrs_msgs::SetInt::Response &res);
   bool callbackSendIntRaw([[maybe_unused]] mrs_msgs::SetInt::Request &req, mrs_msgs::SetInt::Response &res);
+  bool callbackSendReliable(mrs_serial::SendReliable::Request &req, mrs_serial::SendReliable::Response &res);
 
 
-  uint8_t connectToSensor(void);
-  void    processMessage(uint8_t payload_size, uint8_t *input_buffer, uint8_t checksum, uint8_t checksum_rec, bool checksum_correct);
+  void    processClockSyncPong(const baca_protocol::BacaFrame &frame);
+  void    processGarmin(const baca_protocol::BacaFrame &frame);
+  void    processGeneric(const baca_protocol::BacaFrame &frame);
+  void    publishReliableResult(const baca_protocol::ReliableResult &result);
+  void    armReliableTimer();
 
 
   ros::NodeHandle nh_;
@@ -79,12 +100,38 @@ private:
   ros::Publisher range_publisher_A_;
   ros::Publisher range_publisher_B_;
   ros::Publisher baca_protocol_publisher_;
+  ros::Publisher baca_protocol_batch_publisher_;
+  ros::Publisher reliable_result_publisher_;
+  ros::Publisher clock_sync_publisher_;
+  ros::Publisher diagnostics_publisher_;
 
   ros::Subscriber raw_message_subscriber;
   ros::Subscriber baca_protocol_subscriber;
   ros::Subscriber magnet_subscriber;
+  ros::Subscriber reliable_subscriber;
 
   serial_port::SerialPort serial_port_;
+  serial_port::SerialReactor serial_reactor_;
+  serial_port::SerialTransmitter serial_transmitter_{&serial_port_};
+  baca_protocol::BacaFramer baca_framer_;
+  baca_protocol::BacaDispatcher baca_dispatcher_;
+
+  // stamps the measurements with the device clock mapped to ROS time
+  baca_protocol::ClockSync clock_sync_;
+
+  // published messages are recycled once the subscribers release them
+  serial_port::MessagePool<sensor_msgs::Range>     range_pool_A_;
+  serial_port::MessagePool<sensor_msgs::Range>     range_pool_B_;
+  serial_port::MessagePool<mrs_msgs::BacaProtocol> baca_protocol_pool_;
+
+  baca_protocol::BacaBatcher baca_batcher_;
+
+  // commands acknowledged by the device
+  baca_protocol::ReliableSender reliable_sender_;
+  std::mutex                    mutex_reliable_timer_;
+
+  // frame counters and latencies of the link, published on /diagnostics
+  serial_port::LinkStats link_stats_;
 
   boost::function<void(uint8_t)> serial_data_callback_function_;
 
@@ -92,26 +139,57 @@ private:
   bool     simulate_fake_garmin;
   bool     use_timeout;
   bool     swap_garmins;
-  uint16_t received_msg_ok           = 0;
-  uint16_t received_msg_ok_garmin    = 0;
-  uint16_t received_msg_bad_checksum = 0;
 
   int serial_rate_        = 5000;
   int fake_garmin_rate_   = 50;
   int serial_buffer_size_ = 1024;
 
+  bool use_reactor_        = true;
+  bool use_shared_reactor_ = true;
+  bool use_hotplug_        = true;
+  bool use_reader_thread_  = false;
+  int  reader_ring_size_   = 65536;
+  bool use_io_uring_       = false;
+
+  int reconnect_backoff_min_ms_ = 100;
+  int reconnect_backoff_max_ms_ = 5000;
+
+  bool low_latency_      = true;
+  int  latency_timer_ms_ = 1;
+
+  int tx_queue_depth_        = 64;
+  int tx_kernel_queue_limit_ = 64;
+
+  bool resync_on_bad_checksum_ = true;
+
+  bool use_clock_sync_        = false;
+  int  clock_sync_rate_       = 10;
+  int  clock_sync_window_     = 32;
+  int  clock_sync_max_rtt_us_ = 10000;
+
+  bool use_batching_     = false;
+  int  batch_max_frames_ = 50;
+  int  batch_window_us_  = 20000;
+
+  int reliable_timeout_ms_   = 50;
+  int reliable_max_attempts_ = 3;
+
+  double diagnostics_rate_ = 1.0;
+
   std::string portname_;
   int         baudrate_;
   std::string uav_name_;
+
+  // looks the port up by the usb identity of the device instead, when set
+  serial_port::UsbDeviceFilter device_filter_;
   std::string garmin_A_frame_;
   std::string garmin_B_frame_;
 
 
-  ros::Time interval_      = ros::Time::now();
-  ros::Time last_received_ = ros::Time::now();
-
-  bool is_connected_   = false;
   bool is_initialized_ = false;
+
+  // keeps the port open and publishes the state of the connection, declared last so that its threads stop first
+  serial_port::PortSupervisor port_supervisor_{&serial_port_};
 };
 
 //}
@@ -127,6 +205,10 @@ void BacaProtocol::onInit() {
 
   nh_.param("uav_name", uav_name_, std::string("uav"));
   nh_.param("portname", portname_, std::string("/dev/ttyUSB0"));
+  nh_.param("device_vid", device_filter_.vid, std::string(""));
+  nh_.param("device_pid", device_filter_.pid, std::string(""));
+  nh_.param("device_serial", device_filter_.serial, std::string(""));
+  nh_.param("device_usb_path", device_filter_.usb_path, std::string(""));
   nh_.param("baudrate", baudrate_, 115200);
   nh_.param("publish_bad_checksum", publish_bad_checksum, false);
   nh_.param("simulate_fake_garmin", simulate_fake_garmin, false);
@@ -134,9 +216,38 @@ void BacaProtocol::onInit() {
   nh_.param("swap_garmins", swap_garmins, false);
   nh_.param("serial_rate", serial_rate_, 5000);
   nh_.param("serial_buffer_size", serial_buffer_size_, 1024);
-
-  ser_send_int     = nh_.advertiseService("send_int", &BacaProtocol::callbackSendInt, this);
-  ser_send_int_raw = nh_.advertiseService("send_int_raw", &BacaProtocol::callbackSendIntRaw, this);
+  nh_.param("use_reactor", use_reactor_, true);
+  nh_.param("use_shared_reactor", use_shared_reactor_, true);
+  nh_.param("use_hotplug", use_hotplug_, true);
+  nh_.param("reconnect_backoff_min_ms", reconnect_backoff_min_ms_, 100);
+  nh_.param("reconnect_backoff_max_ms", reconnect_backoff_max_ms_, 5000);
+  nh_.param("use_reader_thread", use_reader_thread_, false);
+  nh_.param("reader_ring_size", reader_ring_size_, 65536);
+  nh_.param("use_io_uring", use_io_uring_, false);
+  nh_.param("low_latency", low_latency_, true);
+  nh_.param("latency_timer_ms", latency_timer_ms_, 1);
+  nh_.param("tx_queue_depth", tx_queue_depth_, 64);
+  nh_.param("tx_kernel_queue_limit", tx_kernel_queue_limit_, 64);
+  nh_.param("resync_on_bad_checksum", resync_on_bad_checksum_, true);
+  nh_.param("use_clock_sync", use_clock_sync_, false);
+  nh_.param("clock_sync_rate", clock_sync_rate_, 10);
+  nh_.param("clock_sync_window", clock_sync_window_, 32);
+  nh_.param("clock_sync_max_rtt_us", clock_sync_max_rtt_us_, 10000);
+  nh_.param("use_batching", use_batching_, false);
+  nh_.param("batch_max_frames", batch_max_frames_, 50);
+  nh_.param("batch_window_us", batch_window_us_, 20000);
+  nh_.param("reliable_timeout_ms", reliable_timeout_ms_, 50);
+  nh_.param("reliable_max_attempts", reliable_max_attempts_, 3);
+  nh_.param("diagnostics_rate", diagnostics_rate_, 1.0);
+
+  ser_send_int      = nh_.advertiseService("send_int", &BacaProtocol::callbackSendInt, this);
+  ser_send_int_raw  = nh_.advertiseService("send_int_raw", &BacaProtocol::callbackSendIntRaw, this);
+
+  // the service blocks until the command is acknowledged, so it is served by the worker threads of the nodelet manager,
+  // the global queue keeps the timers and the other nodelets running and the acknowledgement can be read meanwhile
+  ros::NodeHandle nh_reliable(nh_);
+  nh_reliable.setCallbackQueue(&getMTCallbackQueue());
+  ser_send_reliable = nh_reliable.advertiseService("send_reliable", &BacaProtocol::callbackSendReliable, this);
 
   // Publishers
   std::string postfix_A = swap_garmins ? "_up" : "";
@@ -148,22 +259,117 @@ void BacaProtocol::onInit() {
 
   baca_protocol_publisher_ = nh_.advertise<mrs_msgs::BacaProtocol>("baca_protocol_out", 1);
 
+  // generic messages of high-rate streams are published in batches instead of one by one
+  if (use_batching_) {
+    baca_protocol_batch_publisher_ = nh_.advertise<mrs_serial::BacaProtocolArray>("baca_protocol_batch_out", 10);
+    baca_batcher_.init(baca_protocol_batch_publisher_, batch_max_frames_, ros::Duration(batch_window_us_ * 1e-6));
+  }
+
   baca_protocol_subscriber = nh_.subscribe("baca_protocol_in", 10, &BacaProtocol::callbackSendMessage, this, ros::TransportHints().tcpNoDelay());
 
   raw_message_subscriber = nh_.subscribe("raw_in", 10, &BacaProtocol::callbackSendRawMessage, this, ros::TransportHints().tcpNoDelay());
 
+  // commands sent on reliable_in are retransmitted until the device acknowledges them, the outcome goes to reliable_result
+  reliable_result_publisher_ = nh_.advertise<mrs_serial::ReliableCommandResult>("reliable_result", 10);
+  reliable_subscriber        = nh_.subscribe("reliable_in", 10, &BacaProtocol::callbackSendReliableMessage, this, ros::TransportHints().tcpNoDelay());
+
   // Output loaded parameters to console for double checking
   ROS_INFO_THROTTLE(1.0, "[%s] is up and running with the following parameters:", ros::this_node::getName().c_str());
   ROS_INFO_THROTTLE(1.0, "[%s] portname: %s", ros::this_node::getName().c_str(), portname_.c_str());
+  if (!device_filter_.empty()) {
+    ROS_INFO_THROTTLE(1.0, "[%s] device: %s", ros::this_node::getName().c_str(), device_filter_.toString().c_str());
+  }
   ROS_INFO_THROTTLE(1.0, "[%s] baudrate: %i", ros::this_node::getName().c_str(), baudrate_);
   ROS_INFO_STREAM_THROTTLE(1.0, "[" << ros::this_node::getName().c_str() << "] publishing messages with wrong checksum: " << publish_bad_checksum);
 
-  connectToSensor();
+  // the reactor delivers the data as soon as the port becomes readable, polling timer is only a fallback
+  if (use_reactor_) {
+    // one I/O thread for all nodelets of the manager, the data are read and handled in the callback queue of this nodelet
+    if (use_shared_reactor_) {
+      serial_reactor_.setCallbackQueue(&getMTCallbackQueue());
+      serial_reactor_.startShared();
+    } else {
+      serial_reactor_.start();
+    }
+  }
+
+  // outbound frames are written by one thread in the order of their priority
+  serial_transmitter_.start(tx_queue_depth_, tx_kernel_queue_limit_);
+
+  // drain the port from a dedicated thread, so that slow callbacks cannot overrun the kernel buffer
+  if (use_reader_thread_) {
+    serial_port_.enableReaderThread(reader_ring_size_);
+  }
+
+  // io_uring for the reads of the reader thread and the frames of the transmitter, poll() and write() where the kernel does not have it
+  serial_port_.setIoUring(use_io_uring_);
+
+  // small frames would otherwise wait up to 16 ms in the buffer of an FTDI adapter
+  serial_port_.setLowLatency(low_latency_, latency_timer_ms_);
+
+  // rescan the bytes of a frame with a bad checksum, a false start byte in noise would otherwise swallow the following good frames
+  baca_framer_.setResync(resync_on_bad_checksum_);
+
+  reliable_sender_.init(&serial_transmitter_, reliable_timeout_ms_ * 1e-3, reliable_max_attempts_,
+                        [this](const baca_protocol::ReliableResult &result) { publishReliableResult(result); });
+
+  clock_sync_.init(clock_sync_window_, 4, clock_sync_max_rtt_us_ * 1e-6);
+
+  // handlers of the messages this node understands, everything else is published as a generic BacaProtocol message
+  baca_dispatcher_.registerHandler<baca_protocol::messages::GarminRange>([this](const baca_protocol::BacaFrame &frame) { processGarmin(frame); });
+  baca_dispatcher_.registerHandler<baca_protocol::messages::GarminRangeStamped>([this](const baca_protocol::BacaFrame &frame) { processGarmin(frame); });
+  // without clock sync, 0x73 stays free for the messages of the device
+  if (use_clock_sync_) {
+    baca_dispatcher_.registerHandler<baca_protocol::messages::ClockSyncPong>([this](const baca_protocol::BacaFrame &frame) { processClockSyncPong(frame); });
+  }
+  // frames with the id of the acknowledgement that do not match a pending command still go to the generic topic
+  baca_dispatcher_.registerHandler<baca_protocol::messages::ReliableAck>([this](const baca_protocol::BacaFrame &frame) {
+    if (!reliable_sender_.handleAck(frame)) {
+      processGeneric(frame);
+    }
+  });
+  baca_dispatcher_.setDefaultHandler([this](const baca_protocol::BacaFrame &frame) { processGeneric(frame); });
+
+  serial_port::PortSupervisor::Options port_options;
+  port_options.portname      = portname_;
+  port_options.device_filter = device_filter_;
+  port_options.baudrate      = baudrate_;
+  port_options.buffer_size   = serial_buffer_size_;
+  port_options.use_timeout   = use_timeout;
+  port_options.timeout       = MAXIMAL_TIME_INTERVAL;
+  port_options.backoff_min   = reconnect_backoff_min_ms_ * 1e-3;
+  port_options.backoff_max   = reconnect_backoff_max_ms_ * 1e-3;
+  port_options.use_hotplug   = use_hotplug_;
+
+  port_supervisor_.start(nh_, port_options, use_reactor_ ? &serial_reactor_ : nullptr,
+                         [this](const uint8_t *data, int len) { callbackSerialData(data, len); });
+
+  if (!use_reactor_) {
+    serial_timer_ = nh_.createTimer(ros::Rate(serial_rate_), &BacaProtocol::callbackSerialTimer, this);
+  }
 
-  serial_timer_     = nh_.createTimer(ros::Rate(serial_rate_), &BacaProtocol::callbackSerialTimer, this);
   fake_timer_       = nh_.createTimer(ros::Rate(fake_garmin_rate_), &BacaProtocol::callbackFakeTimer, this);
   maintainer_timer_ = nh_.createTimer(ros::Rate(1), &BacaProtocol::callbackMaintainerTimer, this);
 
+  // the device answers the pings with its clock, measurements carrying the clock are then stamped with it
+  if (use_clock_sync_) {
+    clock_sync_publisher_ = nh_.advertise<mrs_serial::ClockSyncStatus>("clock_sync", 10);
+    clock_sync_timer_     = nh_.createTimer(ros::Rate(clock_sync_rate_), &BacaProtocol::callbackClockSyncTimer, this);
+  }
+
+  if (use_batching_) {
+    batch_timer_ = nh_.createTimer(ros::Duration(batch_window_us_ * 1e-6), &BacaProtocol::callbackBatchTimer, this);
+  }
+
+  // retransmits the commands from reliable_in, the service retransmits its own command while it waits,
+  // one-shot and armed by armReliableTimer() only while a command waits for its acknowledgement
+  reliable_timer_ = nh_.createTimer(ros::Duration(reliable_timeout_ms_ * 1e-3), &BacaProtocol::callbackReliableTimer, this, true, false);
+
+  if (diagnostics_rate_ > 0) {
+    diagnostics_publisher_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
+    diagnostics_timer_     = nh_.createTimer(ros::Rate(diagnostics_rate_), &BacaProtocol::callbackDiagnosticsTimer, this);
+  }
+
   is_initialized_ = true;
 }
 //}
@@ -182,11 +388,33 @@ void BacaProtocol::callbackSerialTimer(const ros::TimerEvent &event) {
 
   bytes_read = serial_port_.readSerial(read_buffer, serial_buffer_size_);
 
+  if (bytes_read > 0) {
+    callbackSerialData(read_buffer, bytes_read);
+  }
+}
+
+//}
+
+/* callbackSerialData() //{ */
+
+void BacaProtocol::callbackSerialData(const uint8_t *data, int len) {
+
+  const uint64_t zero_size_before = baca_framer_.stats().frames_zero_size;
+  const uint64_t recovered_before = baca_framer_.stats().frames_recovered;
+
+  baca_framer_.decode(data, len, [this](const baca_protocol::BacaFrame &frame) { interpretFrame(frame); });
+
+  const baca_protocol::BacaFramerStats &stats = baca_framer_.stats();
+  link_stats_.setDecoderTotals(stats.bytes, stats.frames_ok, stats.frames_bad_checksum, stats.frames_zero_size, stats.frames_recovered);
+
+  if (baca_framer_.stats().frames_zero_size != zero_size_before) {
+    ROS_ERROR_THROTTLE(1.0, "[%s]: Message with 0 payload_size received, discarding.", ros::this_node::getName().c_str());
+  }
 
-  for (int i = 0; i < bytes_read; i++) {
-    interpretSerialData(read_buffer[i]);
+  if (baca_framer_.stats().frames_recovered != recovered_before) {
+    ROS_WARN_STREAM_THROTTLE(1.0, "[" << ros::this_node::getName().c_str() << "] Resynchronized after a bad checksum, "
+                                      << baca_framer_.stats().frames_recovered << " frames recovered so far");
   }
-  /* processMessage */
 }
 
 //}
@@ -211,40 +439,102 @@ void BacaProtocol::callbackFakeTimer(const ros::TimerEvent &event) {
 
 //}
 
-/* callbackMaintainerTimer() //{ */
+/* callbackBatchTimer() //{ */
 
-void BacaProtocol::callbackMaintainerTimer(const ros::TimerEvent &event) {
+// publishes the last batch when the stream stops before the batch fills up
+void BacaProtocol::callbackBatchTimer(const ros::TimerEvent &event) {
+  baca_batcher_.flushStale(ros::Time::now());
+}
 
-  if (is_connected_) {
+//}
 
-    if (!serial_port_.checkConnected()) {
-      is_connected_ = false;
-      ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial device is disconnected! ");
-    }
+/* callbackReliableTimer() //{ */
+
+void BacaProtocol::callbackReliableTimer(const ros::TimerEvent &event) {
+  reliable_sender_.checkTimeouts();
+  armReliableTimer();
+}
+
+//}
+
+/* armReliableTimer() //{ */
+
+// schedules the reliable timer to the first deadline of the pending commands, stops it when none is left
+void BacaProtocol::armReliableTimer() {
+
+  // the deadline is looked up under the lock, so that a command sent from another thread cannot get re-armed to a later one
+  std::scoped_lock lock(mutex_reliable_timer_);
+
+  const double until_deadline = reliable_sender_.timeUntilDeadline();
+
+  reliable_timer_.stop();
+
+  if (until_deadline < 0) {
+    return;
   }
 
-  if (((ros::Time::now() - last_received_).toSec() > MAXIMAL_TIME_INTERVAL) && use_timeout && is_connected_) {
+  // a zero period would never fire
+  reliable_timer_.setPeriod(ros::Duration(std::max(until_deadline, 1e-4)));
+  reliable_timer_.start();
+}
+
+//}
+
+/* callbackDiagnosticsTimer() //{ */
+
+void BacaProtocol::callbackDiagnosticsTimer(const ros::TimerEvent &event) {
 
-    is_connected_ = false;
+  // replaced on reconnect when the port is looked up by its usb identity
+  const std::string portname = port_supervisor_.getPortname();
 
-    ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial port timed out - no messages were received in " << MAXIMAL_TIME_INTERVAL
-                         << " seconds");
+  // kernel counters, to tell data lost in the driver from noise on the line
+  link_stats_.setUartCounters(serial_port_.getUartCounters());
+  link_stats_.setLowLatencyState(serial_port_.getLowLatencyState());
+
+  const diagnostic_msgs::DiagnosticArray diagnostics =
+      link_stats_.makeDiagnostics(ros::this_node::getName() + ": serial link", portname, port_supervisor_.isConnected(), ros::Time::now());
+
+  try {
+    diagnostics_publisher_.publish(diagnostics);
+  }
+  catch (...) {
+    ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", diagnostics_publisher_.getTopic().c_str());
   }
+}
 
-  if (is_connected_) {
+//}
 
-    ROS_INFO_STREAM("Got msgs - Garmin: " << received_msg_ok_garmin << " Generic msg: " << received_msg_ok << "  Wrong checksum: " << received_msg_bad_checksum
-                                          << "; in the last " << (ros::Time::now() - interval_).toSec() << " s");
-    received_msg_ok_garmin    = 0;
-    received_msg_ok           = 0;
-    received_msg_bad_checksum = 0;
+/* callbackClockSyncTimer() //{ */
 
-    interval_ = ros::Time::now();
+void BacaProtocol::callbackClockSyncTimer(const ros::TimerEvent &event) {
 
-  } else {
+  if (!port_supervisor_.isConnected()) {
+    return;
+  }
+
+  const auto ping = clock_sync_.makePing(ros::Time::now());
+
+  // the round trip is measured from now, so the ping must not wait behind other frames
+  serial_transmitter_.send(ping.data(), ping.size(), serial_port::TX_SAFETY);
+}
 
-    connectToSensor();
+//}
+
+/* callbackMaintainerTimer() //{ */
+
+void BacaProtocol::callbackMaintainerTimer(const ros::TimerEvent &event) {
+
+  if (port_supervisor_.isConnected()) {
+
+    ROS_INFO_STREAM_THROTTLE(10.0, "[" << ros::this_node::getName().c_str() << "] Tx queue: " << serial_transmitter_.getStatsSummary());
+
+    const std::string reliable_summary = reliable_sender_.getStatsSummary();
+    if (!reliable_summary.empty()) {
+      ROS_INFO_STREAM_THROTTLE(10.0, "[" << ros::this_node::getName().c_str() << "] Reliable commands:\n" << reliable_summary);
+    }
   }
+
+  port_supervisor_.checkConnection();
 }
 
 //}
@@ -277,7 +567,30 @@ void BacaProtocol::callbackSendMessage(const mrs_msgs::BacaProtocolConstPtr &msg
 
   out_buffer[it] = checksum;
 
-  serial_port_.sendCharArray(out_buffer, payload_size + 3);
+  // netgun and parachute commands skip the queue of other traffic
+  const serial_port::TxPriority priority =
+      baca_protocol::messages::isSafetyMessage(out_buffer[2]) ? serial_port::TX_SAFETY : serial_port::TX_CONTROL;
+
+  serial_transmitter_.send(out_buffer, payload_size + 3, priority);
+}
+
+//}
+
+/* callbackSendReliableMessage() //{ */
+
+void BacaProtocol::callbackSendReliableMessage(const mrs_msgs::BacaProtocolConstPtr &msg) {
+
+  if (!is_initialized_) {
+    return;
+  }
+
+  if (!reliable_sender_.send(msg->payload.data(), msg->payload.size())) {
+    ROS_WARN_THROTTLE(1.0, "[%s]: Could not send a reliable command, the payload is empty or too long, or 256 commands are pending.",
+                      ros::this_node::getName().c_str());
+    return;
+  }
+
+  armReliableTimer();
 }
 
 //}
@@ -290,11 +603,8 @@ void BacaProtocol::callbackSendRawMessage(const mrs_msgs::SerialRawConstPtr &msg
     return;
   }
 
-  uint8_t payload_size = msg->payload.size();
-  uint8_t out_buffer[payload_size];
-
   ROS_INFO_STREAM("SENDING");
-  serial_port_.sendCharArray(out_buffer, payload_size);
+  serial_transmitter_.send(msg->payload.data(), msg->payload.size(), serial_port::TX_BULK);
 }
 
 //}
@@ -324,7 +634,9 @@ bool BacaProtocol::callbackSendInt([[maybe_unused]] mrs_msgs::SetInt::Request &r
 
   out_buffer[it] = checksum;
 
-  serial_port_.sendCharArray(out_buffer, payload_size + 3);
+  const serial_port::TxPriority priority = baca_protocol::messages::isSafetyMessage(payload) ? serial_port::TX_SAFETY : serial_port::TX_CONTROL;
+
+  serial_transmitter_.send(out_buffer, payload_size + 3, priority);
 
   char hex_charr[5];
   std::sprintf(hex_charr, "%X", payload);
@@ -351,7 +663,7 @@ bool BacaProtocol::callbackSendIntRaw([[maybe_unused]] mrs_msgs::SetInt::Request
   uint8_t out_buffer[payload_size];
   out_buffer[0] = payload;
 
-  serial_port_.sendCharArray(out_buffer, payload_size);
+  serial_transmitter_.send(out_buffer, payload_size, serial_port::TX_BULK);
 
   /* std::stringstream sstream; */
   /* sstream << std::hex << payload; */
@@ -369,157 +681,191 @@ bool BacaProtocol::callbackSendIntRaw([[maybe_unused]] mrs_msgs::SetInt::Request
 }  // namespace baca_protocol
 //}
 
+/* //{ callbackSendReliable() */
+
+bool BacaProtocol::callbackSendReliable(mrs_serial::SendReliable::Request &req, mrs_serial::SendReliable::Response &res) {
+
+  if (!is_initialized_) {
+    return false;
+  }
+
+  // blocks this callback until the device acknowledges the command or all the attempts time out, it runs in the multi-threaded
+  // callback queue and the acknowledgement is read from another thread (the reactor, or the serial timer in the global queue)
+  const baca_protocol::ReliableResult result = reliable_sender_.sendAndWait(req.payload.data(), req.payload.size(), req.timeout, req.max_attempts);
+
+  res.success         = result.acknowledged;
+  res.attempts        = result.attempts;
+  res.round_trip_time = result.round_trip_time;
+  res.latency         = result.latency;
+
+  if (result.acknowledged) {
+    res.message = "acknowledged";
+  } else if (result.attempts == 0) {
+    res.message = "not sent, the payload is empty or too long, or 256 commands are pending";
+  } else {
+    res.message = "not acknowledged";
+  }
+
+  return true;
+}
+
+//}
+
 // | ------------------------ routines ------------------------ |
 
-/* interpretSerialData() //{ */
-
-void BacaProtocol::interpretSerialData(uint8_t single_character) {
-
-  static serial_receiver_state rec_state    = WAITING_FOR_MESSSAGE;
-  static uint8_t               payload_size = 0;
-  static uint8_t               input_buffer[BUFFER_SIZE];
-  static uint8_t               buffer_counter = 0;
-  static uint8_t               checksum       = 0;
-
-  switch (rec_state) {
-    case WAITING_FOR_MESSSAGE:
-
-      if (single_character == 'b' ||
-          single_character == 'a') {  // the 'a' is there for backwards-compatibility, going forwards all messages should start with 'b'
-        checksum       = single_character;
-        buffer_counter = 0;
-        rec_state      = EXPECTING_SIZE;
-      }
-      break;
-
-    case EXPECTING_SIZE:
-
-      if (single_character == 0) {
-        ROS_ERROR_THROTTLE(1.0, "[%s]: Message with 0 payload_size received, discarding.", ros::this_node::getName().c_str());
-        rec_state = WAITING_FOR_MESSSAGE;
-      } else {
-        payload_size = single_character;
-        checksum += single_character;
-        rec_state = EXPECTING_PAYLOAD;
-      }
-      break;
-
-    case EXPECTING_PAYLOAD:
-
-      input_buffer[buffer_counter] = single_character;
-      checksum += single_character;
-      buffer_counter++;
-      if (buffer_counter >= payload_size) {
-        rec_state = EXPECTING_CHECKSUM;
-      }
-      break;
-
-    case EXPECTING_CHECKSUM:
-
-      if (checksum == single_character) {
-        processMessage(payload_size, input_buffer, checksum, single_character, true);
-        last_received_ = ros::Time::now();
-        rec_state      = WAITING_FOR_MESSSAGE;
-      } else {
-        if (publish_bad_checksum) {
-          processMessage(payload_size, input_buffer, checksum, single_character, false);
-        }
-        received_msg_bad_checksum++;
-        rec_state = WAITING_FOR_MESSSAGE;
-      }
-      break;
+/* interpretFrame() //{ */
+
+void BacaProtocol::interpretFrame(const baca_protocol::BacaFrame &frame) {
+
+  const auto parsed = std::chrono::steady_clock::now();
+
+  if (frame.checksum_correct) {
+    baca_dispatcher_.dispatch(frame);
+    const ros::Time now = ros::Time::now();
+    port_supervisor_.dataReceived(now);
+    link_stats_.recordFrame(frame.messageId(), std::chrono::duration<double>(std::chrono::steady_clock::now() - parsed).count(),
+                            (now - serial_port_.getByteStamp(frame.bytes_after)).toSec());
+  } else if (publish_bad_checksum) {
+    baca_dispatcher_.dispatch(frame);
   }
 }
 
 //}
 
-/* processMessage() //{ */
+/* processGarmin() //{ */
 
-void BacaProtocol::processMessage(uint8_t payload_size, uint8_t *input_buffer, uint8_t checksum, uint8_t checksum_rec, bool checksum_correct) {
+void BacaProtocol::processGarmin(const baca_protocol::BacaFrame &frame) {
 
-  if (payload_size == 3 && (input_buffer[0] == 0x00 || input_buffer[0] == 0x01) && checksum_correct) {
-    /* Special message reserved for garmin rangefinder */
-    received_msg_ok_garmin++;
-    uint8_t message_id = input_buffer[0];
-    int16_t range      = input_buffer[1] << 8;
-    range |= input_buffer[2];
+  using baca_protocol::messages::GarminRange;
+  using baca_protocol::messages::GarminRangeStamped;
 
-    sensor_msgs::Range range_msg;
-    range_msg.field_of_view  = 0.0523599;  // +-3 degree
-    range_msg.max_range      = MAX_RANGE * 0.01;
-    range_msg.min_range      = MIN_RANGE * 0.01;
-    range_msg.radiation_type = sensor_msgs::Range::INFRARED;
-    range_msg.header.stamp   = ros::Time::now();
+  // measurements carrying the device clock are stamped with it once the clock is synchronized, the rest with the arrival of their last byte
+  ros::Time stamp = serial_port_.getByteStamp(frame.bytes_after);
+  if (GarminRangeStamped::matches(frame)) {
+    clock_sync_.toHostTime(GarminRangeStamped::tick::read(frame.payload), stamp);
+  }
 
-    range_msg.range = range * 0.01;  // convert to m
+  uint8_t message_id = frame.messageId();
+  int16_t range      = GarminRange::range::read(frame.payload);
 
-    if (range > MAX_RANGE) {
-      range_msg.range = std::numeric_limits<double>::infinity();
-    } else if (range < MIN_RANGE) {
-      range_msg.range = -std::numeric_limits<double>::infinity();
-    }
+  boost::shared_ptr<sensor_msgs::Range> range_msg = message_id == 0x00 ? range_pool_A_.acquire() : range_pool_B_.acquire();
+  range_msg->field_of_view  = 0.0523599;  // +-3 degree
+  range_msg->max_range      = MAX_RANGE * 0.01;
+  range_msg->min_range      = MIN_RANGE * 0.01;
+  range_msg->radiation_type = sensor_msgs::Range::INFRARED;
+  range_msg->header.stamp   = stamp;
 
-    if (message_id == 0x00) {
-      range_msg.header.frame_id = garmin_A_frame_;
-
-      try {
-        range_publisher_A_.publish(range_msg);
-      }
-      catch (...) {
-        ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", range_publisher_A_.getTopic().c_str());
-      }
-
-    } else if (message_id == 0x01) {
-      range_msg.header.frame_id = garmin_B_frame_;
-
-      try {
-        range_publisher_B_.publish(range_msg);
-      }
-      catch (...) {
-        ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", range_publisher_B_.getTopic().c_str());
-      }
-    }
-  } else {
-    /* General serial message */
-    if (checksum_correct) {
-      received_msg_ok++;
+  range_msg->range = GarminRange::range::get(frame.payload);  // convert to m
+
+  if (range > MAX_RANGE) {
+    range_msg->range = std::numeric_limits<double>::infinity();
+  } else if (range < MIN_RANGE) {
+    range_msg->range = -std::numeric_limits<double>::infinity();
+  }
+
+  if (message_id == 0x00) {
+    range_msg->header.frame_id = garmin_A_frame_;
+
+    try {
+      range_publisher_A_.publish(sensor_msgs::RangeConstPtr(range_msg));
     }
-    mrs_msgs::BacaProtocol msg;
-    msg.stamp = ros::Time::now();
-    for (uint8_t i = 0; i < payload_size; i++) {
-      msg.payload.push_back(input_buffer[i]);
+    catch (...) {
+      ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", range_publisher_A_.getTopic().c_str());
     }
-    msg.checksum_received   = checksum_rec;
-    msg.checksum_calculated = checksum;
-    msg.checksum_correct    = checksum_correct;
+
+  } else if (message_id == 0x01) {
+    range_msg->header.frame_id = garmin_B_frame_;
+
     try {
-      baca_protocol_publisher_.publish(msg);
+      range_publisher_B_.publish(sensor_msgs::RangeConstPtr(range_msg));
     }
     catch (...) {
-      ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", baca_protocol_publisher_.getTopic().c_str());
+      ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", range_publisher_B_.getTopic().c_str());
     }
   }
 }
 
 //}
 
-/* connectToSensors() //{ */
+/* processGeneric() //{ */
+
+void BacaProtocol::processGeneric(const baca_protocol::BacaFrame &frame) {
+
+  if (use_batching_) {
+    baca_batcher_.add(frame, serial_port_.getByteStamp(frame.bytes_after));
+    return;
+  }
+
+  boost::shared_ptr<mrs_msgs::BacaProtocol> msg = baca_protocol_pool_.acquire();
+  msg->stamp = serial_port_.getByteStamp(frame.bytes_after);
+  msg->payload.assign(frame.payload, frame.payload + frame.payload_size);
+  msg->checksum_received   = frame.checksum_received;
+  msg->checksum_calculated = frame.checksum_calculated;
+  msg->checksum_correct    = frame.checksum_correct;
+  try {
+    baca_protocol_publisher_.publish(mrs_msgs::BacaProtocolConstPtr(msg));
+  }
+  catch (...) {
+    ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", baca_protocol_publisher_.getTopic().c_str());
+  }
+}
+
+//}
+
+/* publishReliableResult() //{ */
+
+void BacaProtocol::publishReliableResult(const baca_protocol::ReliableResult &result) {
+
+  if (!result.acknowledged) {
+    ROS_WARN_THROTTLE(1.0, "[%s]: Reliable command 0x%02X was not acknowledged after %d attempts.", ros::this_node::getName().c_str(), result.message_id,
+                      result.attempts);
+  }
+
+  mrs_serial::ReliableCommandResult msg;
+  msg.header.stamp    = ros::Time::now();
+  msg.sequence        = result.sequence;
+  msg.message_id      = result.message_id;
+  msg.acknowledged    = result.acknowledged;
+  msg.attempts        = result.attempts;
+  msg.round_trip_time = result.round_trip_time;
+  msg.latency         = result.latency;
+
+  try {
+    reliable_result_publisher_.publish(msg);
+  }
+  catch (...) {
+    ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", reliable_result_publisher_.getTopic().c_str());
+  }
+}
 
-uint8_t BacaProtocol::connectToSensor(void) {
+//}
 
-  ROS_INFO_THROTTLE(1.0, "[%s]: Openning the serial port.", ros::this_node::getName().c_str());
+/* processClockSyncPong() //{ */
 
-  if (!serial_port_.connect(portname_, baudrate_)) {
-    ROS_ERROR_THROTTLE(1.0, "[%s]: Could not connect to sensor.", ros::this_node::getName().c_str());
-    is_connected_ = false;
-    return 0;
+void BacaProtocol::processClockSyncPong(const baca_protocol::BacaFrame &frame) {
+
+  if (!clock_sync_.handlePong(frame, serial_port_.getByteStamp(frame.bytes_after))) {
+    return;
   }
 
-  ROS_INFO_THROTTLE(1.0, "[%s]: Connected to sensor.", ros::this_node::getName().c_str());
-  is_connected_  = true;
-  last_received_ = ros::Time::now();
+  const baca_protocol::ClockSyncState state = clock_sync_.getState();
+
+  mrs_serial::ClockSyncStatus msg;
+  msg.header.stamp    = ros::Time::now();
+  msg.valid           = state.valid;
+  msg.samples         = state.samples;
+  msg.offset          = state.offset;
+  msg.drift           = state.drift;
+  msg.residual        = state.residual;
+  msg.residual_rms    = state.residual_rms;
+  msg.round_trip_time = state.round_trip_time;
 
-  return 1;
+  try {
+    clock_sync_publisher_.publish(msg);
+  }
+  catch (...) {
+    ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", clock_sync_publisher_.getTopic().c_str());
+  }
 }
 
 //}
@@ -0,0 +1,316 @@
+#include "connection_manager.h"
+
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <cmath>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace serial_port {
+
+/* ConnectionManager() //{ */
+
+    ConnectionManager::ConnectionManager() {
+    }
+
+//}
+
+/* ~ConnectionManager() //{ */
+
+    ConnectionManager::~ConnectionManager() {
+        stop();
+    }
+
+//}
+
+/* setBackoff() //{ */
+
+    void ConnectionManager::setBackoff(double min, double max) {
+        backoff_min_ = std::max(min, 0.001);
+        backoff_max_ = std::max(max, backoff_min_);
+    }
+
+//}
+
+/* start() //{ */
+
+    bool ConnectionManager::start(ConnectFunction connect, DisconnectFunction disconnect, StateCallback callback) {
+
+        if (running_) {
+            return true;
+        }
+
+        connect_ = std::move(connect);
+        disconnect_ = std::move(disconnect);
+        callback_ = std::move(callback);
+
+        wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeup_fd_ == -1) {
+            ROS_ERROR("[ConnectionManager]: eventfd failed: %s", strerror(errno));
+            return false;
+        }
+
+        running_ = true;
+        thread_ = std::thread(&ConnectionManager::loop, this);
+
+        return true;
+    }
+
+//}
+
+/* stop() //{ */
+
+    void ConnectionManager::stop() {
+
+        if (running_) {
+            running_ = false;
+            wakeUp();
+        }
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        if (wakeup_fd_ != -1) {
+            close(wakeup_fd_);
+            wakeup_fd_ = -1;
+        }
+    }
+
+//}
+
+/* getState() //{ */
+
+    ConnectionManager::State ConnectionManager::getState() const {
+        return state_.load(std::memory_order_relaxed);
+    }
+
+//}
+
+/* stateName() //{ */
+
+    const char *ConnectionManager::stateName(State state) {
+
+        switch (state) {
+            case DISCONNECTED:
+                return "disconnected";
+            case OPENING:
+                return "opening";
+            case CONFIGURED:
+                return "configured";
+            case STREAMING:
+                return "streaming";
+            case STALE:
+                return "stale";
+        }
+
+        return "unknown";
+    }
+
+//}
+
+/* dataReceived() //{ */
+
+    void ConnectionManager::dataReceived() {
+
+        // a plain load on every call, the exchange and the wake up only on the first data after a (re)connect
+        if (state_.load(std::memory_order_relaxed) != CONFIGURED) {
+            return;
+        }
+
+        State expected = CONFIGURED;
+        if (state_.compare_exchange_strong(expected, STREAMING)) {
+            wakeUp();
+        }
+    }
+
+//}
+
+/* connectionLost() //{ */
+
+    void ConnectionManager::connectionLost(const std::string &reason) {
+        {
+            std::scoped_lock lock(mutex_requests_);
+            lost_pending_ = true;
+            lost_reason_ = reason;
+        }
+        wakeUp();
+    }
+
+//}
+
+/* connectionStale() //{ */
+
+    void ConnectionManager::connectionStale(const std::string &reason) {
+        {
+            std::scoped_lock lock(mutex_requests_);
+            lost_pending_ = true;
+            stale_pending_ = true;
+            lost_reason_ = reason;
+        }
+        wakeUp();
+    }
+
+//}
+
+/* reconnectNow() //{ */
+
+    void ConnectionManager::reconnectNow() {
+        {
+            std::scoped_lock lock(mutex_requests_);
+            reconnect_pending_ = true;
+        }
+        wakeUp();
+    }
+
+//}
+
+/* wakeUp() //{ */
+
+    void ConnectionManager::wakeUp() {
+
+        if (wakeup_fd_ == -1) {
+            return;
+        }
+
+        uint64_t one = 1;
+        if (write(wakeup_fd_, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN) {
+            ROS_WARN("[ConnectionManager]: failed to wake up the worker thread");
+        }
+    }
+
+//}
+
+/* setState() //{ */
+
+    void ConnectionManager::setState(State state, const std::string &reason, double retry_in) {
+
+        state_ = state;
+
+        StateChange change;
+        change.state = state;
+        change.previous = published_state_;
+        change.reason = reason;
+        change.failed_attempts = failed_attempts_;
+        change.retry_in = retry_in;
+
+        published_state_ = state;
+
+        if (callback_) {
+            callback_(change);
+        }
+    }
+
+//}
+
+/* backoffDelay() //{ */
+
+    double ConnectionManager::backoffDelay() {
+
+        const double delay = std::min(backoff_max_, backoff_min_ * std::pow(2.0, std::min<uint32_t>(failed_attempts_, 32) - 1.0));
+
+        // "equal jitter", at least half of the delay is kept so that a dead device is not hammered
+        std::uniform_real_distribution<double> jitter(0.5, 1.0);
+
+        return delay * jitter(random_engine_);
+    }
+
+//}
+
+/* loop() //{ */
+
+    void ConnectionManager::loop() {
+
+        using clock = std::chrono::steady_clock;
+
+        clock::time_point next_attempt = clock::now();
+
+        struct pollfd fds[1];
+        fds[0].fd = wakeup_fd_;
+        fds[0].events = POLLIN;
+
+        while (running_) {
+
+            bool lost = false;
+            bool stale = false;
+            bool reconnect = false;
+            std::string reason;
+
+            {
+                std::scoped_lock lock(mutex_requests_);
+                std::swap(lost, lost_pending_);
+                std::swap(stale, stale_pending_);
+                std::swap(reconnect, reconnect_pending_);
+                std::swap(reason, lost_reason_);
+            }
+
+            const State state = state_.load();
+
+            // the first data after the (re)connect, set by the read path
+            if (state != published_state_) {
+                setState(state, "data received");
+            }
+
+            if (lost && state != DISCONNECTED) {
+
+                if (stale) {
+                    setState(STALE, reason);
+                }
+
+                disconnect_();
+
+                // the first attempt right away, the port is often back immediately after a glitch
+                failed_attempts_ = 0;
+                next_attempt = clock::now();
+                setState(DISCONNECTED, reason);
+            }
+
+            if (reconnect) {
+                next_attempt = clock::now();
+            }
+
+            if (state_ == DISCONNECTED && clock::now() >= next_attempt) {
+
+                setState(OPENING, "");
+
+                if (connect_()) {
+
+                    failed_attempts_ = 0;
+                    setState(CONFIGURED, "");
+
+                } else {
+
+                    failed_attempts_++;
+
+                    const double delay = backoffDelay();
+                    next_attempt = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(delay));
+
+                    setState(DISCONNECTED, "open failed", delay);
+                }
+            }
+
+            int timeout_ms = -1;
+            if (state_ == DISCONNECTED) {
+                const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(next_attempt - clock::now()).count();
+                timeout_ms = std::max<int>(0, remaining + 1);
+            }
+
+            if (poll(fds, 1, timeout_ms) == -1 && errno != EINTR) {
+                ROS_ERROR("[ConnectionManager]: poll failed: %s", strerror(errno));
+                break;
+            }
+
+            uint64_t value;
+            if (read(wakeup_fd_, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+                ROS_WARN("[ConnectionManager]: failed to read the wake up counter: %s", strerror(errno));
+            }
+        }
+    }
+
+//}
+
+}  // namespace serial_port
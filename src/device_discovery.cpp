@@ -0,0 +1,244 @@
+#include "device_discovery.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <sys/stat.h>
+
+namespace serial_port {
+
+/* readAttribute() //{ */
+
+    // first line of a sysfs attribute, empty when it does not exist
+    static std::string readAttribute(const std::string &path) {
+
+        std::ifstream file(path);
+        std::string value;
+
+        if (!file || !std::getline(file, value)) {
+            return "";
+        }
+
+        while (!value.empty() && std::isspace(static_cast<unsigned char>(value.back()))) {
+            value.pop_back();
+        }
+
+        return value;
+    }
+
+//}
+
+/* normalizeId() //{ */
+
+    // "0x0403" and "0403" are the same vendor
+    static std::string normalizeId(std::string id) {
+
+        if (id.size() > 2 && id[0] == '0' && (id[1] == 'x' || id[1] == 'X')) {
+            id = id.substr(2);
+        }
+
+        std::transform(id.begin(), id.end(), id.begin(), [](unsigned char c) { return std::tolower(c); });
+
+        return id;
+    }
+
+//}
+
+/* fileExists() //{ */
+
+    static bool fileExists(const std::string &path) {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0;
+    }
+
+//}
+
+/* UsbDeviceFilter::empty() //{ */
+
+    bool UsbDeviceFilter::empty() const {
+        return vid.empty() && pid.empty() && serial.empty() && usb_path.empty();
+    }
+
+//}
+
+/* UsbDeviceFilter::matches() //{ */
+
+    bool UsbDeviceFilter::matches(const UsbSerialDevice &device) const {
+
+        if (!vid.empty() && normalizeId(vid) != device.vid) {
+            return false;
+        }
+
+        if (!pid.empty() && normalizeId(pid) != device.pid) {
+            return false;
+        }
+
+        if (!serial.empty() && serial != device.serial) {
+            return false;
+        }
+
+        if (!usb_path.empty() && usb_path != device.usb_path && usb_path != device.interface) {
+            return false;
+        }
+
+        return true;
+    }
+
+//}
+
+/* UsbDeviceFilter::toString() //{ */
+
+    std::string UsbDeviceFilter::toString() const {
+
+        std::string str;
+
+        if (!vid.empty()) {
+            str += " vid " + vid;
+        }
+        if (!pid.empty()) {
+            str += " pid " + pid;
+        }
+        if (!serial.empty()) {
+            str += " serial " + serial;
+        }
+        if (!usb_path.empty()) {
+            str += " usb path " + usb_path;
+        }
+
+        return str.empty() ? "any device" : str.substr(1);
+    }
+
+//}
+
+/* listUsbSerialDevices() //{ */
+
+    std::vector<UsbSerialDevice> listUsbSerialDevices(const std::string &sysfs) {
+
+        std::vector<UsbSerialDevice> devices;
+
+        char resolved[PATH_MAX];
+        if (realpath((sysfs + "/devices").c_str(), resolved) == nullptr) {
+            return devices;
+        }
+        const std::string devices_root = resolved;
+
+        const std::string class_dir = sysfs + "/class/tty";
+        DIR *dir = opendir(class_dir.c_str());
+        if (dir == nullptr) {
+            return devices;
+        }
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+
+            const std::string name = entry->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+
+            // virtual terminals have no device
+            if (realpath((class_dir + "/" + name + "/device").c_str(), resolved) == nullptr) {
+                continue;
+            }
+
+            UsbSerialDevice device;
+
+            // walk up from the tty to the usb device, which is the first one with idVendor
+            // ttyACM: .../1-1.2/1-1.2:1.0, ttyUSB: .../1-1.2/1-1.2:1.0/ttyUSB0
+            std::string path = resolved;
+            bool found = false;
+
+            while (path.size() > devices_root.size() && path.compare(0, devices_root.size(), devices_root) == 0) {
+
+                if (fileExists(path + "/idVendor")) {
+                    found = true;
+                    break;
+                }
+
+                const std::string base = path.substr(path.rfind('/') + 1);
+                if (device.interface.empty() && base.find(':') != std::string::npos && fileExists(path + "/bInterfaceNumber")) {
+                    device.interface = base;
+                }
+
+                path = path.substr(0, path.rfind('/'));
+            }
+
+            // serial ports of the board, bluetooth etc.
+            if (!found) {
+                continue;
+            }
+
+            device.vid          = normalizeId(readAttribute(path + "/idVendor"));
+            device.pid          = normalizeId(readAttribute(path + "/idProduct"));
+            device.serial       = readAttribute(path + "/serial");
+            device.manufacturer = readAttribute(path + "/manufacturer");
+            device.product      = readAttribute(path + "/product");
+            device.usb_path     = path.substr(path.rfind('/') + 1);
+
+            // the node may be named differently than the class entry, e.g. in a subdirectory of /dev
+            std::string devname = name;
+            std::ifstream uevent(class_dir + "/" + name + "/uevent");
+            std::string line;
+            while (std::getline(uevent, line)) {
+                if (line.compare(0, 8, "DEVNAME=") == 0) {
+                    devname = line.substr(8);
+                }
+            }
+            device.devnode = "/dev/" + devname;
+
+            devices.push_back(device);
+        }
+
+        closedir(dir);
+
+        std::sort(devices.begin(), devices.end(), [](const UsbSerialDevice &a, const UsbSerialDevice &b) { return a.devnode < b.devnode; });
+
+        return devices;
+    }
+
+//}
+
+/* findUsbSerialDevice() //{ */
+
+    std::string findUsbSerialDevice(const UsbDeviceFilter &filter, std::string &error, const std::string &sysfs) {
+
+        const std::vector<UsbSerialDevice> devices = listUsbSerialDevices(sysfs);
+
+        std::vector<const UsbSerialDevice *> matching;
+        std::string candidates;
+
+        for (const UsbSerialDevice &device : devices) {
+
+            if (filter.matches(device)) {
+                matching.push_back(&device);
+            }
+
+            candidates += (candidates.empty() ? "" : ", ") + device.devnode + " [" + device.vid + ":" + device.pid;
+            if (!device.serial.empty()) {
+                candidates += " serial " + device.serial;
+            }
+            candidates += " at " + (device.interface.empty() ? device.usb_path : device.interface) + "]";
+        }
+
+        if (matching.size() == 1) {
+            error.clear();
+            return matching[0]->devnode;
+        }
+
+        // guessing would bring back the wrong device the discovery is meant to avoid
+        if (matching.empty()) {
+            error = "no usb serial device matches " + filter.toString() + ", found: " + (candidates.empty() ? "none" : candidates);
+        } else {
+            error = std::to_string(matching.size()) + " usb serial devices match " + filter.toString() + ", narrow the filter down with the serial or the usb path, found: " +
+                    candidates;
+        }
+
+        return "";
+    }
+
+//}
+
+}  // namespace serial_port
@@ -20,6 +20,10 @@
 #include <mrs_lib/service_client_handler.h>
 
 #include <serial_port.h>
+#include <serial_reactor.h>
+#include <device_discovery.h>
+#include <port_supervisor.h>
+#include <serial_transmitter.h>
 
 #include <nodelet/nodelet.h>
 #include <pluginlib/class_list_macros.h>
@@ -62,6 +66,7 @@ private:
   mrs_lib::ServiceClientHandler<std_srvs::SetBool> service_set_all_;
 
   void interpretSerialData(uint8_t data);
+  void callbackSerialData(const uint8_t *data, int len);
   void callbackSerialTimer(const ros::TimerEvent &event);
   void callbackPollTimer(const ros::TimerEvent &event);
   void callbackEstopTimer(const ros::TimerEvent &event);
@@ -70,7 +75,6 @@ private:
   void callbackSendRawMessage(const mrs_msgs::SerialRawConstPtr &msg);
   void controlManagerCallback(const mrs_msgs::ControlManagerDiagnosticsConstPtr &msg);
 
-  uint8_t connectToSensor(void);
   void    processMessage(uint8_t payload_size, uint8_t *input_buffer, uint8_t checksum, uint8_t checksum_rec, bool checksum_correct);
 
   ros::NodeHandle nh_;
@@ -81,6 +85,8 @@ private:
   ros::Subscriber control_manager_subscriber_;
 
   serial_port::SerialPort serial_port_;
+  serial_port::SerialReactor serial_reactor_;
+  serial_port::SerialTransmitter serial_transmitter_{&serial_port_};
 
   boost::function<void(uint8_t)> serial_data_callback_function_;
 
@@ -94,10 +100,29 @@ private:
   int serial_rate_        = 5000;
   int serial_buffer_size_ = 1024;
 
+  bool use_reactor_        = true;
+  bool use_shared_reactor_ = true;
+  bool use_hotplug_        = true;
+  bool use_reader_thread_  = false;
+  int  reader_ring_size_   = 65536;
+  bool use_io_uring_       = false;
+
+  int reconnect_backoff_min_ms_ = 100;
+  int reconnect_backoff_max_ms_ = 5000;
+
+  bool low_latency_      = true;
+  int  latency_timer_ms_ = 1;
+
+  int tx_queue_depth_        = 64;
+  int tx_kernel_queue_limit_ = 64;
+
   std::string portname_;
   int         baudrate_;
   std::string uav_name_;
 
+  // looks the port up by the usb identity of the device instead, when set
+  serial_port::UsbDeviceFilter device_filter_;
+
   std::vector<uint8_t> poll_msg_;
   std::vector<uint8_t> normal_response_msg_;
   std::vector<uint8_t> estop_response_msg_;
@@ -107,10 +132,10 @@ private:
   std::mutex mutex_msg;
 
   ros::Time interval_      = ros::Time::now();
-  ros::Time last_received_ = ros::Time::now();
-
-  bool is_connected_   = false;
   bool is_initialized_ = false;
+
+  // keeps the port open and publishes the state of the connection, declared last so that its threads stop first
+  serial_port::PortSupervisor port_supervisor_{&serial_port_};
 };
 
 //}
@@ -129,11 +154,27 @@ void Estop::onInit() {
 
   param_loader.loadParam("uav_name", uav_name_, std::string("uav"));
   param_loader.loadParam("portname", portname_, std::string("/dev/ttyUSB0"));
+  param_loader.loadParam("device_vid", device_filter_.vid, std::string(""));
+  param_loader.loadParam("device_pid", device_filter_.pid, std::string(""));
+  param_loader.loadParam("device_serial", device_filter_.serial, std::string(""));
+  param_loader.loadParam("device_usb_path", device_filter_.usb_path, std::string(""));
   param_loader.loadParam("baudrate", baudrate_, 115200);
   param_loader.loadParam("publish_bad_checksum", publish_bad_checksum, false);
   param_loader.loadParam("use_timeout", use_timeout, true);
   param_loader.loadParam("serial_rate", serial_rate_, 5000);
   param_loader.loadParam("serial_buffer_size", serial_buffer_size_, 1024);
+  param_loader.loadParam("use_reactor", use_reactor_, true);
+  param_loader.loadParam("use_shared_reactor", use_shared_reactor_, true);
+  param_loader.loadParam("use_hotplug", use_hotplug_, true);
+  param_loader.loadParam("reconnect_backoff_min_ms", reconnect_backoff_min_ms_, 100);
+  param_loader.loadParam("reconnect_backoff_max_ms", reconnect_backoff_max_ms_, 5000);
+  param_loader.loadParam("use_reader_thread", use_reader_thread_, false);
+  param_loader.loadParam("reader_ring_size", reader_ring_size_, 65536);
+  param_loader.loadParam("use_io_uring", use_io_uring_, false);
+  param_loader.loadParam("low_latency", low_latency_, true);
+  param_loader.loadParam("latency_timer_ms", latency_timer_ms_, 1);
+  param_loader.loadParam("tx_queue_depth", tx_queue_depth_, 64);
+  param_loader.loadParam("tx_kernel_queue_limit", tx_kernel_queue_limit_, 64);
 
   std::vector<int> poll_msg_load;
   std::vector<int> normal_response_msg_load;
@@ -185,12 +226,55 @@ void Estop::onInit() {
   ROS_INFO_THROTTLE(1.0, "[%s] test test:", ros::this_node::getName().c_str());
   ROS_INFO_THROTTLE(1.0, "[%s] is up and running with the following parameters:", ros::this_node::getName().c_str());
   ROS_INFO_THROTTLE(1.0, "[%s] portname: %s", ros::this_node::getName().c_str(), portname_.c_str());
+  if (!device_filter_.empty()) {
+    ROS_INFO_THROTTLE(1.0, "[%s] device: %s", ros::this_node::getName().c_str(), device_filter_.toString().c_str());
+  }
   ROS_INFO_THROTTLE(1.0, "[%s] baudrate: %i", ros::this_node::getName().c_str(), baudrate_);
   ROS_INFO_STREAM_THROTTLE(1.0, "[" << ros::this_node::getName().c_str() << "] publishing messages with wrong checksum: " << publish_bad_checksum);
 
-  connectToSensor();
+  // the reactor delivers the data as soon as the port becomes readable, polling timer is only a fallback
+  if (use_reactor_) {
+    // one I/O thread for all nodelets of the manager, the data are read and handled in the callback queue of this nodelet
+    if (use_shared_reactor_) {
+      serial_reactor_.setCallbackQueue(&getMTCallbackQueue());
+      serial_reactor_.startShared();
+    } else {
+      serial_reactor_.start();
+    }
+  }
+
+  // outbound frames are written by one thread in the order of their priority
+  serial_transmitter_.start(tx_queue_depth_, tx_kernel_queue_limit_);
+
+  // drain the port from a dedicated thread, so that slow callbacks cannot overrun the kernel buffer
+  if (use_reader_thread_) {
+    serial_port_.enableReaderThread(reader_ring_size_);
+  }
+
+  // io_uring for the reads of the reader thread and the frames of the transmitter, poll() and write() where the kernel does not have it
+  serial_port_.setIoUring(use_io_uring_);
+
+  // small frames would otherwise wait up to 16 ms in the buffer of an FTDI adapter
+  serial_port_.setLowLatency(low_latency_, latency_timer_ms_);
+
+  serial_port::PortSupervisor::Options port_options;
+  port_options.portname      = portname_;
+  port_options.device_filter = device_filter_;
+  port_options.baudrate      = baudrate_;
+  port_options.buffer_size   = serial_buffer_size_;
+  port_options.use_timeout   = use_timeout;
+  port_options.timeout       = MAXIMAL_TIME_INTERVAL;
+  port_options.backoff_min   = reconnect_backoff_min_ms_ * 1e-3;
+  port_options.backoff_max   = reconnect_backoff_max_ms_ * 1e-3;
+  port_options.use_hotplug   = use_hotplug_;
+
+  port_supervisor_.start(nh_, port_options, use_reactor_ ? &serial_reactor_ : nullptr,
+                         [this](const uint8_t *data, int len) { callbackSerialData(data, len); });
+
+  if (!use_reactor_) {
+    serial_timer_ = nh_.createTimer(ros::Rate(10), &Estop::callbackSerialTimer, this);
+  }
 
-  serial_timer_     = nh_.createTimer(ros::Rate(10), &Estop::callbackSerialTimer, this);
   poll_timer_       = nh_.createTimer(ros::Rate(1), &Estop::callbackPollTimer, this);
   estop_timer_      = nh_.createTimer(ros::Rate(1), &Estop::callbackEstopTimer, this);
   maintainer_timer_ = nh_.createTimer(ros::Rate(1), &Estop::callbackMaintainerTimer, this);
@@ -217,10 +301,25 @@ void Estop::callbackSerialTimer(const ros::TimerEvent &event) {
 
   bytes_read = serial_port_.readSerial(read_buffer, serial_buffer_size_);
 
-  for (int i = 0; i < bytes_read; i++) {
-    interpretSerialData(read_buffer[i]);
+  if (bytes_read > 0) {
+    callbackSerialData(read_buffer, bytes_read);
+  }
+}
+
+//}
+
+/* callbackSerialData() //{ */
+
+void Estop::callbackSerialData(const uint8_t *data, int len) {
+
+  port_supervisor_.dataReceived(ros::Time::now());
+
+  // the response buffer is shared with the poll timer
+  std::scoped_lock lock(mutex_msg);
+
+  for (int i = 0; i < len; i++) {
+    interpretSerialData(data[i]);
   }
-  /* processMessage */
 }
 
 //}
@@ -229,7 +328,10 @@ void Estop::callbackSerialTimer(const ros::TimerEvent &event) {
 
 void Estop::callbackPollTimer(const ros::TimerEvent &event) {
 
-  response_msg_.clear();
+  {
+    std::scoped_lock lock(mutex_msg);
+    response_msg_.clear();
+  }
 
   size_t  payload_size = poll_msg_.size();
   uint8_t msg_out_buffer[payload_size];
@@ -238,7 +340,7 @@ void Estop::callbackPollTimer(const ros::TimerEvent &event) {
     msg_out_buffer[i] = poll_msg_[i];
   }
 
-  serial_port_.sendCharArray(msg_out_buffer, payload_size);
+  serial_transmitter_.send(msg_out_buffer, payload_size, serial_port::TX_SAFETY);
 }
 
 //}
@@ -264,7 +366,10 @@ void Estop::callbackEstopTimer(const ros::TimerEvent &event) {
       set_bool.request.data = false;
       service_set_all_.call(set_bool);
 
+      port_supervisor_.stop();
       serial_timer_.stop();
+      serial_reactor_.stop();
+      serial_transmitter_.stop();
       poll_timer_.stop();
       estop_timer_.stop();
     }
@@ -277,33 +382,20 @@ void Estop::callbackEstopTimer(const ros::TimerEvent &event) {
 
 void Estop::callbackMaintainerTimer(const ros::TimerEvent &event) {
 
-  if (is_connected_) {
+  if (port_supervisor_.isConnected()) {
 
-    if (!serial_port_.checkConnected()) {
-      is_connected_ = false;
-      ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial device is disconnected! ");
-    }
+    ROS_INFO_STREAM_THROTTLE(10.0, "[" << ros::this_node::getName().c_str() << "] Tx queue: " << serial_transmitter_.getStatsSummary());
   }
 
-  if (((ros::Time::now() - last_received_).toSec() > MAXIMAL_TIME_INTERVAL) && use_timeout && is_connected_) {
-
-    is_connected_ = false;
-
-    ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial port timed out - no messages were received in " << MAXIMAL_TIME_INTERVAL
-                         << " seconds");
-  }
+  port_supervisor_.checkConnection();
 
-  if (is_connected_) {
+  if (port_supervisor_.isConnected()) {
 
     received_msg_ok_garmin    = 0;
     received_msg_ok           = 0;
     received_msg_bad_checksum = 0;
 
     interval_ = ros::Time::now();
-
-  } else {
-
-    connectToSensor();
   }
 }
 
@@ -317,11 +409,8 @@ void Estop::callbackSendRawMessage(const mrs_msgs::SerialRawConstPtr &msg) {
     return;
   }
 
-  uint8_t payload_size = msg->payload.size();
-  uint8_t out_buffer[payload_size];
-
   ROS_INFO_STREAM("SENDING");
-  serial_port_.sendCharArray(out_buffer, payload_size);
+  serial_transmitter_.send(msg->payload.data(), msg->payload.size(), serial_port::TX_BULK);
 }
 
 //}
@@ -445,27 +534,6 @@ void Estop::processMessage(uint8_t payload_size, uint8_t *input_buffer, uint8_t
 
 //}
 
-/* connectToSensors() //{ */
-
-uint8_t Estop::connectToSensor(void) {
-
-  ROS_INFO_THROTTLE(1.0, "[%s]: Openning the serial port.", ros::this_node::getName().c_str());
-
-  if (!serial_port_.connect(portname_, baudrate_)) {
-    ROS_ERROR_THROTTLE(1.0, "[%s]: Could not connect to sensor.", ros::this_node::getName().c_str());
-    is_connected_ = false;
-    return 0;
-  }
-
-  ROS_INFO_THROTTLE(1.0, "[%s]: Connected to sensor.", ros::this_node::getName().c_str());
-  is_connected_  = true;
-  last_received_ = ros::Time::now();
-
-  return 1;
-}
-
-//}
-
 }  // namespace estop
 
 PLUGINLIB_EXPORT_CLASS(estop::Estop, nodelet::Nodelet);
@@ -127,7 +127,7 @@ namespace gimbal
                     SBGC_cmd_realtime_data_custom_t msg = {0};
                     if (SBGC_cmd_realtime_data_custom_unpack(msg, m_request_data_flags, cmd) == 0) {
                         ROS_INFO_THROTTLE(1.0, "[Gimbal]: Received realtime custom data.");
-                        process_custom_data_msg(msg);
+                        process_custom_data_msg(msg, sbgc_parser.in_cmd_stamp);
                     } else {
                         ROS_ERROR_THROTTLE(1.0,
                                            "[Gimbal]: Received realtime custom data, but failed to unpack (parsed %u/%u bytes)!",
@@ -167,7 +167,8 @@ namespace gimbal
             const double valid_perc = 100.0 * m_valid_msgs_received / m_msgs_received;
             ROS_INFO_STREAM_THROTTLE(
                     1.0, "[Gimbal]: Received " << m_valid_msgs_received << "/" << m_msgs_received
-                                               << " valid messages so far (" << valid_perc << "%).");
+                                               << " valid messages so far (" << valid_perc << "%) using "
+                                               << sbgc_parser.get_read_call_count() << " reads.");
         }
     }
     //}
@@ -241,7 +242,7 @@ namespace gimbal
     //}
 
     /* process_custom_data_msg() method //{ */
-    void Gimbal::process_custom_data_msg(const SBGC_cmd_realtime_data_custom_t &data) {
+    void Gimbal::process_custom_data_msg(const SBGC_cmd_realtime_data_custom_t &data, const ros::Time &stamp) {
         /* Process the gimbal stabilization frame //{ */
         if (m_request_data_flags & cmd_realtime_data_custom_flags_z_vector_h_vector) {
             // convert the data from END to NWU
@@ -263,7 +264,7 @@ namespace gimbal
 
             geometry_msgs::TransformStamped tf;
             tf.header.frame_id = m_stabilized_frame_id;
-            tf.header.stamp = ros::Time::now();
+            tf.header.stamp = stamp;
             tf.child_frame_id = m_stabilization_frame_id;
             tf.transform.rotation.x = q.x();
             tf.transform.rotation.y = q.y();
@@ -293,7 +294,7 @@ namespace gimbal
             // publish the results
             nav_msgs::OdometryPtr msg = boost::make_shared<nav_msgs::Odometry>();
             msg->header.frame_id = m_base_frame_id;
-            msg->header.stamp = ros::Time::now();
+            msg->header.stamp = stamp;
             msg->child_frame_id = m_stabilized_frame_id;
             msg->pose.pose.orientation.x = q.x();
             msg->pose.pose.orientation.y = q.y();
@@ -0,0 +1,239 @@
+#include "hotplug_monitor.h"
+
+#include <ros/ros.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// changes of the device node in its directory
+#define NODE_EVENTS (IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_TO | IN_MOVED_FROM)
+
+// a missing directory of the node being created in its parent
+#define PARENT_EVENTS (IN_CREATE | IN_MOVED_TO)
+
+namespace serial_port {
+
+/* HotplugMonitor() //{ */
+
+    HotplugMonitor::HotplugMonitor() {
+    }
+
+//}
+
+/* ~HotplugMonitor() //{ */
+
+    HotplugMonitor::~HotplugMonitor() {
+        stop();
+    }
+
+//}
+
+/* start() //{ */
+
+    bool HotplugMonitor::start(const std::string &path, Callback callback) {
+
+        if (running_) {
+            return true;
+        }
+
+        const size_t slash = path.rfind('/');
+        path_ = path;
+        directory_ = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+        name_ = path.substr(slash == std::string::npos ? 0 : slash + 1);
+        callback_ = std::move(callback);
+
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd_ == -1) {
+            ROS_ERROR("[HotplugMonitor]: inotify_init1 failed: %s", strerror(errno));
+            return false;
+        }
+
+        wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeup_fd_ == -1) {
+            ROS_ERROR("[HotplugMonitor]: eventfd failed: %s", strerror(errno));
+            close(inotify_fd_);
+            inotify_fd_ = -1;
+            return false;
+        }
+
+        watchDirectory();
+
+        running_ = true;
+        thread_ = std::thread(&HotplugMonitor::loop, this);
+
+        return true;
+    }
+
+//}
+
+/* stop() //{ */
+
+    void HotplugMonitor::stop() {
+
+        if (running_) {
+            running_ = false;
+            uint64_t one = 1;
+            if (write(wakeup_fd_, &one, sizeof(one)) != sizeof(one)) {
+                ROS_WARN("[HotplugMonitor]: failed to wake up the monitor thread");
+            }
+        }
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        if (wakeup_fd_ != -1) {
+            close(wakeup_fd_);
+            wakeup_fd_ = -1;
+        }
+
+        // closing the inotify fd removes all its watches
+        if (inotify_fd_ != -1) {
+            close(inotify_fd_);
+            inotify_fd_ = -1;
+        }
+
+        directory_wd_ = -1;
+        parent_wd_ = -1;
+    }
+
+//}
+
+/* isRunning() //{ */
+
+    bool HotplugMonitor::isRunning() const {
+        return running_;
+    }
+
+//}
+
+/* watchDirectory() //{ */
+
+    void HotplugMonitor::watchDirectory() {
+
+        // a few levels may get created while we are adding the watches
+        for (int attempt = 0; directory_wd_ == -1 && attempt < 8; attempt++) {
+
+            directory_wd_ = inotify_add_watch(inotify_fd_, directory_.c_str(), NODE_EVENTS);
+            if (directory_wd_ != -1) {
+                break;
+            }
+
+            // wait for the directory in its deepest existing parent
+            std::string parent = directory_;
+            int wd = -1;
+
+            while (wd == -1 && parent.size() > 1) {
+                const size_t slash = parent.rfind('/');
+                parent = slash == std::string::npos || slash == 0 ? "/" : parent.substr(0, slash);
+                wd = inotify_add_watch(inotify_fd_, parent.c_str(), PARENT_EVENTS);
+            }
+
+            if (wd == -1) {
+                ROS_ERROR_THROTTLE(1.0, "[HotplugMonitor]: could not watch any parent of %s: %s", directory_.c_str(), strerror(errno));
+                return;
+            }
+
+            if (parent_wd_ != -1 && parent_wd_ != wd) {
+                inotify_rm_watch(inotify_fd_, parent_wd_);
+            }
+            parent_wd_ = wd;
+
+            if (access(directory_.c_str(), F_OK) != 0) {
+                return;
+            }
+        }
+
+        if (directory_wd_ != -1 && parent_wd_ != -1) {
+            inotify_rm_watch(inotify_fd_, parent_wd_);
+            parent_wd_ = -1;
+        }
+    }
+
+//}
+
+/* loop() //{ */
+
+    void HotplugMonitor::loop() {
+
+        // the events are variable-length records, see inotify(7)
+        alignas(struct inotify_event) char buffer[4096];
+
+        struct pollfd fds[2];
+        fds[0].fd = inotify_fd_;
+        fds[0].events = POLLIN;
+        fds[1].fd = wakeup_fd_;
+        fds[1].events = POLLIN;
+
+        bool was_present = access(path_.c_str(), F_OK) == 0;
+
+        while (running_) {
+
+            if (poll(fds, 2, -1) == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ROS_ERROR("[HotplugMonitor]: poll failed: %s", strerror(errno));
+                break;
+            }
+
+            if (!running_) {
+                break;
+            }
+
+            bool changed = false;
+            ssize_t len;
+
+            while ((len = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+
+                for (char *ptr = buffer; ptr < buffer + len;) {
+
+                    const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+                    ptr += sizeof(struct inotify_event) + event->len;
+
+                    if (event->wd == directory_wd_) {
+
+                        // the directory itself was removed
+                        if (event->mask & IN_IGNORED) {
+                            directory_wd_ = -1;
+                            changed = true;
+                        } else if (event->len > 0 && (name_.empty() || name_ == event->name)) {
+                            changed = true;
+                        }
+
+                    } else if (event->wd == parent_wd_) {
+
+                        // the parent was removed as well, the watch moves further up
+                        if (event->mask & IN_IGNORED) {
+                            parent_wd_ = -1;
+                        }
+                        changed = true;
+                    }
+                }
+            }
+
+            if (!changed) {
+                continue;
+            }
+
+            watchDirectory();
+
+            // follows a by-id link to its tty, a watched directory itself is always present
+            const bool present = access(path_.c_str(), F_OK) == 0;
+
+            // a node that is present is reported again, opening it may have failed before udev set its permissions
+            if (present || was_present) {
+                callback_(present);
+            }
+
+            was_present = present;
+        }
+    }
+
+//}
+
+}  // namespace serial_port
@@ -3,6 +3,7 @@
 #include <ros/package.h>
 #include <stdlib.h>
 #include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <sensor_msgs/Range.h>
 #include <std_msgs/Char.h>
 #include <std_srvs/SetBool.h>
@@ -10,18 +11,26 @@
 #include <mrs_msgs/SetInt.h>
 #include <std_msgs/Empty.h>
 #include <mutex>
+#include <chrono>
 
 #include <string>
 #include <mrs_msgs/BacaProtocol.h>
 #include <mrs_msgs/SerialRaw.h>
 
 #include <serial_port.h>
+#include <serial_reactor.h>
+#include <device_discovery.h>
+#include <port_supervisor.h>
+#include <serial_transmitter.h>
+#include <message_pool.h>
+#include <baca_framer.h>
+#include <baca_dispatcher.h>
+#include <baca_messages.h>
+#include <link_stats.h>
 
 #include <nodelet/nodelet.h>
 #include <pluginlib/class_list_macros.h>
 
-#define BUFFER_SIZE 256
-
 #define MAXIMAL_TIME_INTERVAL 1
 
 namespace led
@@ -35,25 +44,19 @@ public:
   virtual void onInit();
 
 private:
-  enum serial_receiver_state
-  {
-    WAITING_FOR_MESSSAGE,
-    EXPECTING_SIZE,
-    EXPECTING_PAYLOAD,
-    EXPECTING_CHECKSUM
-  };
-
-
   ros::Timer serial_timer_;
   ros::Timer maintainer_timer_;
+  ros::Timer diagnostics_timer_;
 
   ros::ServiceServer all_service_server_;
   ros::ServiceServer led_service_server_;
   ros::ServiceServer ouster_service_server_;
 
-  void interpretSerialData(uint8_t data);
+  void interpretFrame(const baca_protocol::BacaFrame &frame);
+  void callbackSerialData(const uint8_t *data, int len);
   void callbackSerialTimer(const ros::TimerEvent &event);
   void callbackMaintainerTimer(const ros::TimerEvent &event);
+  void callbackDiagnosticsTimer(const ros::TimerEvent &event);
 
   bool callbackAll(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res);
   bool callbackLed(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res);
@@ -61,42 +64,71 @@ private:
 
   void callbackSendRawMessage(const mrs_msgs::SerialRawConstPtr &msg);
 
-  uint8_t connectToSensor(void);
-  void    processMessage(uint8_t payload_size, uint8_t *input_buffer, uint8_t checksum, uint8_t checksum_rec, bool checksum_correct);
+  void    processGeneric(const baca_protocol::BacaFrame &frame);
 
   ros::NodeHandle nh_;
 
   ros::Publisher status_publisher;
   ros::Publisher baca_protocol_publisher_;
+  ros::Publisher diagnostics_publisher_;
   /* ros::Publisher baca_protocol_debug_publisher_; */
 
   ros::Subscriber raw_message_subscriber;
 
   serial_port::SerialPort serial_port_;
+  serial_port::SerialReactor serial_reactor_;
+  serial_port::SerialTransmitter serial_transmitter_{&serial_port_};
+  baca_protocol::BacaFramer baca_framer_;
+  baca_protocol::BacaDispatcher baca_dispatcher_;
+
+  // frame counters and latencies of the link, published on /diagnostics
+  serial_port::LinkStats link_stats_;
+
+  // published messages are recycled once the subscribers release them
+  serial_port::MessagePool<mrs_msgs::BacaProtocol> baca_protocol_pool_;
 
   boost::function<void(uint8_t)> serial_data_callback_function_;
 
   bool publish_bad_checksum;
   bool use_timeout;
 
-  uint16_t received_msg_ok           = 0;
-  uint16_t received_msg_ok_garmin    = 0;
-  uint16_t received_msg_bad_checksum = 0;
 
   int serial_rate_        = 5000;
   int serial_buffer_size_ = 1024;
 
+  bool use_reactor_        = true;
+  bool use_shared_reactor_ = true;
+  bool use_hotplug_        = true;
+  bool use_reader_thread_  = false;
+  int  reader_ring_size_   = 65536;
+  bool use_io_uring_       = false;
+
+  int reconnect_backoff_min_ms_ = 100;
+  int reconnect_backoff_max_ms_ = 5000;
+
+  bool low_latency_      = true;
+  int  latency_timer_ms_ = 1;
+
+  int tx_queue_depth_        = 64;
+  int tx_kernel_queue_limit_ = 64;
+
+  bool resync_on_bad_checksum_ = true;
+
+  double diagnostics_rate_ = 1.0;
+
   std::string portname_;
   int         baudrate_;
   std::string uav_name_;
 
-  std::mutex mutex_msg;
+  // looks the port up by the usb identity of the device instead, when set
+  serial_port::UsbDeviceFilter device_filter_;
 
-  ros::Time interval_      = ros::Time::now();
-  ros::Time last_received_ = ros::Time::now();
+  std::mutex mutex_msg;
 
-  bool is_connected_   = false;
   bool is_initialized_ = false;
+
+  // keeps the port open and publishes the state of the connection, declared last so that its threads stop first
+  serial_port::PortSupervisor port_supervisor_{&serial_port_};
 };
 
 //}
@@ -112,11 +144,29 @@ void Led::onInit() {
 
   nh_.param("uav_name", uav_name_, std::string("uav"));
   nh_.param("portname", portname_, std::string("/dev/ttyUSB0"));
+  nh_.param("device_vid", device_filter_.vid, std::string(""));
+  nh_.param("device_pid", device_filter_.pid, std::string(""));
+  nh_.param("device_serial", device_filter_.serial, std::string(""));
+  nh_.param("device_usb_path", device_filter_.usb_path, std::string(""));
   nh_.param("baudrate", baudrate_, 115200);
   nh_.param("publish_bad_checksum", publish_bad_checksum, false);
   nh_.param("use_timeout", use_timeout, true);
   nh_.param("serial_rate", serial_rate_, 50);
   nh_.param("serial_buffer_size", serial_buffer_size_, 1024);
+  nh_.param("use_reactor", use_reactor_, true);
+  nh_.param("use_shared_reactor", use_shared_reactor_, true);
+  nh_.param("use_hotplug", use_hotplug_, true);
+  nh_.param("reconnect_backoff_min_ms", reconnect_backoff_min_ms_, 100);
+  nh_.param("reconnect_backoff_max_ms", reconnect_backoff_max_ms_, 5000);
+  nh_.param("use_reader_thread", use_reader_thread_, false);
+  nh_.param("reader_ring_size", reader_ring_size_, 65536);
+  nh_.param("use_io_uring", use_io_uring_, false);
+  nh_.param("low_latency", low_latency_, true);
+  nh_.param("latency_timer_ms", latency_timer_ms_, 1);
+  nh_.param("tx_queue_depth", tx_queue_depth_, 64);
+  nh_.param("tx_kernel_queue_limit", tx_kernel_queue_limit_, 64);
+  nh_.param("resync_on_bad_checksum", resync_on_bad_checksum_, true);
+  nh_.param("diagnostics_rate", diagnostics_rate_, 1.0);
 
   // Publishers
   baca_protocol_publisher_       = nh_.advertise<mrs_msgs::BacaProtocol>("baca_protocol_out", 1);
@@ -132,14 +182,68 @@ void Led::onInit() {
   ROS_INFO_THROTTLE(1.0, "[%s] test test:", ros::this_node::getName().c_str());
   ROS_INFO_THROTTLE(1.0, "[%s] is up and running with the following parameters:", ros::this_node::getName().c_str());
   ROS_INFO_THROTTLE(1.0, "[%s] portname: %s", ros::this_node::getName().c_str(), portname_.c_str());
+  if (!device_filter_.empty()) {
+    ROS_INFO_THROTTLE(1.0, "[%s] device: %s", ros::this_node::getName().c_str(), device_filter_.toString().c_str());
+  }
   ROS_INFO_THROTTLE(1.0, "[%s] baudrate: %i", ros::this_node::getName().c_str(), baudrate_);
   ROS_INFO_STREAM_THROTTLE(1.0, "[" << ros::this_node::getName().c_str() << "] publishing messages with wrong checksum: " << publish_bad_checksum);
 
-  connectToSensor();
+  // the reactor delivers the data as soon as the port becomes readable, polling timer is only a fallback
+  if (use_reactor_) {
+    // one I/O thread for all nodelets of the manager, the data are read and handled in the callback queue of this nodelet
+    if (use_shared_reactor_) {
+      serial_reactor_.setCallbackQueue(&getMTCallbackQueue());
+      serial_reactor_.startShared();
+    } else {
+      serial_reactor_.start();
+    }
+  }
+
+  // outbound frames are written by one thread in the order of their priority
+  serial_transmitter_.start(tx_queue_depth_, tx_kernel_queue_limit_);
+
+  // drain the port from a dedicated thread, so that slow callbacks cannot overrun the kernel buffer
+  if (use_reader_thread_) {
+    serial_port_.enableReaderThread(reader_ring_size_);
+  }
+
+  // io_uring for the reads of the reader thread and the frames of the transmitter, poll() and write() where the kernel does not have it
+  serial_port_.setIoUring(use_io_uring_);
+
+  // small frames would otherwise wait up to 16 ms in the buffer of an FTDI adapter
+  serial_port_.setLowLatency(low_latency_, latency_timer_ms_);
+
+  // rescan the bytes of a frame with a bad checksum, a false start byte in noise would otherwise swallow the following good frames
+  baca_framer_.setResync(resync_on_bad_checksum_);
+
+  // the node does not decode any message itself, all of them are published as generic BacaProtocol messages
+  baca_dispatcher_.setDefaultHandler([this](const baca_protocol::BacaFrame &frame) { processGeneric(frame); });
+
+  serial_port::PortSupervisor::Options port_options;
+  port_options.portname      = portname_;
+  port_options.device_filter = device_filter_;
+  port_options.baudrate      = baudrate_;
+  port_options.buffer_size   = serial_buffer_size_;
+  port_options.use_timeout   = use_timeout;
+  port_options.timeout       = MAXIMAL_TIME_INTERVAL;
+  port_options.backoff_min   = reconnect_backoff_min_ms_ * 1e-3;
+  port_options.backoff_max   = reconnect_backoff_max_ms_ * 1e-3;
+  port_options.use_hotplug   = use_hotplug_;
+
+  port_supervisor_.start(nh_, port_options, use_reactor_ ? &serial_reactor_ : nullptr,
+                         [this](const uint8_t *data, int len) { callbackSerialData(data, len); });
+
+  if (!use_reactor_) {
+    serial_timer_ = nh_.createTimer(ros::Rate(serial_rate_), &Led::callbackSerialTimer, this);
+  }
 
-  serial_timer_     = nh_.createTimer(ros::Rate(serial_rate_), &Led::callbackSerialTimer, this);
   maintainer_timer_ = nh_.createTimer(ros::Rate(1), &Led::callbackMaintainerTimer, this);
 
+  if (diagnostics_rate_ > 0) {
+    diagnostics_publisher_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
+    diagnostics_timer_     = nh_.createTimer(ros::Rate(diagnostics_rate_), &Led::callbackDiagnosticsTimer, this);
+  }
+
   is_initialized_ = true;
 }
 //}
@@ -157,49 +261,71 @@ void Led::callbackSerialTimer(const ros::TimerEvent &event) {
 
   bytes_read = serial_port_.readSerial(read_buffer, serial_buffer_size_);
 
-
-  for (int i = 0; i < bytes_read; i++) {
-    interpretSerialData(read_buffer[i]);
+  if (bytes_read > 0) {
+    callbackSerialData(read_buffer, bytes_read);
   }
-  /* processMessage */
 }
 
 //}
 
-/* callbackMaintainerTimer() //{ */
+/* callbackSerialData() //{ */
 
-void Led::callbackMaintainerTimer(const ros::TimerEvent &event) {
+void Led::callbackSerialData(const uint8_t *data, int len) {
 
-  if (is_connected_) {
+  const uint64_t zero_size_before = baca_framer_.stats().frames_zero_size;
+  const uint64_t recovered_before = baca_framer_.stats().frames_recovered;
 
-    if (!serial_port_.checkConnected()) {
-      is_connected_ = false;
-      ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial device is disconnected! ");
-    }
+  baca_framer_.decode(data, len, [this](const baca_protocol::BacaFrame &frame) { interpretFrame(frame); });
+
+  const baca_protocol::BacaFramerStats &stats = baca_framer_.stats();
+  link_stats_.setDecoderTotals(stats.bytes, stats.frames_ok, stats.frames_bad_checksum, stats.frames_zero_size, stats.frames_recovered);
+
+  if (baca_framer_.stats().frames_zero_size != zero_size_before) {
+    ROS_ERROR_THROTTLE(1.0, "[%s]: Message with 0 payload_size received, discarding.", ros::this_node::getName().c_str());
+  }
+
+  if (baca_framer_.stats().frames_recovered != recovered_before) {
+    ROS_WARN_STREAM_THROTTLE(1.0, "[" << ros::this_node::getName().c_str() << "] Resynchronized after a bad checksum, "
+                                      << baca_framer_.stats().frames_recovered << " frames recovered so far");
   }
+}
+
+//}
+
+/* callbackDiagnosticsTimer() //{ */
 
-  if (((ros::Time::now() - last_received_).toSec() > MAXIMAL_TIME_INTERVAL) && use_timeout && is_connected_) {
+void Led::callbackDiagnosticsTimer(const ros::TimerEvent &event) {
 
-    is_connected_ = false;
+  // replaced on reconnect when the port is looked up by its usb identity
+  const std::string portname = port_supervisor_.getPortname();
 
-    ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial port timed out - no messages were received in " << MAXIMAL_TIME_INTERVAL
-                         << " seconds");
+  // kernel counters, to tell data lost in the driver from noise on the line
+  link_stats_.setUartCounters(serial_port_.getUartCounters());
+  link_stats_.setLowLatencyState(serial_port_.getLowLatencyState());
+
+  const diagnostic_msgs::DiagnosticArray diagnostics =
+      link_stats_.makeDiagnostics(ros::this_node::getName() + ": serial link", portname, port_supervisor_.isConnected(), ros::Time::now());
+
+  try {
+    diagnostics_publisher_.publish(diagnostics);
   }
+  catch (...) {
+    ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", diagnostics_publisher_.getTopic().c_str());
+  }
+}
 
-  if (is_connected_) {
+//}
 
-    ROS_INFO_STREAM("Got msgs - Garmin: " << received_msg_ok_garmin << " Generic msg: " << received_msg_ok << "  Wrong checksum: " << received_msg_bad_checksum
-                                          << "; in the last " << (ros::Time::now() - interval_).toSec() << " s");
-    received_msg_ok_garmin    = 0;
-    received_msg_ok           = 0;
-    received_msg_bad_checksum = 0;
+/* callbackMaintainerTimer() //{ */
 
-    interval_ = ros::Time::now();
+void Led::callbackMaintainerTimer(const ros::TimerEvent &event) {
 
-  } else {
+  if (port_supervisor_.isConnected()) {
 
-    connectToSensor();
+    ROS_INFO_STREAM_THROTTLE(10.0, "[" << ros::this_node::getName().c_str() << "] Tx queue: " << serial_transmitter_.getStatsSummary());
   }
+
+  port_supervisor_.checkConnection();
 }
 
 //}
@@ -212,11 +338,8 @@ void Led::callbackSendRawMessage(const mrs_msgs::SerialRawConstPtr &msg) {
     return;
   }
 
-  uint8_t payload_size = msg->payload.size();
-  uint8_t out_buffer[payload_size];
-
   ROS_INFO_STREAM("SENDING");
-  serial_port_.sendCharArray(out_buffer, payload_size);
+  serial_transmitter_.send(msg->payload.data(), msg->payload.size(), serial_port::TX_BULK);
 }
 
 //}
@@ -227,50 +350,23 @@ bool Led::callbackAll(std_srvs::SetBool::Request &req, std_srvs::SetBool::Respon
 
   bool desired_state = req.data;
 
-  // payload - Id, A, B, C and D outputs
-  // 0 - turn off
-  // 1 - turn on
-  // 2 - do not change
+  using baca_protocol::messages::LedOutputs;
 
-  std::vector<uint8_t> payl;
-  payl.push_back(0x66);
-  payl.push_back(desired_state);
-  payl.push_back(0x00);
-  payl.push_back(desired_state);
-  payl.push_back(0x00);
+  LedOutputs::Payload payload = LedOutputs::payload();
+  LedOutputs::a::write(payload.data(), desired_state);
+  LedOutputs::b::write(payload.data(), LedOutputs::OFF);
+  LedOutputs::c::write(payload.data(), desired_state);
+  LedOutputs::d::write(payload.data(), LedOutputs::OFF);
 
-  for (size_t i = 0; i < payl.size(); i++) {
-    ROS_INFO_STREAM_THROTTLE(1.0, "SENDING: " << payl[i]);
+  for (size_t i = 0; i < payload.size(); i++) {
+    ROS_INFO_STREAM_THROTTLE(1.0, "SENDING: " << payload[i]);
   }
 
   std::scoped_lock lock(mutex_msg);
-  /* uint8_t          payload_size = payl.size(); */
-  uint8_t  payload_size = 5;
-  uint8_t  checksum     = 0;
-  uint16_t it           = 0;
 
-  uint8_t out_buffer[payload_size + 3];
+  const LedOutputs::Frame out_frame = LedOutputs::frame(payload);
 
-  out_buffer[it++] = 'b';
-  checksum += 'b';
-  out_buffer[it++] = payload_size;
-  checksum += payload_size;
-
-  for (int i = 0; i < payload_size; i++) {
-    out_buffer[it++] = payl[i];
-    checksum += payl[i];
-  }
-
-  out_buffer[it] = checksum;
-
-  serial_port_.sendCharArray(out_buffer, payload_size + 3);
-
-  /* mrs_msgs::BacaProtocol msg; */
-  /* msg.stamp = ros::Time::now(); */
-  /* for (uint8_t i = 0; i < payload_size + 3; i++) { */
-  /*   msg.payload.push_back(out_buffer[i]); */
-  /* } */
-  /* baca_protocol_debug_publisher_.publish(msg); */
+  serial_transmitter_.send(out_frame.data(), out_frame.size(), serial_port::TX_BULK);
 
   res.success = true;
   res.message = "Callback All";
@@ -285,40 +381,21 @@ bool Led::callbackLed(std_srvs::SetBool::Request &req, std_srvs::SetBool::Respon
 
   bool desired_state = req.data;
 
-  // payload - Id, A, B, C and D outputs
-  // 0 - turn off
-  // 1 - turn on
-  // 2 - do not change
+  using baca_protocol::messages::LedOutputs;
 
-  std::vector<uint8_t> payl;
-  payl.push_back(0x66);
-  payl.push_back(desired_state);
-  payl.push_back(0x02);
-  payl.push_back(0x02);
-  payl.push_back(0x02);
+  LedOutputs::Payload payload = LedOutputs::payload();
+  LedOutputs::a::write(payload.data(), desired_state);
+  LedOutputs::b::write(payload.data(), LedOutputs::NO_CHANGE);
+  LedOutputs::c::write(payload.data(), LedOutputs::NO_CHANGE);
+  LedOutputs::d::write(payload.data(), LedOutputs::NO_CHANGE);
 
-  ROS_INFO_STREAM_THROTTLE(1.0, "SENDING: " << payl[0]);
+  ROS_INFO_STREAM_THROTTLE(1.0, "SENDING: " << payload[0]);
 
   std::scoped_lock lock(mutex_msg);
-  uint8_t          payload_size = payl.size();
-  uint8_t          checksum     = 0;
-  uint16_t         it           = 0;
 
-  uint8_t out_buffer[payload_size + 3];
+  const LedOutputs::Frame out_frame = LedOutputs::frame(payload);
 
-  out_buffer[it++] = 'b';
-  checksum += 'b';
-  out_buffer[it++] = payload_size;
-  checksum += payload_size;
-
-  for (int i = 0; i < payload_size; i++) {
-    out_buffer[it++] = payl[i];
-    checksum += payl[i];
-  }
-
-  out_buffer[it] = checksum;
-
-  serial_port_.sendCharArray(out_buffer, payload_size + 3);
+  serial_transmitter_.send(out_frame.data(), out_frame.size(), serial_port::TX_BULK);
 
   res.success = true;
   res.message = "Callback All";
@@ -333,40 +410,21 @@ bool Led::callbackOuster(std_srvs::SetBool::Request &req, std_srvs::SetBool::Res
 
   bool desired_state = req.data;
 
-  // payload - Id, A, B, C and D outputs
-  // 0 - turn off
-  // 1 - turn on
-  // 2 - do not change
+  using baca_protocol::messages::LedOutputs;
 
-  std::vector<uint8_t> payl;
-  payl.push_back(0x66);
-  payl.push_back(0x02);
-  payl.push_back(0x02);
-  payl.push_back(desired_state);
-  payl.push_back(0x02);
+  LedOutputs::Payload payload = LedOutputs::payload();
+  LedOutputs::a::write(payload.data(), LedOutputs::NO_CHANGE);
+  LedOutputs::b::write(payload.data(), LedOutputs::NO_CHANGE);
+  LedOutputs::c::write(payload.data(), desired_state);
+  LedOutputs::d::write(payload.data(), LedOutputs::NO_CHANGE);
 
-  ROS_INFO_STREAM_THROTTLE(1.0, "SENDING: " << payl[0]);
+  ROS_INFO_STREAM_THROTTLE(1.0, "SENDING: " << payload[0]);
 
   std::scoped_lock lock(mutex_msg);
-  uint8_t          payload_size = payl.size();
-  uint8_t          checksum     = 0;
-  uint16_t         it           = 0;
 
-  uint8_t out_buffer[payload_size + 3];
+  const LedOutputs::Frame out_frame = LedOutputs::frame(payload);
 
-  out_buffer[it++] = 'b';
-  checksum += 'b';
-  out_buffer[it++] = payload_size;
-  checksum += payload_size;
-
-  for (int i = 0; i < payload_size; i++) {
-    out_buffer[it++] = payl[i];
-    checksum += payl[i];
-  }
-
-  out_buffer[it] = checksum;
-
-  serial_port_.sendCharArray(out_buffer, payload_size + 3);
+  serial_transmitter_.send(out_frame.data(), out_frame.size(), serial_port::TX_BULK);
 
   res.success = true;
   res.message = "Callback All";
@@ -377,155 +435,41 @@ bool Led::callbackOuster(std_srvs::SetBool::Request &req, std_srvs::SetBool::Res
 
 // | ------------------------ routines ------------------------ |
 
-/* interpretSerialData() //{ */
-
-void Led::interpretSerialData(uint8_t single_character) {
-
-  static serial_receiver_state rec_state    = WAITING_FOR_MESSSAGE;
-  static uint8_t               payload_size = 0;
-  static uint8_t               input_buffer[BUFFER_SIZE];
-  static uint8_t               buffer_counter = 0;
-  static uint8_t               checksum       = 0;
-
-  switch (rec_state) {
-    case WAITING_FOR_MESSSAGE:
-
-      if (single_character == 'b' ||
-          single_character == 'a') {  // the 'a' is there for backwards-compatibility, going forwards all messages should start with 'b'
-        checksum       = single_character;
-        buffer_counter = 0;
-        rec_state      = EXPECTING_SIZE;
-      }
-      break;
-
-    case EXPECTING_SIZE:
-
-      if (single_character == 0) {
-        ROS_ERROR_THROTTLE(1.0, "[%s]: Message with 0 payload_size received, discarding.", ros::this_node::getName().c_str());
-        rec_state = WAITING_FOR_MESSSAGE;
-      } else {
-        payload_size = single_character;
-        checksum += single_character;
-        rec_state = EXPECTING_PAYLOAD;
-      }
-      break;
-
-    case EXPECTING_PAYLOAD:
-
-      input_buffer[buffer_counter] = single_character;
-      checksum += single_character;
-      buffer_counter++;
-      if (buffer_counter >= payload_size) {
-        rec_state = EXPECTING_CHECKSUM;
-      }
-      break;
-
-    case EXPECTING_CHECKSUM:
-
-      if (checksum == single_character) {
-        processMessage(payload_size, input_buffer, checksum, single_character, true);
-        last_received_ = ros::Time::now();
-        rec_state      = WAITING_FOR_MESSSAGE;
-      } else {
-        if (publish_bad_checksum) {
-          processMessage(payload_size, input_buffer, checksum, single_character, false);
-        }
-        received_msg_bad_checksum++;
-        rec_state = WAITING_FOR_MESSSAGE;
-      }
-      break;
-  }
-}
+/* interpretFrame() //{ */
 
-//}
+void Led::interpretFrame(const baca_protocol::BacaFrame &frame) {
 
-/* processMessage() //{ */
-
-void Led::processMessage(uint8_t payload_size, uint8_t *input_buffer, uint8_t checksum, uint8_t checksum_rec, bool checksum_correct) {
-
-  /* if (payload_size == 3 && (input_buffer[0] == 0x00 || input_buffer[0] == 0x01) && checksum_correct) { */
-  /*   /1* Special message reserved for garmin rangefinder *1/ */
-  /*   received_msg_ok_garmin++; */
-  /*   uint8_t message_id = input_buffer[0]; */
-  /*   int16_t range      = input_buffer[1] << 8; */
-  /*   range |= input_buffer[2]; */
-
-  /*   sensor_msgs::Range range_msg; */
-  /*   range_msg.field_of_view  = 0.0523599;  // +-3 degree */
-  /*   range_msg.max_range      = MAX_RANGE * 0.01; */
-  /*   range_msg.min_range      = MIN_RANGE * 0.01; */
-  /*   range_msg.radiation_type = sensor_msgs::Range::INFRARED; */
-  /*   range_msg.header.stamp   = ros::Time::now(); */
-
-  /*   range_msg.range = range * 0.01;  // convert to m */
-
-  /*   if (range > MAX_RANGE) { */
-  /*     range_msg.range = std::numeric_limits<double>::infinity(); */
-  /*   } else if (range < MIN_RANGE) { */
-  /*     range_msg.range = -std::numeric_limits<double>::infinity(); */
-  /*   } */
-
-  /*   if (message_id == 0x00) { */
-  /*     range_msg.header.frame_id = garmin_A_frame_; */
-
-  /*     try { */
-  /*       range_publisher_A_.publish(range_msg); */
-  /*     } */
-  /*     catch (...) { */
-  /*       ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", range_publisher_A_.getTopic().c_str()); */
-  /*     } */
-
-  /*   } else if (message_id == 0x01) { */
-  /*     range_msg.header.frame_id = garmin_B_frame_; */
-
-  /*     try { */
-  /*       range_publisher_B_.publish(range_msg); */
-  /*     } */
-  /*     catch (...) { */
-  /*       ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", range_publisher_B_.getTopic().c_str()); */
-  /*     } */
-  /*   } */
-  /* } else { */
-  /* General serial message */
-  if (checksum_correct) {
-    received_msg_ok++;
-  }
-  mrs_msgs::BacaProtocol msg;
-  msg.stamp = ros::Time::now();
-  for (uint8_t i = 0; i < payload_size; i++) {
-    msg.payload.push_back(input_buffer[i]);
-  }
-  msg.checksum_received   = checksum_rec;
-  msg.checksum_calculated = checksum;
-  msg.checksum_correct    = checksum_correct;
-  try {
-    baca_protocol_publisher_.publish(msg);
-  }
-  catch (...) {
-    ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", baca_protocol_publisher_.getTopic().c_str());
+  const auto parsed = std::chrono::steady_clock::now();
+
+  if (frame.checksum_correct) {
+    baca_dispatcher_.dispatch(frame);
+    const ros::Time now = ros::Time::now();
+    port_supervisor_.dataReceived(now);
+    link_stats_.recordFrame(frame.messageId(), std::chrono::duration<double>(std::chrono::steady_clock::now() - parsed).count(),
+                            (now - serial_port_.getByteStamp(frame.bytes_after)).toSec());
+  } else if (publish_bad_checksum) {
+    baca_dispatcher_.dispatch(frame);
   }
-  /* } */
 }
 
 //}
 
-/* connectToSensors() //{ */
+/* processGeneric() //{ */
 
-uint8_t Led::connectToSensor(void) {
+void Led::processGeneric(const baca_protocol::BacaFrame &frame) {
 
-  ROS_INFO_THROTTLE(1.0, "[%s]: Openning the serial port.", ros::this_node::getName().c_str());
-
-  if (!serial_port_.connect(portname_, baudrate_)) {
-    ROS_ERROR_THROTTLE(1.0, "[%s]: Could not connect to sensor.", ros::this_node::getName().c_str());
-    is_connected_ = false;
-    return 0;
+  boost::shared_ptr<mrs_msgs::BacaProtocol> msg = baca_protocol_pool_.acquire();
+  msg->stamp = serial_port_.getByteStamp(frame.bytes_after);
+  msg->payload.assign(frame.payload, frame.payload + frame.payload_size);
+  msg->checksum_received   = frame.checksum_received;
+  msg->checksum_calculated = frame.checksum_calculated;
+  msg->checksum_correct    = frame.checksum_correct;
+  try {
+    baca_protocol_publisher_.publish(mrs_msgs::BacaProtocolConstPtr(msg));
+  }
+  catch (...) {
+    ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", baca_protocol_publisher_.getTopic().c_str());
   }
-
-  ROS_INFO_THROTTLE(1.0, "[%s]: Connected to sensor.", ros::this_node::getName().c_str());
-  is_connected_  = true;
-  last_received_ = ros::Time::now();
-
-  return 1;
 }
 
 //}
@@ -18,6 +18,9 @@
 #include <boost/algorithm/string.hpp>
 
 #include "serial_port.h"
+#include "serial_reactor.h"
+#include "device_discovery.h"
+#include "port_supervisor.h"
 
 #include <nodelet/nodelet.h>
 #include <pluginlib/class_list_macros.h>
@@ -45,6 +48,7 @@ public:
 
 private:
   void interpretSerialData(uint8_t data);
+  void callbackSerialData(const uint8_t *data, int len);
   void callbackSerialTimer(const ros::TimerEvent& event);
   void callbackMaintainerTimer(const ros::TimerEvent& event);
 
@@ -57,8 +61,8 @@ private:
   serial_receiver_state state_ = WAITING_FOR_DOLLAR;
 
   std::string msg_;
+  ros::Time   sentence_stamp_;  // arrival of the last byte of msg_
 
-  uint8_t connectToSensor(void);
   void    processMessage();
   void    stringTimer(const ros::TimerEvent& event);
 
@@ -89,6 +93,7 @@ private:
   mrs_msgs::Bestpos bestpos_msg_;
 
   serial_port::SerialPort serial_port_;
+  serial_port::SerialReactor serial_reactor_;
 
   rtk_state rtk_state_ = NONE;
 
@@ -102,9 +107,25 @@ private:
   int serial_rate_        = 500;
   int serial_buffer_size_ = 1024;
 
+  bool use_reactor_        = true;
+  bool use_shared_reactor_ = true;
+  bool use_hotplug_        = true;
+  bool use_reader_thread_  = false;
+  int  reader_ring_size_   = 65536;
+  bool use_io_uring_       = false;
+
+  int reconnect_backoff_min_ms_ = 100;
+  int reconnect_backoff_max_ms_ = 5000;
+
+  bool low_latency_      = true;
+  int  latency_timer_ms_ = 1;
+
   std::string portname_;
   int         baudrate_;
   std::string uav_name_;
+
+  // looks the port up by the usb identity of the device instead, when set
+  serial_port::UsbDeviceFilter device_filter_;
   std::string garmin_A_frame_;
   std::string garmin_B_frame_;
 
@@ -115,11 +136,12 @@ private:
   int msg_counter_gpgst_ = 0;
   int msg_counter_gpvtg_ = 0;
 
-  ros::Time last_received_;
   ros::Time interval_;
 
-  bool is_connected_   = false;
   bool is_initialized_ = false;
+
+  // keeps the port open and publishes the state of the connection, declared last so that its threads stop first
+  serial_port::PortSupervisor port_supervisor_{&serial_port_};
 };
 
 //}
@@ -135,9 +157,23 @@ void NmeaParser::onInit() {
 
   nh_.param("uav_name", uav_name_, std::string("uav"));
   nh_.param("portname", portname_, std::string("/dev/ttyUSB0"));
+  nh_.param("device_vid", device_filter_.vid, std::string(""));
+  nh_.param("device_pid", device_filter_.pid, std::string(""));
+  nh_.param("device_serial", device_filter_.serial, std::string(""));
+  nh_.param("device_usb_path", device_filter_.usb_path, std::string(""));
   nh_.param("baudrate", baudrate_, 115200);
   nh_.param("serial_rate", serial_rate_, 500);
   nh_.param("serial_buffer_size", serial_buffer_size_, 1024);
+  nh_.param("use_reactor", use_reactor_, true);
+  nh_.param("use_shared_reactor", use_shared_reactor_, true);
+  nh_.param("use_hotplug", use_hotplug_, true);
+  nh_.param("reconnect_backoff_min_ms", reconnect_backoff_min_ms_, 100);
+  nh_.param("reconnect_backoff_max_ms", reconnect_backoff_max_ms_, 5000);
+  nh_.param("use_reader_thread", use_reader_thread_, false);
+  nh_.param("reader_ring_size", reader_ring_size_, 65536);
+  nh_.param("use_io_uring", use_io_uring_, false);
+  nh_.param("low_latency", low_latency_, true);
+  nh_.param("latency_timer_ms", latency_timer_ms_, 1);
 
   gpgga_pub_               = nh_.advertise<mrs_msgs::Gpgga>("gpgga_out", 1);
   gpgsa_pub_               = nh_.advertise<mrs_msgs::Gpgsa>("gpgsa_out", 1);
@@ -152,12 +188,52 @@ void NmeaParser::onInit() {
   // Output loaded parameters to console for double checking
   ROS_INFO_THROTTLE(1.0, "[%s] is up and running with the following parameters:", ros::this_node::getName().c_str());
   ROS_INFO_THROTTLE(1.0, "[%s] portname: %s", ros::this_node::getName().c_str(), portname_.c_str());
+  if (!device_filter_.empty()) {
+    ROS_INFO_THROTTLE(1.0, "[%s] device: %s", ros::this_node::getName().c_str(), device_filter_.toString().c_str());
+  }
   ROS_INFO_THROTTLE(1.0, "[%s] baudrate: %i", ros::this_node::getName().c_str(), baudrate_);
   ROS_INFO_STREAM_THROTTLE(1.0, "[" << ros::this_node::getName().c_str() << "] publishing messages with wrong checksum: " << publish_bad_checksum);
 
-  connectToSensor();
+  // the reactor delivers the data as soon as the port becomes readable, polling timer is only a fallback
+  if (use_reactor_) {
+    // one I/O thread for all nodelets of the manager, the data are read and handled in the callback queue of this nodelet
+    if (use_shared_reactor_) {
+      serial_reactor_.setCallbackQueue(&getMTCallbackQueue());
+      serial_reactor_.startShared();
+    } else {
+      serial_reactor_.start();
+    }
+  }
+
+  // drain the port from a dedicated thread, so that slow callbacks cannot overrun the kernel buffer
+  if (use_reader_thread_) {
+    serial_port_.enableReaderThread(reader_ring_size_);
+  }
+
+  // io_uring for the reads of the reader thread, poll() where the kernel does not have it
+  serial_port_.setIoUring(use_io_uring_);
+
+  // small frames would otherwise wait up to 16 ms in the buffer of an FTDI adapter
+  serial_port_.setLowLatency(low_latency_, latency_timer_ms_);
+
+  serial_port::PortSupervisor::Options port_options;
+  port_options.portname      = portname_;
+  port_options.device_filter = device_filter_;
+  port_options.baudrate      = baudrate_;
+  port_options.buffer_size   = serial_buffer_size_;
+  port_options.use_timeout   = use_timeout;
+  port_options.timeout       = MAXIMAL_TIME_INTERVAL;
+  port_options.backoff_min   = reconnect_backoff_min_ms_ * 1e-3;
+  port_options.backoff_max   = reconnect_backoff_max_ms_ * 1e-3;
+  port_options.use_hotplug   = use_hotplug_;
+
+  port_supervisor_.start(nh_, port_options, use_reactor_ ? &serial_reactor_ : nullptr,
+                         [this](const uint8_t *data, int len) { callbackSerialData(data, len); });
+
+  if (!use_reactor_) {
+    serial_timer_ = nh_.createTimer(ros::Rate(serial_rate_), &NmeaParser::callbackSerialTimer, this);
+  }
 
-  serial_timer_     = nh_.createTimer(ros::Rate(serial_rate_), &NmeaParser::callbackSerialTimer, this);
   maintainer_timer_ = nh_.createTimer(ros::Rate(1), &NmeaParser::callbackMaintainerTimer, this);
 
   is_initialized_ = true;
@@ -176,35 +252,37 @@ void NmeaParser::callbackSerialTimer(const ros::TimerEvent& event) {
 
   bytes_read = serial_port_.readSerial(read_buffer, serial_buffer_size_);
 
-  for (int i = 0; i < bytes_read; i++) {
-    interpretSerialData(read_buffer[i]);
+  if (bytes_read > 0) {
+    callbackSerialData(read_buffer, bytes_read);
   }
-  /* processMessage */
 }
 
 //}
 
-/* callbackMaintainerTimer() //{ */
+/* callbackSerialData() //{ */
 
-void NmeaParser::callbackMaintainerTimer(const ros::TimerEvent& event) {
+void NmeaParser::callbackSerialData(const uint8_t *data, int len) {
 
-  if (is_connected_) {
+  for (int i = 0; i < len; i++) {
 
-    if (!serial_port_.checkConnected()) {
-      is_connected_ = false;
-      ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial device is disconnected! ");
+    // the sentence ends with this byte, it arrived before the rest of the chunk
+    if (data[i] == '\n') {
+      sentence_stamp_ = serial_port_.getByteStamp(len - 1 - i);
     }
+
+    interpretSerialData(data[i]);
   }
+}
 
-  if (((ros::Time::now() - last_received_).toSec() > MAXIMAL_TIME_INTERVAL) && use_timeout && is_connected_) {
+//}
 
-    is_connected_ = false;
+/* callbackMaintainerTimer() //{ */
 
-    ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial port timed out - no messages were received in " << MAXIMAL_TIME_INTERVAL
-                         << " seconds");
-  }
+void NmeaParser::callbackMaintainerTimer(const ros::TimerEvent& event) {
 
-  if (is_connected_) {
+  port_supervisor_.checkConnection();
+
+  if (port_supervisor_.isConnected()) {
 
     ROS_INFO_STREAM("[" << ros::this_node::getName().c_str() << "] Got " << msg_counter_gpgga_ << " GPGGA, " << msg_counter_gpgsa_ << " GPGSA, "
                         << msg_counter_gpgst_ << " GPGST, " << msg_counter_gpvtg_ << " GPVTG messages in last " << (ros::Time::now() - interval_).toSec()
@@ -214,10 +292,6 @@ void NmeaParser::callbackMaintainerTimer(const ros::TimerEvent& event) {
     msg_counter_gpgst_ = 0;
     msg_counter_gpvtg_ = 0;
     interval_          = ros::Time::now();
-
-  } else {
-
-    connectToSensor();
   }
 }
 
@@ -250,7 +324,7 @@ void NmeaParser::interpretSerialData(uint8_t single_character) {
   }
 
 
-  last_received_ = ros::Time::now();
+  port_supervisor_.dataReceived(ros::Time::now());
 }
 
 //}
@@ -262,7 +336,7 @@ void NmeaParser::interpretSerialData(uint8_t single_character) {
 void NmeaParser::processMessage() {
 
   mrs_msgs::StringStamped string_raw_out;
-  string_raw_out.header.stamp = ros::Time::now();
+  string_raw_out.header.stamp = sentence_stamp_;
   string_raw_out.data         = msg_;
 
   try {
@@ -312,8 +386,8 @@ void NmeaParser::processGPGGA(std::vector<std::string>& results) {
   /* } */
 
 
-  gpgga_msg.header.stamp    = ros::Time::now();
-  bestpos_msg_.header.stamp = ros::Time::now();
+  gpgga_msg.header.stamp    = sentence_stamp_;
+  bestpos_msg_.header.stamp = sentence_stamp_;
 
   gpgga_msg.utc_seconds = stodSafe(results[1]);
 
@@ -441,7 +515,7 @@ void NmeaParser::processGPGGA(std::vector<std::string>& results) {
 void NmeaParser::processGPGSA(std::vector<std::string>& results) {
 
   mrs_msgs::Gpgsa gpgsa_msg;
-  gpgsa_msg.header.stamp = ros::Time::now();
+  gpgsa_msg.header.stamp = sentence_stamp_;
 
   gpgsa_msg.auto_manual_mode = results[2];
   gpgsa_msg.fix_mode         = stoiSafe(results[3]);
@@ -476,7 +550,7 @@ void NmeaParser::processGPGSA(std::vector<std::string>& results) {
 void NmeaParser::processGPGST(std::vector<std::string>& results) {
 
   mrs_msgs::Gpgst gpgst_msg;
-  gpgst_msg.header.stamp = ros::Time::now();
+  gpgst_msg.header.stamp = sentence_stamp_;
 
   /* for (size_t i = 0; i < results.size(); i++) { */
   /*   ROS_INFO_STREAM("[NmeaParser]:  " << i << "  " << results[i]); */
@@ -511,7 +585,7 @@ void NmeaParser::processGPGST(std::vector<std::string>& results) {
 void NmeaParser::processGPVTG(std::vector<std::string>& results) {
 
   mrs_msgs::Gpvtg gpvtg_msg;
-  gpvtg_msg.header.stamp = ros::Time::now();
+  gpvtg_msg.header.stamp = sentence_stamp_;
 
   /* for (size_t i = 0; i < results.size(); i++) { */
   /*   ROS_INFO_STREAM("[NmeaParser]:  " << i << "  " << results[i]); */
@@ -577,27 +651,6 @@ int NmeaParser::stoiSafe(std::string& string_in) {
 
 //}
 
-/* connectToSensors() //{ */
-
-uint8_t NmeaParser::connectToSensor(void) {
-
-  ROS_INFO_THROTTLE(1.0, "[%s]: Openning the serial port.", ros::this_node::getName().c_str());
-
-  if (!serial_port_.connect(portname_, baudrate_)) {
-    ROS_ERROR_THROTTLE(1.0, "[%s]: Could not connect to sensor.", ros::this_node::getName().c_str());
-    is_connected_ = false;
-    return 0;
-  }
-
-  ROS_INFO_THROTTLE(1.0, "[%s]: Connected to sensor.", ros::this_node::getName().c_str());
-  is_connected_  = true;
-  last_received_ = ros::Time::now();
-
-  return 1;
-}
-
-//}
-
 }  // namespace nmea_parser
 
 PLUGINLIB_EXPORT_CLASS(nmea_parser::NmeaParser, nodelet::Nodelet);
@@ -0,0 +1,282 @@
+#include "port_supervisor.h"
+
+#include <mrs_serial/ConnectionState.h>
+
+namespace serial_port {
+
+/* PortSupervisor() //{ */
+
+    PortSupervisor::PortSupervisor(SerialPort *port) : port_(port) {
+    }
+
+//}
+
+/* ~PortSupervisor() //{ */
+
+    PortSupervisor::~PortSupervisor() {
+        stop();
+    }
+
+//}
+
+/* start() //{ */
+
+    bool PortSupervisor::start(ros::NodeHandle &nh, const Options &options, SerialReactor *reactor, SerialReactor::DataCallback data_callback) {
+
+        options_ = options;
+        reactor_ = reactor;
+        data_callback_ = std::move(data_callback);
+
+        {
+            std::scoped_lock lock(mutex_portname_);
+            portname_ = options_.portname;
+        }
+
+        state_publisher_ = nh.advertise<mrs_serial::ConnectionState>("connection_state", 10, true);
+
+        // open() and tcsetattr() may block on a flaky adapter, the port is (re)opened by a worker thread with backoff instead of in the timers
+        connection_manager_.setBackoff(options_.backoff_min, options_.backoff_max);
+
+        if (!connection_manager_.start([this]() { return connect(); }, [this]() { disconnect(); },
+                                       [this](const ConnectionManager::StateChange &change) { publishState(change); })) {
+            return false;
+        }
+
+        // the maintainer timer only notices a removed device within a second
+        if (options_.use_hotplug) {
+            // a device looked up by its usb identity may come back under another name, any new node in /dev can be it
+            const std::string path = options_.device_filter.empty() ? options_.portname : std::string("/dev/");
+            hotplug_monitor_.start(path, [this](bool present) { callbackHotplug(present); });
+        }
+
+        return true;
+    }
+
+//}
+
+/* stop() //{ */
+
+    void PortSupervisor::stop() {
+
+        hotplug_monitor_.stop();
+        connection_manager_.stop();
+
+        if (reactor_) {
+            reactor_->removePort(port_);
+        }
+    }
+
+//}
+
+/* isConnected() //{ */
+
+    bool PortSupervisor::isConnected() const {
+        return connected_;
+    }
+
+//}
+
+/* getPortname() //{ */
+
+    std::string PortSupervisor::getPortname() const {
+        std::scoped_lock lock(mutex_portname_);
+        return portname_;
+    }
+
+//}
+
+/* dataReceived() //{ */
+
+    void PortSupervisor::dataReceived(const ros::Time &now) {
+        last_received_.store(now.toSec(), std::memory_order_relaxed);
+        connection_manager_.dataReceived();
+    }
+
+//}
+
+/* checkConnection() //{ */
+
+    void PortSupervisor::checkConnection() {
+
+        std::unique_lock lock(mutex_connection_, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            return;
+        }
+
+        if (port_->isReaderThreadEnabled() && connected_) {
+            const RxRingStats stats = port_->getRxRingStats();
+            ROS_INFO_STREAM_THROTTLE(10.0, "[" << ros::this_node::getName().c_str() << "] Rx ring: " << stats.used << "/" << stats.capacity << " B used, peak "
+                                               << stats.high_water << " B, dropped " << stats.dropped << " B");
+        }
+
+        if (connected_ && !port_->checkConnected()) {
+            connected_ = false;
+            ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial device is disconnected! ");
+            // the worker removes the port from the reactor before it closes it in disconnect()
+            connection_manager_.connectionLost("tcgetattr failed");
+        }
+
+        const double silent = ros::Time::now().toSec() - last_received_.load(std::memory_order_relaxed);
+
+        if (silent > options_.timeout && options_.use_timeout && connected_) {
+
+            connected_ = false;
+
+            ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial port timed out - no messages were received in " << options_.timeout
+                                 << " seconds");
+
+            connection_manager_.connectionStale("no data received");
+        }
+    }
+
+//}
+
+/* connectionLost() //{ */
+
+    void PortSupervisor::connectionLost(const std::string &reason) {
+        connected_ = false;
+        connection_manager_.connectionLost(reason);
+    }
+
+//}
+
+/* reconnectNow() //{ */
+
+    void PortSupervisor::reconnectNow() {
+        connection_manager_.reconnectNow();
+    }
+
+//}
+
+/* connect() //{ */
+
+    bool PortSupervisor::connect() {
+
+        std::scoped_lock lock(mutex_connection_);
+
+        ROS_INFO_THROTTLE(1.0, "[%s]: Openning the serial port.", ros::this_node::getName().c_str());
+
+        // stop reading from the old fd before it gets replaced
+        if (reactor_) {
+            reactor_->removePort(port_);
+        }
+
+        std::string portname = getPortname();
+
+        // /dev/ttyUSBx follows the enumeration order, the device is looked up by its usb identity on every (re)connect
+        if (!options_.device_filter.empty()) {
+
+            std::string error;
+            const std::string found = findUsbSerialDevice(options_.device_filter, error);
+
+            if (found.empty()) {
+                ROS_ERROR_THROTTLE(1.0, "[%s]: Could not find the sensor: %s", ros::this_node::getName().c_str(), error.c_str());
+                connected_ = false;
+                return false;
+            }
+
+            if (found != portname) {
+                ROS_INFO("[%s]: Found %s at %s.", ros::this_node::getName().c_str(), options_.device_filter.toString().c_str(), found.c_str());
+                std::scoped_lock lock_portname(mutex_portname_);
+                portname_ = found;
+                portname = found;
+            }
+        }
+
+        if (!port_->connect(portname, options_.baudrate)) {
+            ROS_ERROR_THROTTLE(1.0, "[%s]: Could not connect to sensor.", ros::this_node::getName().c_str());
+            connected_ = false;
+            return false;
+        }
+
+        ROS_INFO_THROTTLE(1.0, "[%s]: Connected to sensor.", ros::this_node::getName().c_str());
+        connected_ = true;
+        last_received_.store(ros::Time::now().toSec(), std::memory_order_relaxed);
+
+        if (reactor_) {
+            reactor_->addPort(port_, data_callback_, options_.buffer_size);
+        }
+
+        return true;
+    }
+
+//}
+
+/* disconnect() //{ */
+
+    void PortSupervisor::disconnect() {
+
+        std::scoped_lock lock(mutex_connection_);
+
+        connected_ = false;
+
+        if (reactor_) {
+            reactor_->removePort(port_);
+        }
+
+        port_->disconnect();
+    }
+
+//}
+
+/* callbackHotplug() //{ */
+
+    void PortSupervisor::callbackHotplug(bool present) {
+
+        const std::string portname = getPortname();
+
+        // every change in /dev is reported, the connected device is still there only while it is found under the same name
+        if (!options_.device_filter.empty() && connected_) {
+            std::string error;
+            present = findUsbSerialDevice(options_.device_filter, error) == portname;
+        }
+
+        if (!present && connected_) {
+
+            ROS_ERROR("[%s]: Serial device %s was removed.", ros::this_node::getName().c_str(), portname.c_str());
+
+            connectionLost("device removed");
+
+        } else if (present && !connected_) {
+
+            connection_manager_.reconnectNow();
+        }
+    }
+
+//}
+
+/* publishState() //{ */
+
+    void PortSupervisor::publishState(const ConnectionManager::StateChange &change) {
+
+        mrs_serial::ConnectionState msg;
+
+        msg.header.stamp    = ros::Time::now();
+        msg.state           = change.state;
+        msg.previous_state  = change.previous;
+        msg.reason          = change.reason;
+        msg.failed_attempts = change.failed_attempts;
+        msg.retry_in        = change.retry_in;
+        msg.portname        = getPortname();
+
+        // every attempt goes through opening, only the failures are worth a line
+        if (change.state == ConnectionManager::DISCONNECTED && change.failed_attempts > 0) {
+            ROS_WARN_THROTTLE(1.0, "[%s]: Opening %s failed %u times, next attempt in %.2f s.", ros::this_node::getName().c_str(), msg.portname.c_str(),
+                              change.failed_attempts, change.retry_in);
+        } else if (change.state != ConnectionManager::OPENING) {
+            ROS_INFO("[%s]: Serial port %s: %s -> %s%s%s", ros::this_node::getName().c_str(), msg.portname.c_str(),
+                     ConnectionManager::stateName(change.previous), ConnectionManager::stateName(change.state), change.reason.empty() ? "" : ", ",
+                     change.reason.c_str());
+        }
+
+        try {
+            state_publisher_.publish(msg);
+        }
+        catch (...) {
+            ROS_ERROR("[PortSupervisor]: exception caught during publishing topic %s", state_publisher_.getTopic().c_str());
+        }
+    }
+
+//}
+
+}  // namespace serial_port
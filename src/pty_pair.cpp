@@ -0,0 +1,147 @@
+#include "pty_pair.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace serial_port {
+
+/* PtyPair() //{ */
+
+    PtyPair::PtyPair() {
+    }
+
+//}
+
+/* ~PtyPair() //{ */
+
+    PtyPair::~PtyPair() {
+        close();
+    }
+
+//}
+
+/* open() //{ */
+
+    bool PtyPair::open(const std::string &link) {
+
+        close();
+
+        device_fd_ = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (device_fd_ == -1) {
+            return false;
+        }
+
+        char pts[128];
+        if (grantpt(device_fd_) != 0 || unlockpt(device_fd_) != 0 || ptsname_r(device_fd_, pts, sizeof(pts)) != 0) {
+            const int err = errno;
+            close();
+            errno = err;
+            return false;
+        }
+        pts_path_ = pts;
+
+        // without an open port side, the device side would read EIO and poll as hung up
+        hold_fd_ = ::open(pts, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+        if (hold_fd_ == -1) {
+            const int err = errno;
+            close();
+            errno = err;
+            return false;
+        }
+
+        // until a port configures it, the pty would echo the data of the device back to it
+        struct termios tio{};
+        if (tcgetattr(hold_fd_, &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(hold_fd_, TCSANOW, &tio);
+        }
+
+        if (!link.empty()) {
+
+            struct stat st;
+            if (lstat(link.c_str(), &st) == 0 && !S_ISLNK(st.st_mode)) {
+                close();
+                errno = EEXIST;
+                return false;
+            }
+
+            // renamed over the old link, a node watching the path sees the new one appear at once
+            const std::string tmp = link + ".tmp";
+            unlink(tmp.c_str());
+            if (symlink(pts, tmp.c_str()) != 0 || rename(tmp.c_str(), link.c_str()) != 0) {
+                const int err = errno;
+                unlink(tmp.c_str());
+                close();
+                errno = err;
+                return false;
+            }
+
+            link_ = link;
+        }
+
+        return true;
+    }
+
+//}
+
+/* close() //{ */
+
+    void PtyPair::close() {
+
+        if (!link_.empty()) {
+            unlink(link_.c_str());
+            link_.clear();
+        }
+
+        if (hold_fd_ != -1) {
+            ::close(hold_fd_);
+            hold_fd_ = -1;
+        }
+
+        if (device_fd_ != -1) {
+            ::close(device_fd_);
+            device_fd_ = -1;
+        }
+
+        pts_path_.clear();
+    }
+
+//}
+
+/* isOpen() //{ */
+
+    bool PtyPair::isOpen() const {
+        return device_fd_ != -1;
+    }
+
+//}
+
+/* getDeviceFd() //{ */
+
+    int PtyPair::getDeviceFd() const {
+        return device_fd_;
+    }
+
+//}
+
+/* getPortPath() //{ */
+
+    std::string PtyPair::getPortPath() const {
+        return link_.empty() ? pts_path_ : link_;
+    }
+
+//}
+
+/* getPtsPath() //{ */
+
+    std::string PtyPair::getPtsPath() const {
+        return pts_path_;
+    }
+
+//}
+
+}  // namespace serial_port
@@ -1,5 +1,58 @@
 #include "serial_port.h"
 
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <linux/serial.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "pty_pair.h"
+#include "uring_queue.h"
+
+// size of the chunks the reader thread reads from the fd
+#define READER_CHUNK_SIZE 4096
+
+// provided buffers of READER_CHUNK_SIZE for the multishot read
+#define RX_URING_BUFFERS 16
+#define RX_URING_BUFFER_GROUP 0
+
+// enough for the buffers given back after a wake up and the re-armed requests
+#define RX_URING_ENTRIES 32
+
+// frames submitted at once by sendFrames(), and their timeout
+#define TX_URING_ENTRIES 32
+
+// user data of the timeout and the cancel of the writes, which have their index in the chain
+#define URING_TX_TIMEOUT TX_URING_ENTRIES
+#define URING_TX_CANCEL (TX_URING_ENTRIES + 1)
+
+// user data of the io_uring requests of the reader thread
+#define URING_WAKEUP 1
+#define URING_POLL 2
+#define URING_READ 3
+#define URING_CANCEL 4
+#define URING_PROVIDE 5
+
+// applied baudrates further than this from the requested one are reported as errors
+#define MAX_BAUDRATE_ERROR 0.02
+
+// Linux termios2 interface for arbitrary baudrates, asm/termbits.h cannot be included together with termios.h
+#ifndef BOTHER
+#define BOTHER 0010000
+#endif
+
+struct termios2 {
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t c_line;
+    cc_t c_cc[19];
+    speed_t c_ispeed;
+    speed_t c_ospeed;
+};
+
 namespace serial_port {
 
 /* SerialPort() //{ */
@@ -13,6 +66,14 @@ namespace serial_port {
 
     SerialPort::~SerialPort() {
         disconnect();
+
+        if (reader_wakeup_fd_ != -1) {
+            close(reader_wakeup_fd_);
+        }
+
+        if (rx_notify_fd_ != -1) {
+            close(rx_notify_fd_);
+        }
     }
 
 //}
@@ -21,13 +82,15 @@ namespace serial_port {
 
     bool SerialPort::checkConnected() {
 
+        std::scoped_lock fd_lck(fd_mtx_);
+
         struct termios tmp_newtio{};
         int serial_status = tcgetattr(serial_port_fd_, &tmp_newtio);
 
+        // the port stays open, it may still be registered in the reactor, the caller disconnects it once it is removed there
         if (serial_status == -1) {
 
             ROS_ERROR("[%s] Serial port disconected!", ros::this_node::getName().c_str());
-            close(serial_port_fd_);
             return false;
         }
 
@@ -44,6 +107,10 @@ namespace serial_port {
         // O_RDWR - Read and write
         // O_NOCTTY - Ignore special chars like CTRL-C
 
+        stopReaderThread();
+
+        std::scoped_lock fd_lck(fd_mtx_);
+
         serial_port_fd_ = open(port.c_str(), O_RDWR | O_NOCTTY | O_NDELAY);
 
         if (serial_port_fd_ == -1) {
@@ -52,13 +119,16 @@ namespace serial_port {
             return false;
 
         } else {
-            fcntl(serial_port_fd_, F_SETFL, 0);
+            // non-blocking, so that a write stalled by a full tty buffer cannot hold fd_mtx_, writeFrame() waits for room with poll()
+            fcntl(serial_port_fd_, F_SETFL, O_NONBLOCK);
         }
 
         struct termios newtio{};
         bzero(&newtio, sizeof(newtio));  // clear struct for new port settings
 
-        uint16_t baudrate_set;
+        // rates without a Bxxx constant are set through termios2/BOTHER after the rest of the configuration
+        speed_t baudrate_set;
+        bool custom_baudrate = false;
         switch (baudrate) {
             case 9600: {
                 baudrate_set = B9600;
@@ -100,10 +170,31 @@ namespace serial_port {
                 baudrate_set = B921600;
                 break;
             }
+            case 1000000: {
+                baudrate_set = B1000000;
+                break;
+            }
+            case 1500000: {
+                baudrate_set = B1500000;
+                break;
+            }
+            case 2000000: {
+                baudrate_set = B2000000;
+                break;
+            }
+            case 3000000: {
+                baudrate_set = B3000000;
+                break;
+            }
             default:
-                baudrate_set = 0;
-                ROS_ERROR_STREAM("[SerialPort] Unsupported baudrate: " << baudrate);
-                return false;
+                if (baudrate <= 0) {
+                    ROS_ERROR_STREAM("[SerialPort] Unsupported baudrate: " << baudrate);
+                    close(serial_port_fd_);
+                    serial_port_fd_ = -1;
+                    return false;
+                }
+                baudrate_set = B38400;
+                custom_baudrate = true;
         }
 
         cfsetispeed(&newtio, baudrate_set);  // Input port speed
@@ -129,13 +220,317 @@ namespace serial_port {
         tcflush(serial_port_fd_, TCIFLUSH);
         tcsetattr(serial_port_fd_, TCSANOW, &newtio);
 
+        if (custom_baudrate && !setCustomBaudrate(baudrate)) {
+            ROS_ERROR_STREAM("[SerialPort] Could not set custom baudrate " << baudrate << " through termios2");
+            close(serial_port_fd_);
+            serial_port_fd_ = -1;
+            return false;
+        }
+
+        checkAppliedBaudrate(baudrate);
+
+        if (low_latency_) {
+            applyLowLatency(port);
+        }
+
+        byte_time_ = applied_baudrate_ > 0 ? 10.0 / applied_baudrate_ : 0.0;
+
         setBlocking(serial_port_fd_, 0);
 
+        {
+            std::scoped_lock lck(tx_uring_mtx_);
+            tx_uring_pending_ = use_io_uring_;
+        }
+
+        if (rx_ring_) {
+            startReaderThread();
+        }
+
+        return true;
+    }
+
+//}
+
+/* connectPty() //{ */
+
+    bool SerialPort::connectPty(PtyPair &pty, int baudrate) {
+
+        if (!pty.isOpen() && !pty.open()) {
+            ROS_ERROR("[SerialPort]: could not create a pseudo terminal: %s", strerror(errno));
+            return false;
+        }
+
+        // a pty does not pace the data by the baudrate, it still sets the byte time of the stamps
+        return connect(pty.getPortPath(), baudrate);
+    }
+
+//}
+
+/* setCustomBaudrate() //{ */
+
+    bool SerialPort::setCustomBaudrate(int baudrate) {
+
+        struct termios2 tio2{};
+
+        if (ioctl(serial_port_fd_, TCGETS2, &tio2) == -1) {
+            return false;
+        }
+
+        tio2.c_cflag &= ~CBAUD;
+        tio2.c_cflag |= BOTHER;
+        tio2.c_ispeed = baudrate;
+        tio2.c_ospeed = baudrate;
+
+        return ioctl(serial_port_fd_, TCSETS2, &tio2) != -1;
+    }
+
+//}
+
+/* checkAppliedBaudrate() //{ */
+
+    void SerialPort::checkAppliedBaudrate(int requested_baudrate) {
+
+        struct termios2 tio2{};
+
+        if (ioctl(serial_port_fd_, TCGETS2, &tio2) == -1) {
+            // the driver does not report the real rate, assume the requested one
+            applied_baudrate_ = requested_baudrate;
+            baudrate_error_ = 0.0;
+            return;
+        }
+
+        applied_baudrate_ = tio2.c_ospeed;
+        baudrate_error_ = (double(applied_baudrate_) - requested_baudrate) / requested_baudrate;
+
+        if (std::abs(baudrate_error_) > MAX_BAUDRATE_ERROR) {
+            ROS_ERROR("[SerialPort]: requested baudrate %d, the kernel applied %d (error %.2f %%)", requested_baudrate, applied_baudrate_,
+                      100.0 * baudrate_error_);
+        } else {
+            ROS_INFO("[SerialPort]: requested baudrate %d, the kernel applied %d (error %.2f %%)", requested_baudrate, applied_baudrate_,
+                     100.0 * baudrate_error_);
+        }
+    }
+
+//}
+
+/* getAppliedBaudrate() //{ */
+
+    int SerialPort::getAppliedBaudrate() const {
+        return applied_baudrate_;
+    }
+
+//}
+
+/* getBaudrateError() //{ */
+
+    double SerialPort::getBaudrateError() const {
+        return baudrate_error_;
+    }
+
+//}
+
+/* setLowLatency() //{ */
+
+    void SerialPort::setLowLatency(bool enable, int latency_timer_ms) {
+        low_latency_ = enable;
+        latency_timer_ms_ = latency_timer_ms;
+    }
+
+//}
+
+/* getLowLatencyState() //{ */
+
+    LowLatencyState SerialPort::getLowLatencyState() const {
+        std::scoped_lock lck(low_latency_mtx_);
+        return low_latency_state_;
+    }
+
+//}
+
+/* setIoUring() //{ */
+
+    void SerialPort::setIoUring(bool enable) {
+
+#ifndef HAVE_IO_URING
+        if (enable) {
+            ROS_WARN("[SerialPort]: built without io_uring, reading with poll() and writing with write()");
+        }
+        enable = false;
+#endif
+
+        use_io_uring_ = enable;
+    }
+
+//}
+
+/* getIoStats() //{ */
+
+    IoStats SerialPort::getIoStats() const {
+
+        IoStats stats;
+
+        stats.rx_io_uring = rx_uring_active_;
+        {
+            std::scoped_lock lck(tx_uring_mtx_);
+            stats.tx_io_uring = tx_uring_ != nullptr;
+        }
+
+        stats.rx_syscalls = rx_syscalls_;
+        stats.rx_bytes = rx_ring_ ? rx_ring_received_.load() : rx_bytes_.load();
+        stats.tx_syscalls = tx_syscalls_;
+        stats.tx_bytes = tx_bytes_;
+
+        return stats;
+    }
+
+//}
+
+#ifdef HAVE_IO_URING
+
+/* setupTxUring() //{ */
+
+    bool SerialPort::setupTxUring() {
+
+        auto uring = std::make_unique<UringQueue>();
+
+        // a linked write issued while the kernel flags the thread for completion work would fail with EINTR
+        if (!uring->init(TX_URING_ENTRIES, true)) {
+            ROS_WARN("[SerialPort]: io_uring is not available (%s), writing with write()", strerror(errno));
+            return false;
+        }
+
+        // since 5.6
+        if (!uring->supportsOp(URING_OP_WRITE)) {
+            ROS_WARN("[SerialPort]: the kernel has no io_uring writes, writing with write()");
+            return false;
+        }
+
+        tx_uring_ = std::move(uring);
+        tx_uring_owner_ = std::this_thread::get_id();
+
         return true;
     }
 
 //}
 
+#endif
+
+/* applyLowLatency() //{ */
+
+    void SerialPort::applyLowLatency(const std::string &port) {
+
+        LowLatencyState state;
+        state.requested = true;
+
+        // the tty layer then hands the received bytes to the reader directly instead of from a deferred work item
+        struct serial_struct serial{};
+        if (ioctl(serial_port_fd_, TIOCGSERIAL, &serial) == 0) {
+
+            serial.flags |= ASYNC_LOW_LATENCY;
+            if (ioctl(serial_port_fd_, TIOCSSERIAL, &serial) == -1) {
+                state.error = std::string("TIOCSSERIAL: ") + strerror(errno);
+            }
+
+            if (ioctl(serial_port_fd_, TIOCGSERIAL, &serial) == 0) {
+                state.async_low_latency_supported = true;
+                state.async_low_latency = serial.flags & ASYNC_LOW_LATENCY;
+            }
+        }
+
+        // FTDI adapters hold back the received bytes until their buffer fills or the latency timer expires,
+        // the attribute lives on the usb-serial device behind the tty, e.g. a /dev/serial/by-id link
+        char resolved[PATH_MAX];
+        if (realpath(port.c_str(), resolved) != nullptr) {
+
+            const std::string device = resolved;
+            const std::string path = "/sys/class/tty/" + device.substr(device.rfind('/') + 1) + "/device/latency_timer";
+
+            // writing usually needs root or a udev rule, the current value can still be reported without it
+            const int fd = open(path.c_str(), O_RDWR);
+            const int open_errno = errno;
+            const int read_fd = fd != -1 ? fd : open(path.c_str(), O_RDONLY);
+
+            if (read_fd != -1) {
+
+                state.latency_timer_path = path;
+
+                if (fd == -1) {
+                    state.error += std::string(state.error.empty() ? "" : ", ") + "latency_timer: " + strerror(open_errno);
+                } else {
+                    const std::string value = std::to_string(latency_timer_ms_);
+                    if (write(fd, value.c_str(), value.size()) == -1) {
+                        state.error += std::string(state.error.empty() ? "" : ", ") + "latency_timer: " + strerror(errno);
+                    }
+                }
+
+                char buffer[16] = {};
+                if (pread(read_fd, buffer, sizeof(buffer) - 1, 0) > 0) {
+                    state.latency_timer = atoi(buffer);
+                }
+
+                close(read_fd);
+            }
+        }
+
+        if (!state.error.empty() || (state.latency_timer_path.size() > 0 && state.latency_timer != latency_timer_ms_)) {
+            ROS_WARN("[SerialPort]: low latency mode only partly applied on %s: ASYNC_LOW_LATENCY %s, latency_timer %d ms (%s)", port.c_str(),
+                     state.async_low_latency ? "on" : "off", state.latency_timer, state.error.c_str());
+        } else {
+            const std::string latency_timer = state.latency_timer >= 0 ? std::to_string(state.latency_timer) + " ms" : "not present";
+            ROS_INFO("[SerialPort]: low latency mode on %s: ASYNC_LOW_LATENCY %s, latency_timer %s", port.c_str(),
+                     state.async_low_latency_supported ? (state.async_low_latency ? "on" : "off") : "not supported", latency_timer.c_str());
+        }
+
+        std::scoped_lock lck(low_latency_mtx_);
+        low_latency_state_ = state;
+    }
+
+//}
+
+/* getUartCounters() //{ */
+
+    UartCounters SerialPort::getUartCounters() const {
+
+        UartCounters counters;
+
+        std::scoped_lock fd_lck(fd_mtx_);
+
+        struct serial_icounter_struct icount{};
+        if (serial_port_fd_ < 0 || ioctl(serial_port_fd_, TIOCGICOUNT, &icount) == -1) {
+            return counters;
+        }
+
+        // the kernel counters are 32-bit ints
+        counters.supported   = true;
+        counters.rx          = uint32_t(icount.rx);
+        counters.tx          = uint32_t(icount.tx);
+        counters.frame       = uint32_t(icount.frame);
+        counters.overrun     = uint32_t(icount.overrun);
+        counters.parity      = uint32_t(icount.parity);
+        counters.brk         = uint32_t(icount.brk);
+        counters.buf_overrun = uint32_t(icount.buf_overrun);
+
+        return counters;
+    }
+
+//}
+
+/* getOutputQueueBytes() //{ */
+
+    int SerialPort::getOutputQueueBytes() const {
+
+        std::scoped_lock fd_lck(fd_mtx_);
+
+        int bytes = 0;
+        if (ioctl(serial_port_fd_, TIOCOUTQ, &bytes) == -1) {
+            return -1;
+        }
+
+        return bytes;
+    }
+
+//}
+
 /* setBlocking //{ */
 
     void SerialPort::setBlocking(int fd, int should_block) {
@@ -159,8 +554,20 @@ namespace serial_port {
 
     void SerialPort::disconnect() {
 
+        stopReaderThread();
+
+        // waits for a write in progress, the writers find the fd closed from then on instead of writing to whatever reuses its number
+        std::scoped_lock fd_lck(fd_mtx_);
+
+        {
+            std::scoped_lock lck(tx_uring_mtx_);
+            tx_uring_.reset();
+            tx_uring_pending_ = false;
+        }
+
         try {
             close(serial_port_fd_);
+            serial_port_fd_ = -1;
         }
         catch (int e) {
             ROS_WARN_THROTTLE(1.0, "Error while closing the sensor serial line!");
@@ -172,7 +579,10 @@ namespace serial_port {
 /* sendChar() //{ */
 
     bool SerialPort::sendChar(const char c) {
+        std::scoped_lock fd_lck(fd_mtx_);
         try {
+            tx_syscalls_.fetch_add(1, std::memory_order_relaxed);
+            tx_bytes_.fetch_add(1, std::memory_order_relaxed);
             return write(serial_port_fd_, (const void *) &c, 1);
         }
         catch (int e) {
@@ -186,9 +596,12 @@ namespace serial_port {
 /* sendCharArray() //{ */
 
     bool SerialPort::sendCharArray(uint8_t *buffer, int len) {
+        std::scoped_lock fd_lck(fd_mtx_);
         try {
             bool ret_val = write(serial_port_fd_, buffer, len);
             tcflush(serial_port_fd_, TCOFLUSH);
+            tx_syscalls_.fetch_add(2, std::memory_order_relaxed);
+            tx_bytes_.fetch_add(len, std::memory_order_relaxed);
             return ret_val;
         }
         catch (int e) {
@@ -199,18 +612,725 @@ namespace serial_port {
 
 //}
 
+/* sendFrame() //{ */
+
+    bool SerialPort::sendFrame(const uint8_t *buffer, int len) {
+        std::scoped_lock fd_lck(fd_mtx_);
+        return writeFrame(buffer, len);
+    }
+
+//}
+
+/* writeFrame() //{ */
+
+    bool SerialPort::writeFrame(const uint8_t *buffer, int len) {
+
+        int written = 0;
+
+        while (written < len) {
+
+            const int ret = write(serial_port_fd_, buffer + written, len - written);
+            tx_syscalls_.fetch_add(1, std::memory_order_relaxed);
+
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                // the fd is non-blocking, wait for the tty buffer to make room instead of spinning with fd_mtx_ held,
+                // the tty wakes the writers once 256 B are free, sending them and the rest of the frame takes this long
+                if (errno == EAGAIN) {
+                    const int timeout_ms = int(std::ceil((len - written + 256) * byte_time_ * 1e3)) + 1;
+
+                    struct pollfd pfd{serial_port_fd_, POLLOUT, 0};
+                    int res;
+                    do {
+                        res = poll(&pfd, 1, timeout_ms);
+                    } while (res < 0 && errno == EINTR);
+
+                    if (res > 0 && !(pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+                        continue;
+                    }
+
+                    ROS_WARN_THROTTLE(1.0, "[SerialPort]: the serial line did not take the frame within %d ms, %d of %d B written", timeout_ms, written, len);
+                    tx_bytes_.fetch_add(written, std::memory_order_relaxed);
+                    return false;
+                }
+
+                ROS_WARN_THROTTLE(1.0, "Error while writing to serial line!");
+                return false;
+            }
+
+            written += ret;
+        }
+
+        tx_bytes_.fetch_add(len, std::memory_order_relaxed);
+
+        return true;
+    }
+
+//}
+
+/* sendFrames() //{ */
+
+    int SerialPort::sendFrames(const struct iovec *frames, int count) {
+
+        std::scoped_lock fd_lck(fd_mtx_);
+
+#ifdef HAVE_IO_URING
+        {
+            std::scoped_lock lck(tx_uring_mtx_);
+
+            // only the thread that set the ring up may submit to it
+            if (tx_uring_pending_) {
+                tx_uring_pending_ = false;
+                setupTxUring();
+            }
+
+            if (tx_uring_ && tx_uring_owner_ == std::this_thread::get_id()) {
+                return sendFramesUring(frames, count);
+            }
+        }
+#endif
+
+        // the frames behind a failed one are not written, the line would hold each of them for the write timeout
+        for (int i = 0; i < count; i++) {
+            if (!writeFrame((const uint8_t *)frames[i].iov_base, frames[i].iov_len)) {
+                return i;
+            }
+        }
+
+        return count;
+    }
+
+//}
+
+#ifdef HAVE_IO_URING
+
+/* sendFramesUring() //{ */
+
+    int SerialPort::sendFramesUring(const struct iovec *frames, int count) {
+
+        // the frame to continue with and how much of it is out already
+        int next = 0;
+        size_t offset = 0;
+
+        while (next < count) {
+
+            const int batch = std::min(count - next, TX_URING_ENTRIES - 1);
+            size_t chain_bytes = 0;
+
+            // linked, a write starts only after the previous one completed in full, a short or failed one cancels the rest
+            for (int i = 0; i < batch; i++) {
+                const struct iovec &frame = frames[next + i];
+                const size_t skip = i == 0 ? offset : 0;
+                struct io_uring_sqe *sqe = tx_uring_->getSqe();
+                sqe->opcode = URING_OP_WRITE;
+                sqe->fd = serial_port_fd_;
+                sqe->addr = (uint64_t)frame.iov_base + skip;
+                sqe->len = frame.iov_len - skip;
+                sqe->off = (uint64_t)-1;
+                sqe->user_data = i;
+                sqe->flags = i + 1 < batch ? IOSQE_IO_LINK : 0;
+                chain_bytes += frame.iov_len - skip;
+            }
+
+            // a full tty buffer makes the kernel wait for room, as writeFrame() does the chain waits only as long as the tty
+            // takes to free 256 B (when it wakes the writers) and to send the chain, the timeout completes early with the writes
+            const double timeout = (chain_bytes + 256) * byte_time_ + 0.001;
+            const UringTimespec timeout_ts{int64_t(timeout), (long long)((timeout - int64_t(timeout)) * 1e9)};
+
+            struct io_uring_sqe *sqe = tx_uring_->getSqe();
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->fd = -1;
+            sqe->addr = (uint64_t)&timeout_ts;
+            sqe->len = 1;
+            sqe->off = batch;
+            sqe->user_data = URING_TX_TIMEOUT;
+
+            int results[TX_URING_ENTRIES];
+            int expected = batch + 1;
+            int completed = 0;
+            int writes_completed = 0;
+            bool timed_out = false;
+
+            while (completed < expected) {
+
+                const int ret = tx_uring_->submit(expected - completed);
+                tx_syscalls_.fetch_add(1, std::memory_order_relaxed);
+
+                if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    // closing the ring cancels what is still in flight, the port writes without it from now on
+                    ROS_ERROR("[SerialPort]: io_uring_enter failed: %s, writing without io_uring", strerror(errno));
+                    tx_uring_.reset();
+                    for (int i = next; i < count; i++) {
+                        const size_t skip = i == next ? offset : 0;
+                        if (!writeFrame((const uint8_t *)frames[i].iov_base + skip, frames[i].iov_len - skip)) {
+                            return i;
+                        }
+                    }
+                    return count;
+                }
+
+                completed += tx_uring_->reap([&](const struct io_uring_cqe &cqe) {
+                    if (cqe.user_data < URING_TX_TIMEOUT) {
+                        results[cqe.user_data] = cqe.res;
+                        writes_completed++;
+                    } else if (cqe.user_data == URING_TX_TIMEOUT && cqe.res == -ETIME) {
+                        timed_out = true;
+                    }
+                });
+
+                // the writes complete in the order of the chain, cancelling the one in progress cancels the ones linked to it
+                if (timed_out && writes_completed < batch && expected == batch + 1) {
+                    sqe = tx_uring_->getSqe();
+                    sqe->opcode = URING_OP_ASYNC_CANCEL;
+                    sqe->fd = -1;
+                    sqe->addr = writes_completed;
+                    sqe->user_data = URING_TX_CANCEL;
+                    expected++;
+                }
+            }
+
+            const int first = next;
+            const size_t first_offset = offset;
+
+            for (int i = 0; i < batch; i++) {
+
+                const size_t len = frames[next].iov_len - offset;
+                const int res = results[i];
+
+                if (res >= 0) {
+                    tx_bytes_.fetch_add(res, std::memory_order_relaxed);
+                }
+
+                if (res == int(len)) {
+                    next++;
+                    offset = 0;
+                    continue;
+                }
+
+                // a full tty buffer or a signal broke the chain, the rest is submitted again
+                if (res > 0) {
+                    offset += res;
+                    break;
+                }
+
+                if (res == 0 || res == -EAGAIN || res == -EINTR || res == -ECANCELED) {
+                    break;
+                }
+
+                // the rest of the chain has been cancelled, the frames behind it are not written either
+                ROS_WARN_THROTTLE(1.0, "[SerialPort]: io_uring write failed: %s", strerror(-res));
+                return next;
+            }
+
+            if (timed_out && next == first && offset == first_offset) {
+                ROS_WARN_THROTTLE(1.0, "[SerialPort]: the serial line did not take the frame within %.0f ms", timeout * 1e3);
+                return next;
+            }
+
+            // nothing went out, writeFrame() waits for room in the tty buffer instead of spinning on the ring
+            if (next == first && offset == first_offset) {
+                if (!writeFrame((const uint8_t *)frames[next].iov_base + offset, frames[next].iov_len - offset)) {
+                    return next;
+                }
+                next++;
+                offset = 0;
+            }
+        }
+
+        return count;
+    }
+
+//}
+
+#endif
+
 /* readSerial() //{ */
     int SerialPort::readSerial(uint8_t *arr, int arr_max_size) {
-        return read(serial_port_fd_, arr, arr_max_size);
+
+        if (rx_ring_) {
+            // reset the notification before popping, so that no push can be missed
+            uint64_t tmp;
+            if (read(rx_notify_fd_, &tmp, sizeof(tmp)) < 0 && errno != EAGAIN) {
+                ROS_WARN_THROTTLE(1.0, "[SerialPort]: failed to read the rx ring notification");
+            }
+            rx_syscalls_.fetch_add(1, std::memory_order_relaxed);
+            const int bytes_popped = rx_ring_->pop(arr, arr_max_size);
+
+            // marks of the chunks holding the popped bytes, the bytes of a dropped mark are covered by the next one
+            rx_popped_ += bytes_popped;
+            rx_chunk_marks_.clear();
+            if (rx_mark_.end > rx_popped_ - bytes_popped) {
+                rx_chunk_marks_.push_back(rx_mark_);
+            }
+            while (rx_mark_.end < rx_popped_ && rx_marks_->pop(&rx_mark_, 1) == 1) {
+                rx_chunk_marks_.push_back(rx_mark_);
+            }
+
+            // the reader thread has not pushed the mark of the last chunk yet
+            if (rx_mark_.end < rx_popped_) {
+                rx_chunk_marks_.push_back(RxChunkMark{rx_popped_, ros::Time::now()});
+            }
+
+            return bytes_popped;
+        }
+
+        int bytes_read;
+        {
+            // disconnect() closes the fd under fd_mtx_, a read must not reach whatever reuses its number
+            std::scoped_lock fd_lck(fd_mtx_);
+            bytes_read = read(serial_port_fd_, arr, arr_max_size);
+        }
+        if (bytes_read < 0 && errno == EAGAIN) {
+            bytes_read = 0;
+        }
+        rx_syscalls_.fetch_add(1, std::memory_order_relaxed);
+
+        if (bytes_read > 0) {
+            last_read_stamp_ = ros::Time::now();
+            rx_bytes_.fetch_add(bytes_read, std::memory_order_relaxed);
+        }
+
+        return bytes_read;
+    }
+
+//}
+
+/* getByteStamp() //{ */
+
+    ros::Time SerialPort::getByteStamp(size_t bytes_after) const {
+
+        if (!rx_ring_) {
+            return last_read_stamp_ - ros::Duration(bytes_after * byte_time_);
+        }
+
+        // the chunk the reader thread read the byte in
+        const uint64_t position = rx_popped_ - bytes_after;
+        for (const RxChunkMark &mark : rx_chunk_marks_) {
+            if (mark.end >= position) {
+                return mark.stamp - ros::Duration((mark.end - position) * byte_time_);
+            }
+        }
+
+        return ros::Time::now();
+    }
+
+//}
+
+/* getByteTime() //{ */
+
+    double SerialPort::getByteTime() const {
+        return byte_time_;
     }
 
 //}
 
 /* readChar() //{ */
     bool SerialPort::readChar(uint8_t *c) {
-        return read(serial_port_fd_, c, 1);
+
+        if (rx_ring_) {
+            return readSerial(c, 1) == 1;
+        }
+
+        std::scoped_lock fd_lck(fd_mtx_);
+        return read(serial_port_fd_, c, 1) == 1;
+    }
+
+//}
+
+/* enableReaderThread() //{ */
+
+    bool SerialPort::enableReaderThread(size_t ring_size) {
+
+        if (rx_ring_) {
+            return true;
+        }
+
+        reader_wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        rx_notify_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if (reader_wakeup_fd_ == -1 || rx_notify_fd_ == -1) {
+            ROS_ERROR("[SerialPort]: could not create the reader thread eventfds: %s", strerror(errno));
+            return false;
+        }
+
+        rx_ring_ = std::make_unique<SpscRing<uint8_t>>(ring_size);
+        rx_marks_ = std::make_unique<SpscRing<RxChunkMark>>(std::max(ring_size / 16, size_t(256)));
+
+        return true;
+    }
+
+//}
+
+/* isReaderThreadEnabled() //{ */
+
+    bool SerialPort::isReaderThreadEnabled() const {
+        return rx_ring_ != nullptr;
+    }
+
+//}
+
+/* getRxRingStats() //{ */
+
+    RxRingStats SerialPort::getRxRingStats() const {
+
+        RxRingStats stats;
+
+        if (rx_ring_) {
+            stats.capacity = rx_ring_->capacity();
+            stats.used = rx_ring_->size();
+            stats.high_water = rx_ring_high_water_;
+            stats.received = rx_ring_received_;
+            stats.dropped = rx_ring_dropped_;
+        }
+
+        return stats;
+    }
+
+//}
+
+/* getReadableFd() //{ */
+
+    int SerialPort::getReadableFd() const {
+        return rx_ring_ ? rx_notify_fd_ : serial_port_fd_;
+    }
+
+//}
+
+/* startReaderThread() //{ */
+
+    void SerialPort::startReaderThread() {
+
+        stopReaderThread();
+
+#ifdef HAVE_IO_URING
+        if (use_io_uring_ && setupRxUring(serial_port_fd_)) {
+            rx_uring_active_ = true;
+            reader_running_ = true;
+            reader_thread_ = std::thread(&SerialPort::readerLoopUring, this, serial_port_fd_);
+            return;
+        }
+#endif
+
+        reader_running_ = true;
+        reader_thread_ = std::thread(&SerialPort::readerLoop, this, serial_port_fd_);
+    }
+
+//}
+
+/* stopReaderThread() //{ */
+
+    void SerialPort::stopReaderThread() {
+
+        if (!reader_thread_.joinable()) {
+            return;
+        }
+
+        reader_running_ = false;
+
+        uint64_t one = 1;
+        if (write(reader_wakeup_fd_, &one, sizeof(one)) != sizeof(one)) {
+            ROS_WARN("[SerialPort]: failed to wake up the reader thread");
+        }
+
+        reader_thread_.join();
+
+        // the reader thread has cancelled its requests
+        rx_uring_.reset();
+        rx_uring_active_ = false;
+
+        uint64_t tmp;
+        while (read(reader_wakeup_fd_, &tmp, sizeof(tmp)) > 0) {
+        }
+    }
+
+//}
+
+/* readerLoop() //{ */
+
+    void SerialPort::readerLoop(int fd) {
+
+        uint8_t chunk[READER_CHUNK_SIZE];
+
+        struct pollfd fds[2];
+        fds[0].fd = fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = reader_wakeup_fd_;
+        fds[1].events = POLLIN;
+
+        while (reader_running_) {
+
+            rx_syscalls_.fetch_add(1, std::memory_order_relaxed);
+            if (poll(fds, 2, -1) == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ROS_ERROR("[SerialPort]: reader thread poll failed: %s", strerror(errno));
+                break;
+            }
+
+            if (fds[1].revents & POLLIN) {
+                break;
+            }
+
+            if (fds[0].revents & POLLIN) {
+
+                const int bytes_read = read(fd, chunk, READER_CHUNK_SIZE);
+                rx_syscalls_.fetch_add(1, std::memory_order_relaxed);
+
+                if (bytes_read > 0) {
+                    pushChunk(chunk, bytes_read, ros::Time::now());
+                    notifyRxRing();
+                }
+            }
+
+            if (fds[0].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+                // the maintainer notices the dead port through checkConnected() and reconnects
+                ROS_ERROR("[SerialPort]: reader thread lost the serial port");
+                break;
+            }
+        }
+    }
+
+//}
+
+/* pushChunk() //{ */
+
+    void SerialPort::pushChunk(const uint8_t *data, int len, const ros::Time &stamp) {
+
+        const size_t pushed = rx_ring_->push(data, len);
+
+        rx_pushed_ += pushed;
+        const RxChunkMark mark{rx_pushed_, stamp};
+        rx_marks_->push(&mark, 1);
+
+        rx_ring_received_ += len;
+        if (pushed < size_t(len)) {
+            rx_ring_dropped_ += len - pushed;
+        }
+
+        const size_t used = rx_ring_->size();
+        if (used > rx_ring_high_water_) {
+            rx_ring_high_water_ = used;
+        }
+    }
+
+//}
+
+/* notifyRxRing() //{ */
+
+    void SerialPort::notifyRxRing() {
+
+        uint64_t one = 1;
+        if (write(rx_notify_fd_, &one, sizeof(one)) != sizeof(one)) {
+            ROS_WARN_THROTTLE(1.0, "[SerialPort]: failed to notify about received data");
+        }
+        rx_syscalls_.fetch_add(1, std::memory_order_relaxed);
     }
 
 //}
 
+#ifdef HAVE_IO_URING
+
+/* setupRxUring() //{ */
+
+    bool SerialPort::setupRxUring(int fd) {
+
+        auto uring = std::make_unique<UringQueue>();
+
+        if (!uring->init(RX_URING_ENTRIES)) {
+            ROS_WARN("[SerialPort]: io_uring is not available (%s), reading with poll()", strerror(errno));
+            return false;
+        }
+
+        rx_uring_buffers_.resize(RX_URING_BUFFERS * READER_CHUNK_SIZE);
+
+        // multishot reads since 6.7
+        rx_uring_multishot_ = uring->supportsOp(URING_OP_READ_MULTISHOT) && uring->supportsOp(URING_OP_PROVIDE_BUFFERS);
+
+        if (!rx_uring_multishot_) {
+
+            const struct iovec iov{rx_uring_buffers_.data(), READER_CHUNK_SIZE};
+
+            if (!uring->registerBuffers(&iov, 1)) {
+                ROS_WARN("[SerialPort]: could not register the io_uring read buffer (%s), reading with poll()", strerror(errno));
+                return false;
+            }
+        }
+
+        // with VMIN 0 an empty tty reads as end of file, which would end the multishot read, the reads happen only when it is readable anyway
+        setBlocking(fd, 1);
+
+        ROS_INFO("[SerialPort]: reading through io_uring with %s", rx_uring_multishot_ ? "a multishot read" : "poll linked to a fixed buffer read");
+
+        rx_uring_ = std::move(uring);
+
+        if (rx_uring_multishot_) {
+            provideRxBuffers(0, RX_URING_BUFFERS);
+        }
+
+        return true;
+    }
+
+//}
+
+/* provideRxBuffers() //{ */
+
+    void SerialPort::provideRxBuffers(uint16_t first, uint16_t count) {
+
+        struct io_uring_sqe *sqe = rx_uring_->getSqe();
+        sqe->opcode = URING_OP_PROVIDE_BUFFERS;
+        sqe->fd = count;
+        sqe->addr = (uint64_t)(rx_uring_buffers_.data() + size_t(first) * READER_CHUNK_SIZE);
+        sqe->len = READER_CHUNK_SIZE;
+        sqe->off = first;
+        sqe->buf_index = RX_URING_BUFFER_GROUP;  // buf_group of newer headers
+        sqe->user_data = URING_PROVIDE;
+    }
+
+//}
+
+/* readerLoopUring() //{ */
+
+    void SerialPort::readerLoopUring(int fd) {
+
+        UringQueue &uring = *rx_uring_;
+
+        bool wakeup_armed = false;
+        bool read_armed = false;
+        bool lost = false;
+
+        while (reader_running_ && !lost) {
+
+            if (!wakeup_armed) {
+                struct io_uring_sqe *sqe = uring.getSqe();
+                sqe->opcode = IORING_OP_POLL_ADD;
+                sqe->fd = reader_wakeup_fd_;
+                setUringPollEvents(sqe, POLLIN);
+                sqe->user_data = URING_WAKEUP;
+                wakeup_armed = true;
+            }
+
+            if (!read_armed) {
+
+                if (rx_uring_multishot_) {
+                    // completes once for every chunk until it fails or it runs out of provided buffers
+                    struct io_uring_sqe *sqe = uring.getSqe();
+                    sqe->opcode = URING_OP_READ_MULTISHOT;
+                    sqe->fd = fd;
+                    sqe->flags = URING_SQE_BUFFER_SELECT;
+                    sqe->buf_index = RX_URING_BUFFER_GROUP;  // buf_group of newer headers
+                    sqe->user_data = URING_READ;
+                } else {
+                    // the read is issued by the kernel as soon as the poll completes, one system call per wake up
+                    struct io_uring_sqe *sqe = uring.getSqe();
+                    sqe->opcode = IORING_OP_POLL_ADD;
+                    sqe->fd = fd;
+                    setUringPollEvents(sqe, POLLIN);
+                    sqe->flags = IOSQE_IO_LINK;
+                    sqe->user_data = URING_POLL;
+
+                    sqe = uring.getSqe();
+                    sqe->opcode = IORING_OP_READ_FIXED;
+                    sqe->fd = fd;
+                    sqe->addr = (uint64_t)rx_uring_buffers_.data();
+                    sqe->len = READER_CHUNK_SIZE;
+                    sqe->off = (uint64_t)-1;
+                    sqe->buf_index = 0;
+                    sqe->user_data = URING_READ;
+                }
+
+                read_armed = true;
+            }
+
+            rx_syscalls_.fetch_add(1, std::memory_order_relaxed);
+            if (uring.submit(1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                ROS_ERROR("[SerialPort]: reader thread io_uring_enter failed: %s", strerror(errno));
+                break;
+            }
+
+            // all chunks of the wake up are pushed with one stamp and announced with one notification
+            const ros::Time stamp = ros::Time::now();
+            bool pushed = false;
+
+            uring.reap([&](const struct io_uring_cqe &cqe) {
+                switch (cqe.user_data) {
+
+                    case URING_WAKEUP: {
+                        wakeup_armed = false;
+                        break;
+                    }
+
+                    case URING_PROVIDE: {
+                        if (cqe.res < 0) {
+                            ROS_WARN_THROTTLE(1.0, "[SerialPort]: could not provide the io_uring read buffers: %s", strerror(-cqe.res));
+                        }
+                        break;
+                    }
+
+                    case URING_READ: {
+
+                        if (!(cqe.flags & URING_CQE_F_MORE)) {
+                            read_armed = false;
+                        }
+
+                        if (cqe.res > 0) {
+
+                            if (rx_uring_multishot_) {
+                                const uint16_t id = cqe.flags >> URING_CQE_BUFFER_SHIFT;
+                                pushChunk(rx_uring_buffers_.data() + size_t(id) * READER_CHUNK_SIZE, cqe.res, stamp);
+                                provideRxBuffers(id, 1);
+                            } else {
+                                pushChunk(rx_uring_buffers_.data(), cqe.res, stamp);
+                            }
+
+                            pushed = true;
+
+                        } else if (cqe.res == 0 || (cqe.res != -EAGAIN && cqe.res != -EINTR && cqe.res != -ENOBUFS && cqe.res != -ECANCELED)) {
+                            // end of file of a hung up tty or an error, the maintainer notices the dead port through checkConnected() and reconnects
+                            lost = true;
+                        }
+
+                        break;
+                    }
+                }
+            });
+
+            if (pushed) {
+                notifyRxRing();
+            }
+        }
+
+        if (lost) {
+            ROS_ERROR("[SerialPort]: reader thread lost the serial port");
+        }
+
+        // the kernel must not write into the buffers anymore once the thread is gone
+        if (read_armed) {
+
+            struct io_uring_sqe *sqe = uring.getSqe();
+            sqe->opcode = URING_OP_ASYNC_CANCEL;
+            // cancelling the poll cancels the read linked to it
+            sqe->addr = rx_uring_multishot_ ? URING_READ : URING_POLL;
+            sqe->user_data = URING_CANCEL;
+
+            while (read_armed) {
+                if (uring.submit(1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    break;
+                }
+                uring.reap([&](const struct io_uring_cqe &cqe) {
+                    if (cqe.user_data == URING_READ && !(cqe.flags & URING_CQE_F_MORE)) {
+                        read_armed = false;
+                    }
+                });
+            }
+        }
+    }
+
+//}
+
+#endif
+
 }  // namespace serial_port
@@ -0,0 +1,485 @@
+#include "serial_reactor.h"
+
+#include <boost/make_shared.hpp>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define MAX_EPOLL_EVENTS 16
+
+// epoll user data of the internal eventfd used to wake up the loop
+#define WAKEUP_ID 0
+
+namespace serial_port {
+
+/* class SerialReactor::ReadCallback //{ */
+
+    // queued for a readable port, the port stays alive until the callback is called or dropped with the queue
+    class SerialReactor::ReadCallback : public ros::CallbackInterface {
+    public:
+        ReadCallback(SerialReactor *reactor, std::shared_ptr<Port> port) : reactor_(reactor), port_(std::move(port)) {
+        }
+
+        CallResult call() override {
+
+            // a removed port may belong to a reactor that does not exist anymore, its destructor waits for busy
+            std::scoped_lock busy(port_->busy);
+
+            if (!port_->removed) {
+                reactor_->drainQueued(port_);
+            }
+
+            return Success;
+        }
+
+    private:
+        SerialReactor *reactor_;
+        std::shared_ptr<Port> port_;
+    };
+
+//}
+
+/* SerialReactor() //{ */
+
+    SerialReactor::SerialReactor() {
+    }
+
+//}
+
+/* ~SerialReactor() //{ */
+
+    SerialReactor::~SerialReactor() {
+
+        stop();
+
+        // the callbacks still waiting in the queues must not touch the reactor anymore
+        std::vector<std::shared_ptr<Port>> ports;
+        {
+            std::scoped_lock lck(mtx_);
+            for (auto &[id, p] : ports_) {
+                ports.push_back(p);
+            }
+            ports_.clear();
+        }
+        markRemoved(ports);
+    }
+
+//}
+
+/* getShared() //{ */
+
+    std::shared_ptr<SerialReactor> SerialReactor::getShared() {
+
+        static std::mutex mutex;
+        static std::weak_ptr<SerialReactor> instance;
+
+        std::scoped_lock lck(mutex);
+
+        // the thread of the shared reactor stops with the last handle
+        std::shared_ptr<SerialReactor> reactor = instance.lock();
+        if (!reactor) {
+            reactor = std::make_shared<SerialReactor>();
+            if (!reactor->start()) {
+                return nullptr;
+            }
+            instance = reactor;
+        }
+
+        return reactor;
+    }
+
+//}
+
+/* start() //{ */
+
+    bool SerialReactor::start() {
+
+        if (running_) {
+            return true;
+        }
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ == -1) {
+            ROS_ERROR("[SerialReactor]: epoll_create1 failed: %s", strerror(errno));
+            return false;
+        }
+
+        wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeup_fd_ == -1) {
+            ROS_ERROR("[SerialReactor]: eventfd failed: %s", strerror(errno));
+            close(epoll_fd_);
+            epoll_fd_ = -1;
+            return false;
+        }
+
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = WAKEUP_ID;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &ev);
+
+        {
+            std::scoped_lock lck(mtx_);
+            // ports added before start() are registered now
+            for (auto &[id, p] : ports_) {
+                struct epoll_event pev{};
+                pev.events = p->queue ? EPOLLIN | EPOLLONESHOT : EPOLLIN;
+                pev.data.u64 = id;
+                epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, p->fd, &pev);
+            }
+        }
+
+        running_ = true;
+        thread_ = std::thread(&SerialReactor::loop, this);
+
+        return true;
+    }
+
+//}
+
+/* startShared() //{ */
+
+    bool SerialReactor::startShared() {
+
+        if (running_ || shared_) {
+            return true;
+        }
+
+        shared_ = getShared();
+
+        return shared_ != nullptr;
+    }
+
+//}
+
+/* stop() //{ */
+
+    void SerialReactor::stop() {
+
+        if (shared_) {
+
+            std::set<SerialPort *> ports;
+            {
+                std::scoped_lock lck(mtx_);
+                ports.swap(shared_ports_);
+            }
+
+            for (SerialPort *port : ports) {
+                shared_->removePort(port);
+            }
+
+            shared_.reset();
+            return;
+        }
+
+        if (running_) {
+            running_ = false;
+            uint64_t one = 1;
+            if (write(wakeup_fd_, &one, sizeof(one)) != sizeof(one)) {
+                ROS_WARN("[SerialReactor]: failed to wake up the reactor thread");
+            }
+        }
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        if (wakeup_fd_ != -1) {
+            close(wakeup_fd_);
+            wakeup_fd_ = -1;
+        }
+
+        if (epoll_fd_ != -1) {
+            close(epoll_fd_);
+            epoll_fd_ = -1;
+        }
+    }
+
+//}
+
+/* isRunning() //{ */
+
+    bool SerialReactor::isRunning() const {
+        return shared_ ? shared_->isRunning() : running_.load();
+    }
+
+//}
+
+/* setCallbackQueue() //{ */
+
+    void SerialReactor::setCallbackQueue(ros::CallbackQueueInterface *queue) {
+        std::scoped_lock lck(mtx_);
+        queue_ = queue;
+    }
+
+//}
+
+/* addPort() //{ */
+
+    bool SerialReactor::addPort(SerialPort *port, DataCallback callback, int buffer_size) {
+
+        ros::CallbackQueueInterface *queue;
+        {
+            std::scoped_lock lck(mtx_);
+            queue = queue_;
+            if (shared_) {
+                shared_ports_.insert(port);
+            }
+        }
+
+        if (shared_) {
+            return shared_->registerPort(port, std::move(callback), buffer_size, queue);
+        }
+
+        return registerPort(port, std::move(callback), buffer_size, queue);
+    }
+
+//}
+
+/* registerPort() //{ */
+
+    bool SerialReactor::registerPort(SerialPort *port, DataCallback callback, int buffer_size, ros::CallbackQueueInterface *queue) {
+
+        removePort(port);
+
+        std::scoped_lock lck(mtx_);
+
+        const uint64_t id = next_id_++;
+        auto p = std::make_shared<Port>();
+        p->id = id;
+        p->port = port;
+        p->fd = port->getReadableFd();
+        p->callback = std::move(callback);
+        p->buffer.resize(std::max(buffer_size, 1));
+        p->queue = queue;
+
+        if (epoll_fd_ != -1) {
+            struct epoll_event ev{};
+            // a queued port is re-armed after its callback drained it
+            ev.events = queue ? EPOLLIN | EPOLLONESHOT : EPOLLIN;
+            ev.data.u64 = id;
+
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, p->fd, &ev) == -1) {
+                ROS_ERROR("[SerialReactor]: could not watch fd %d: %s", p->fd, strerror(errno));
+                return false;
+            }
+        }
+
+        ports_.emplace(id, std::move(p));
+
+        return true;
+    }
+
+//}
+
+/* removePort() //{ */
+
+    void SerialReactor::removePort(SerialPort *port) {
+
+        if (shared_) {
+            {
+                std::scoped_lock lck(mtx_);
+                shared_ports_.erase(port);
+            }
+            shared_->removePort(port);
+            return;
+        }
+
+        std::vector<std::shared_ptr<Port>> removed;
+
+        {
+            std::scoped_lock lck(mtx_);
+
+            for (auto it = ports_.begin(); it != ports_.end();) {
+                if (it->second->port == port) {
+                    if (epoll_fd_ != -1) {
+                        // fails harmlessly if the fd has been closed in the meantime
+                        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->second->fd, nullptr);
+                    }
+                    removed.push_back(it->second);
+                    it = ports_.erase(it);
+                } else {
+                    it++;
+                }
+            }
+        }
+
+        // outside of mtx_, a queued read takes mtx_ while holding busy
+        markRemoved(removed);
+    }
+
+//}
+
+/* markRemoved() //{ */
+
+    void SerialReactor::markRemoved(const std::vector<std::shared_ptr<Port>> &ports) {
+
+        // waits for a read of the port running in its queue
+        for (const std::shared_ptr<Port> &p : ports) {
+            std::scoped_lock busy(p->busy);
+            p->removed = true;
+        }
+    }
+
+//}
+
+/* loop() //{ */
+
+    void SerialReactor::loop() {
+
+        struct epoll_event events[MAX_EPOLL_EVENTS];
+
+        while (running_) {
+
+            const int n_events = epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS, -1);
+
+            if (n_events == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ROS_ERROR("[SerialReactor]: epoll_wait failed: %s", strerror(errno));
+                break;
+            }
+
+            for (int i = 0; i < n_events; i++) {
+
+                if (events[i].data.u64 == WAKEUP_ID) {
+                    uint64_t tmp;
+                    while (read(wakeup_fd_, &tmp, sizeof(tmp)) > 0) {
+                    }
+                    continue;
+                }
+
+                dispatch(events[i].data.u64, events[i].events);
+            }
+        }
+
+        running_ = false;
+    }
+
+//}
+
+/* dispatch() //{ */
+
+    void SerialReactor::dispatch(uint64_t id, uint32_t events) {
+
+        std::scoped_lock lck(mtx_);
+
+        // the port might have been removed while we were waiting for the lock
+        auto it = ports_.find(id);
+        if (it == ports_.end()) {
+            return;
+        }
+
+        const std::shared_ptr<Port> p = it->second;
+        bool failed = events & (EPOLLHUP | EPOLLERR);
+
+        if (!failed && p->queue) {
+            // one callback per burst, the fd stays disarmed until the callback has drained it
+            p->queue->addCallback(boost::make_shared<ReadCallback>(this, p), p->id);
+            return;
+        }
+
+        if (!failed && (events & EPOLLIN)) {
+            failed = !drain(*p);
+
+            // the callback might have removed the port
+            if (ports_.find(id) == ports_.end()) {
+                return;
+            }
+        }
+
+        if (failed) {
+            // stop watching, the maintainer of the port will notice and reconnect
+            ROS_ERROR("[SerialReactor]: serial port fd %d hung up, not watching it anymore", p->fd);
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, p->fd, nullptr);
+            ports_.erase(it);
+        }
+    }
+
+//}
+
+/* drain() //{ */
+
+    bool SerialReactor::drain(Port &p) {
+
+        const int buffer_size = p.buffer.size();
+        const uint64_t id = p.id;
+
+        // drain the fd, the callback gets the data in chunks of at most buffer_size bytes
+        while (true) {
+
+            const int bytes_read = p.port->readSerial(p.buffer.data(), buffer_size);
+
+            if (bytes_read > 0) {
+                p.callback(p.buffer.data(), bytes_read);
+
+                // the callback might have removed the port
+                if (p.removed) {
+                    return true;
+                }
+                if (!p.queue) {
+                    std::scoped_lock lck(mtx_);
+                    if (ports_.find(id) == ports_.end()) {
+                        return true;
+                    }
+                }
+            }
+
+            if (bytes_read < 0 && errno != EAGAIN && errno != EINTR) {
+                return false;
+            }
+
+            if (bytes_read < buffer_size) {
+                return true;
+            }
+        }
+    }
+
+//}
+
+/* drainQueued() //{ */
+
+    void SerialReactor::drainQueued(const std::shared_ptr<Port> &p) {
+
+        bool failed;
+
+        {
+            std::scoped_lock busy(p->busy);
+
+            if (p->removed) {
+                return;
+            }
+
+            failed = !drain(*p);
+
+            if (p->removed) {
+                return;
+            }
+
+            // a stopped reactor registers its ports again in start()
+            if (!failed && epoll_fd_ != -1) {
+                struct epoll_event ev{};
+                ev.events = EPOLLIN | EPOLLONESHOT;
+                ev.data.u64 = p->id;
+                failed = epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, p->fd, &ev) == -1;
+            }
+
+            if (failed) {
+                p->removed = true;
+            }
+        }
+
+        if (failed) {
+            ROS_ERROR("[SerialReactor]: serial port fd %d hung up, not watching it anymore", p->fd);
+
+            std::scoped_lock lck(mtx_);
+            auto it = ports_.find(p->id);
+            if (it != ports_.end()) {
+                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, p->fd, nullptr);
+                ports_.erase(it);
+            }
+        }
+    }
+
+//}
+
+}  // namespace serial_port
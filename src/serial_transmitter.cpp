@@ -0,0 +1,233 @@
+#include "serial_transmitter.h"
+
+#include <algorithm>
+
+// [s] shortest sleep while waiting for the kernel queue to drain
+#define MIN_DRAIN_WAIT 0.0001
+
+// frames handed to the port at once
+#define TX_MAX_BATCH 16
+
+namespace serial_port {
+
+/* SerialTransmitter() //{ */
+
+    SerialTransmitter::SerialTransmitter(SerialPort *port) : port_(port) {
+    }
+
+//}
+
+/* ~SerialTransmitter() //{ */
+
+    SerialTransmitter::~SerialTransmitter() {
+        stop();
+    }
+
+//}
+
+/* start() //{ */
+
+    void SerialTransmitter::start(size_t max_depth, int kernel_queue_limit) {
+
+        if (running_) {
+            return;
+        }
+
+        max_depth_          = std::max(max_depth, size_t(1));
+        kernel_queue_limit_ = kernel_queue_limit;
+
+        running_ = true;
+        thread_  = std::thread(&SerialTransmitter::writerLoop, this);
+    }
+
+//}
+
+/* stop() //{ */
+
+    void SerialTransmitter::stop() {
+
+        {
+            std::scoped_lock lck(mtx_);
+            running_ = false;
+        }
+        cv_.notify_all();
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+//}
+
+/* send() //{ */
+
+    bool SerialTransmitter::send(const uint8_t *frame, int len, TxPriority priority) {
+
+        if (len <= 0 || priority >= TX_PRIORITY_COUNT) {
+            return false;
+        }
+
+        {
+            std::scoped_lock lck(mtx_);
+
+            TxClass &c = classes_[priority];
+
+            if (c.queue.size() >= max_depth_) {
+                c.stats.dropped++;
+                ROS_WARN_THROTTLE(1.0, "[SerialTransmitter]: queue of priority %d is full, dropping a frame", int(priority));
+                return false;
+            }
+
+            c.queue.push_back(Frame{std::vector<uint8_t>(frame, frame + len), std::chrono::steady_clock::now(), priority});
+            c.stats.depth      = c.queue.size();
+            c.stats.peak_depth = std::max(c.stats.peak_depth, c.stats.depth);
+        }
+
+        cv_.notify_one();
+
+        return true;
+    }
+
+//}
+
+/* getStats() //{ */
+
+    TxClassStats SerialTransmitter::getStats(TxPriority priority) {
+
+        std::scoped_lock lck(mtx_);
+
+        TxClassStats stats = classes_[priority].stats;
+        stats.wait_avg     = stats.sent > 0 ? classes_[priority].wait_sum / stats.sent : 0.0;
+
+        return stats;
+    }
+
+//}
+
+/* getStatsSummary() //{ */
+
+    std::string SerialTransmitter::getStatsSummary() {
+
+        static const char *names[TX_PRIORITY_COUNT] = {"safety", "control", "bulk"};
+
+        std::string summary;
+
+        for (int i = 0; i < TX_PRIORITY_COUNT; i++) {
+
+            const TxClassStats stats = getStats(TxPriority(i));
+
+            char line[192];
+            snprintf(line, sizeof(line), "%s%s: %zu queued (peak %zu), %lu sent, %lu failed, %lu dropped, wait %.2f/%.2f ms avg/max", i > 0 ? " | " : "",
+                     names[i], stats.depth, stats.peak_depth, (unsigned long)stats.sent, (unsigned long)stats.failed, (unsigned long)stats.dropped,
+                     stats.wait_avg * 1e3, stats.wait_max * 1e3);
+            summary += line;
+        }
+
+        return summary;
+    }
+
+//}
+
+/* writerLoop() //{ */
+
+    void SerialTransmitter::writerLoop() {
+
+        std::unique_lock lck(mtx_);
+
+        std::vector<Frame>        batch;
+        std::vector<struct iovec> iovecs;
+
+        while (running_) {
+
+            batch.clear();
+
+            double wait          = 0;
+            bool   queue_checked = false;
+            int    queued        = -1;
+            int    batched_bytes = 0;
+
+            // the frames the scheduling rules allow to write right now, in order, handed to the port together
+            while (batch.size() < TX_MAX_BATCH) {
+
+                auto it = std::find_if(classes_.begin(), classes_.end(), [](const TxClass &c) { return !c.queue.empty(); });
+
+                if (it == classes_.end()) {
+                    break;
+                }
+
+                const TxPriority priority = TxPriority(it - classes_.begin());
+
+                // keep the kernel buffer short, so that a safety frame queued later does not wait behind it
+                if (priority != TX_SAFETY && kernel_queue_limit_ >= 0) {
+
+                    if (!queue_checked) {
+                        queued        = port_->getOutputQueueBytes();
+                        queue_checked = true;
+                    }
+
+                    if (queued >= 0 && queued + batched_bytes > kernel_queue_limit_) {
+                        // 10 bits per byte on the wire, a safety frame arriving meanwhile wakes us up
+                        const int baudrate = std::max(port_->getAppliedBaudrate(), 1);
+                        wait               = std::max((queued + batched_bytes - kernel_queue_limit_) * 10.0 / baudrate, MIN_DRAIN_WAIT);
+                        break;
+                    }
+                }
+
+                Frame frame = std::move(it->queue.front());
+                it->queue.pop_front();
+
+                it->stats.depth = it->queue.size();
+
+                batched_bytes += frame.data.size();
+                batch.push_back(std::move(frame));
+            }
+
+            if (batch.empty()) {
+                if (wait > 0) {
+                    cv_.wait_for(lck, std::chrono::duration<double>(wait));
+                } else {
+                    cv_.wait(lck);
+                }
+                continue;
+            }
+
+            lck.unlock();
+
+            iovecs.clear();
+            for (Frame &frame : batch) {
+                iovecs.push_back(iovec{frame.data.data(), frame.data.size()});
+            }
+
+            // linked writes with one system call with the io_uring backend, one write() per frame otherwise
+            const int written = port_->sendFrames(iovecs.data(), iovecs.size());
+
+            if (written < int(batch.size())) {
+                ROS_WARN_THROTTLE(1.0, "[SerialTransmitter]: failed to write %d of a batch of %zu frames", int(batch.size()) - written, batch.size());
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+
+            lck.lock();
+
+            // the port writes the frames in order and stops at the first one that fails
+            for (int i = 0; i < int(batch.size()); i++) {
+
+                TxClass &c = classes_[batch[i].priority];
+
+                if (i >= written) {
+                    c.stats.failed++;
+                    continue;
+                }
+
+                const double waited = std::chrono::duration<double>(now - batch[i].enqueued).count();
+
+                c.stats.sent++;
+                c.stats.wait_max = std::max(c.stats.wait_max, waited);
+                c.wait_sum += waited;
+            }
+        }
+    }
+
+//}
+
+}  // namespace serial_port
@@ -0,0 +1,155 @@
+/*
+ * Decoding throughput of baca_protocol::BacaFramer in MB/s, on synthetic streams handed over
+ * in chunks as the nodelets read them from the port. The start byte scan and the payload
+ * checksums use the widest vectors of the build: baca_framer_benchmark is built with the
+ * default flags (SSE2 on x86-64), baca_framer_benchmark_avx2 with -mavx2 and
+ * baca_framer_benchmark_scalar without the vector paths.
+ *
+ *   rosrun mrs_serial baca_framer_benchmark [megabytes] [chunk_bytes]
+ *
+ * Every stream is decoded with the resync on a bad checksum off and on, the best of RUNS counts.
+ */
+
+#include <baca_framer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#define RUNS 5
+
+namespace
+{
+
+    struct Stream {
+        const char *name;
+        int payload_size;
+        int noise;           // random bytes between the frames
+        bool start_bytes;    // the noise may hold false start bytes, which the resync recovers from
+        double bad;          // fraction of the frames with a wrong checksum
+    };
+
+    const Stream STREAMS[] = {
+        {"payload 3 B", 3, 0, false, 0},
+        {"payload 13 B", 13, 0, false, 0},
+        {"payload 200 B", 200, 0, false, 0},
+        {"payload 3 B, 64 B noise", 3, 64, false, 0},
+        {"payload 13 B, 256 B noise", 13, 256, false, 0},
+        {"payload 13 B, 1 % bad", 13, 0, false, 0.01},
+        {"payload 13 B, 16 B raw noise", 13, 16, true, 0},
+    };
+
+/* generate() //{ */
+
+    std::vector<uint8_t> generate(const Stream &stream, size_t bytes, uint64_t &frames) {
+
+        std::mt19937 rng(1);
+        std::bernoulli_distribution corrupt(stream.bad);
+
+        std::vector<uint8_t> data;
+        data.reserve(bytes + stream.noise + stream.payload_size + 3);
+        frames = 0;
+
+        while (data.size() < bytes) {
+
+            for (int i = 0; i < stream.noise; i++) {
+                const uint8_t c = rng();
+                data.push_back(!stream.start_bytes && (c == 'a' || c == 'b') ? 0 : c);
+            }
+
+            data.push_back('b');
+            data.push_back(stream.payload_size);
+
+            uint8_t checksum = 'b' + stream.payload_size;
+            for (int i = 0; i < stream.payload_size; i++) {
+                const uint8_t c = rng();
+                data.push_back(c);
+                checksum += c;
+            }
+
+            data.push_back(corrupt(rng) ? checksum + 1 : checksum);
+            frames++;
+        }
+
+        return data;
+    }
+
+//}
+
+/* decode() //{ */
+
+    // [MB/s], the best of RUNS
+    double decode(const std::vector<uint8_t> &data, size_t chunk, bool resync, uint64_t &frames_ok) {
+
+        double best = 0;
+
+        for (int run = 0; run < RUNS; run++) {
+
+            baca_protocol::BacaFramer framer;
+            framer.setResync(resync);
+
+            uint64_t ok = 0;
+
+            const auto start = std::chrono::steady_clock::now();
+
+            for (size_t i = 0; i < data.size(); i += chunk) {
+                framer.decode(data.data() + i, std::min(chunk, data.size() - i), [&ok](const baca_protocol::BacaFrame &frame) { ok += frame.checksum_correct; });
+            }
+
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            best = std::max(best, data.size() / seconds / 1e6);
+            frames_ok = ok;
+        }
+
+        return best;
+    }
+
+//}
+
+}  // namespace
+
+/* main() //{ */
+
+int main(int argc, char **argv) {
+
+#if defined(BACA_FRAMER_AVX2)
+    if (!__builtin_cpu_supports("avx2")) {
+        fprintf(stderr, "this CPU does not support AVX2\n");
+        return 1;
+    }
+#endif
+
+    const double megabytes = argc > 1 ? atof(argv[1]) : 64.0;
+    const int chunk_bytes = argc > 2 ? atoi(argv[2]) : 1024;
+
+    if (chunk_bytes <= 0) {
+        fprintf(stderr, "chunk_bytes must be positive\n");
+        return 1;
+    }
+
+    const size_t chunk = chunk_bytes;
+
+    printf("%s, %.0f MB in chunks of %zu B, best of %d:\n", baca_protocol::simd::instructionSet(), megabytes, chunk, RUNS);
+    printf("  %-28s %12s %12s   %s\n", "", "resync off", "resync on", "good frames off/on/sent");
+
+    for (const Stream &stream : STREAMS) {
+
+        uint64_t frames;
+        const std::vector<uint8_t> data = generate(stream, megabytes * 1e6, frames);
+
+        uint64_t ok_off, ok_on;
+        const double off = decode(data, chunk, false, ok_off);
+        const double on = decode(data, chunk, true, ok_on);
+
+        printf("  %-28s %7.0f MB/s %7.0f MB/s   %lu/%lu/%lu\n", stream.name, off, on, ok_off, ok_on, frames);
+    }
+
+    return 0;
+}
+
+//}
@@ -0,0 +1,198 @@
+/*
+ * Counts the read() calls and the CPU time per MB the SBGC parser needs to receive a stream
+ * of commands from a pseudo terminal. The port is drained every millisecond, as the receiving
+ * loop of the gimbal does, and the device side of the pty is driven by a helper thread whose
+ * CPU time is not counted.
+ *
+ *   rosrun mrs_serial sbgc_read_benchmark [megabytes] [command_bytes]
+ *
+ * "per byte" is the former loop of SBGC_Parser::read_cmd(), one readChar() for every byte,
+ * "block" the buffered read_cmd(), one readSerial() for everything available.
+ */
+
+#include <serial_port.h>
+#include <SBGC_lib/SBGC.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+// period of the receiving loop of the gimbal [ns]
+#define POLL_PERIOD 1000000
+
+// the id of the realtime data the gimbal streams
+#define COMMAND_ID SBGC_CMD_REALTIME_DATA_CUSTOM
+
+namespace
+{
+
+/* helpers //{ */
+
+    double processCpu() {
+        struct rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+    }
+
+    double threadCpu() {
+        struct timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    uint8_t pattern(uint64_t i) {
+        return uint8_t(i * 7 + (i >> 8));
+    }
+
+    struct Result {
+        double mb = 0;
+        double cpu = 0;      // [s] without the device side
+        uint64_t reads = 0;
+        bool valid = true;   // all the commands arrived complete and in order
+    };
+
+    void printResult(const char *name, const Result &result) {
+        printf("  %-10s %10.1f reads/MB %8.2f ms CPU/MB%s\n", name, result.reads / result.mb, result.cpu * 1e3 / result.mb, result.valid ? "" : "  DATA MISMATCH");
+    }
+
+//}
+
+/* benchmark() //{ */
+
+    Result benchmark(bool per_byte, size_t bytes, int command) {
+
+        Result result;
+
+        // the device side of the pty, the port opens the other one
+        const int device_fd = posix_openpt(O_RDWR | O_NOCTTY);
+        char pts[128];
+        if (device_fd == -1 || grantpt(device_fd) != 0 || unlockpt(device_fd) != 0 || ptsname_r(device_fd, pts, sizeof(pts)) != 0) {
+            perror("posix_openpt");
+            exit(1);
+        }
+
+        serial_port::SerialPort port;
+        if (!port.connect(pts, 115200)) {
+            exit(1);
+        }
+
+        SBGC_Parser parser;
+        parser.init(&port);
+
+        const int payload = command - SBGC_CMD_NON_PAYLOAD_BYTES;
+        const size_t n_commands = bytes / command;
+        result.mb = n_commands * command / 1e6;
+
+        double device_cpu = 0;
+
+        const double cpu_start = processCpu();
+
+        // one write() per command, as the controller streams its realtime data
+        std::thread device([&] {
+            std::vector<uint8_t> data(command);
+            // header: start byte, id, payload size and their checksum, the checksum of the payload follows the data
+            data[0] = SBGC_CMD_START_BYTE;
+            data[1] = COMMAND_ID;
+            data[2] = payload;
+            data[3] = COMMAND_ID + payload;
+            for (size_t i = 0; i < n_commands; i++) {
+                uint8_t checksum = 0;
+                for (int j = 0; j < payload; j++) {
+                    data[4 + j] = pattern(i * payload + j);
+                    checksum += data[4 + j];
+                }
+                data[command - 1] = checksum;
+                for (int written = 0; written < command;) {
+                    const int ret = write(device_fd, data.data() + written, command - written);
+                    if (ret > 0) {
+                        written += ret;
+                    }
+                }
+            }
+            device_cpu = threadCpu();
+        });
+
+        size_t received = 0;
+
+        const auto check = [&]() {
+            const SerialCommand &cmd = parser.in_cmd;
+            result.valid &= cmd.id == COMMAND_ID && cmd.len == payload;
+            for (int j = 0; j < cmd.len; j++) {
+                result.valid &= cmd.data[j] == pattern(received * payload + j);
+            }
+            received++;
+        };
+
+        while (received < n_commands) {
+
+            const struct timespec period{0, POLL_PERIOD};
+            nanosleep(&period, nullptr);
+
+            if (per_byte) {
+                // one read() for every byte and one more for the empty port
+                uint8_t c;
+                while (true) {
+                    result.reads++;
+                    if (!port.readChar(&c)) {
+                        break;
+                    }
+                    if (parser.process_char(c)) {
+                        check();
+                    }
+                }
+            } else {
+                while (parser.read_cmd()) {
+                    check();
+                }
+            }
+        }
+
+        device.join();
+
+        result.cpu = processCpu() - cpu_start - device_cpu;
+        if (!per_byte) {
+            result.reads = parser.get_read_call_count();
+        }
+        result.valid &= parser.get_parse_error_count() == 0;
+
+        port.disconnect();
+        close(device_fd);
+
+        return result;
+    }
+
+//}
+
+}  // namespace
+
+/* main() //{ */
+
+int main(int argc, char **argv) {
+
+    ros::Time::init();
+
+    const double megabytes = argc > 1 ? atof(argv[1]) : 2.0;
+    const int command = argc > 2 ? atoi(argv[2]) : 25;
+
+    // the parser holds one command at a time
+    if (command <= SBGC_CMD_NON_PAYLOAD_BYTES || command > SBGC_CMD_MAX_BYTES) {
+        fprintf(stderr, "command_bytes must be between %d and %d\n", SBGC_CMD_NON_PAYLOAD_BYTES + 1, SBGC_CMD_MAX_BYTES);
+        return 1;
+    }
+
+    const size_t bytes = megabytes * 1e6;
+
+    printf("%.1f MB in commands of %d B, read every %d ms:\n", megabytes, command, POLL_PERIOD / 1000000);
+    printResult("per byte", benchmark(true, bytes, command));
+    printResult("block", benchmark(false, bytes, command));
+
+    return 0;
+}
+
+//}
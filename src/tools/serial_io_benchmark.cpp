@@ -0,0 +1,269 @@
+/*
+ * Compares the I/O backends of serial_port::SerialPort on a pseudo terminal: system calls
+ * and CPU time per MB of received and of sent data. The device side of the pty is driven
+ * by a helper thread, its CPU time is not counted.
+ *
+ *   rosrun mrs_serial serial_io_benchmark [megabytes] [rx_chunk_bytes] [tx_frame_bytes]
+ *
+ * rx "direct" is the default path (epoll on the port and readSerial()), "reader thread"
+ * is poll() and read() in the reader thread, "io_uring" the reader thread on io_uring.
+ * tx "write" writes every frame with write(), "io_uring" the frames of a batch as linked writes,
+ * the next batch follows when the device received the previous one.
+ */
+
+#include <pty_pair.h>
+#include <serial_port.h>
+
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <thread>
+
+// frames handed to sendFrames() at once, as the transmitter does
+#define TX_BATCH 16
+
+namespace
+{
+
+/* helpers //{ */
+
+    double processCpu() {
+        struct rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+    }
+
+    double threadCpu() {
+        struct timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    uint8_t pattern(uint64_t i) {
+        return uint8_t(i * 7 + (i >> 8));
+    }
+
+    struct Result {
+        double mb = 0;
+        double cpu = 0;          // [s] without the device side
+        uint64_t syscalls = 0;
+        bool valid = true;       // the bytes arrived complete and in order
+        bool fallback = false;   // io_uring was requested but not available
+    };
+
+    void printResult(const char *name, const Result &result) {
+        printf("  %-14s %8.1f syscalls/MB %8.2f ms CPU/MB%s%s\n", name, result.syscalls / result.mb, result.cpu * 1e3 / result.mb,
+               result.valid ? "" : "  DATA MISMATCH", result.fallback ? "  (io_uring not available)" : "");
+    }
+
+//}
+
+/* benchmarkRx() //{ */
+
+    Result benchmarkRx(bool reader_thread, bool io_uring, size_t bytes, int chunk) {
+
+        Result result;
+        result.mb = bytes / 1e6;
+
+        serial_port::PtyPair pty;
+        if (!pty.open()) {
+            perror("posix_openpt");
+            exit(1);
+        }
+
+        serial_port::SerialPort port;
+        port.setIoUring(io_uring);
+        if (reader_thread) {
+            port.enableReaderThread(1 << 20);
+        }
+        if (!port.connectPty(pty, 115200)) {
+            exit(1);
+        }
+
+        const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, port.getReadableFd(), &ev);
+
+        double device_cpu = 0;
+
+        const double cpu_start = processCpu();
+        const serial_port::IoStats stats_start = port.getIoStats();
+
+        // the device, small chunks as sent by the sensors
+        std::thread device([&] {
+            std::vector<uint8_t> data(chunk);
+            for (size_t sent = 0; sent < bytes;) {
+                const int len = std::min<size_t>(chunk, bytes - sent);
+                for (int i = 0; i < len; i++) {
+                    data[i] = pattern(sent + i);
+                }
+                const int ret = write(pty.getDeviceFd(), data.data(), len);
+                if (ret > 0) {
+                    sent += ret;
+                }
+            }
+            device_cpu = threadCpu();
+        });
+
+        std::vector<uint8_t> buffer(1024);
+        size_t received = 0;
+        uint64_t waits = 0;
+
+        while (received < bytes) {
+
+            epoll_wait(epoll_fd, &ev, 1, 1000);
+            waits++;
+
+            // as the reactor does, until a short read
+            while (true) {
+                const int n = port.readSerial(buffer.data(), buffer.size());
+                for (int i = 0; i < n; i++) {
+                    result.valid &= buffer[i] == pattern(received + i);
+                }
+                received += std::max(n, 0);
+                if (n < int(buffer.size())) {
+                    break;
+                }
+            }
+        }
+
+        device.join();
+
+        const serial_port::IoStats stats = port.getIoStats();
+
+        result.cpu = processCpu() - cpu_start - device_cpu;
+        result.syscalls = stats.rx_syscalls - stats_start.rx_syscalls + waits;
+        result.fallback = io_uring && !stats.rx_io_uring;
+
+        port.disconnect();
+        close(epoll_fd);
+
+        return result;
+    }
+
+//}
+
+/* benchmarkTx() //{ */
+
+    Result benchmarkTx(bool io_uring, size_t bytes, int frame) {
+
+        Result result;
+        result.mb = bytes / 1e6;
+
+        serial_port::PtyPair pty;
+        if (!pty.open()) {
+            perror("posix_openpt");
+            exit(1);
+        }
+
+        serial_port::SerialPort port;
+        port.setIoUring(io_uring);
+        if (!port.connectPty(pty, 115200)) {
+            exit(1);
+        }
+
+        double device_cpu = 0;
+        bool device_valid = true;
+
+        const double cpu_start = processCpu();
+        const serial_port::IoStats stats_start = port.getIoStats();
+
+        const size_t n_frames = bytes / frame;
+        const size_t batch_bytes = size_t(TX_BATCH) * frame;
+
+        // the next batch is sent after the device got the previous one, as the transmitter keeps the kernel queue short
+        const int batch_done = eventfd(0, EFD_CLOEXEC);
+
+        // the device drains the pty
+        std::thread device([&] {
+            std::vector<uint8_t> data(65536);
+            const size_t total = n_frames * frame;
+            size_t received = 0;
+            while (received < total) {
+                const int n = read(pty.getDeviceFd(), data.data(), data.size());
+                for (int i = 0; i < n; i++) {
+                    device_valid &= data[i] == pattern(received + i);
+                }
+                received += std::max(n, 0);
+                if (n > 0 && (received % batch_bytes == 0 || received == total)) {
+                    uint64_t one = 1;
+                    if (write(batch_done, &one, sizeof(one)) != sizeof(one)) {
+                        device_valid = false;
+                    }
+                }
+            }
+            device_cpu = threadCpu();
+        });
+
+        std::vector<uint8_t> data(batch_bytes);
+        struct iovec frames[TX_BATCH];
+
+        for (size_t sent = 0; sent < n_frames;) {
+
+            const int batch = std::min<size_t>(TX_BATCH, n_frames - sent);
+
+            for (int i = 0; i < batch; i++) {
+                uint8_t *f = data.data() + i * frame;
+                for (int j = 0; j < frame; j++) {
+                    f[j] = pattern((sent + i) * frame + j);
+                }
+                frames[i] = iovec{f, size_t(frame)};
+            }
+
+            result.valid &= port.sendFrames(frames, batch) == batch;
+            sent += batch;
+
+            uint64_t done;
+            if (read(batch_done, &done, sizeof(done)) != sizeof(done)) {
+                result.valid = false;
+            }
+        }
+
+        device.join();
+        close(batch_done);
+
+        const serial_port::IoStats stats = port.getIoStats();
+
+        result.cpu = processCpu() - cpu_start - device_cpu;
+        result.syscalls = stats.tx_syscalls - stats_start.tx_syscalls;
+        result.valid &= device_valid;
+        result.fallback = io_uring && !stats.tx_io_uring;
+
+        port.disconnect();
+
+        return result;
+    }
+
+//}
+
+}  // namespace
+
+/* main() //{ */
+
+int main(int argc, char **argv) {
+
+    ros::Time::init();
+
+    const double megabytes = argc > 1 ? atof(argv[1]) : 20.0;
+    const int rx_chunk = argc > 2 ? atoi(argv[2]) : 64;
+    const int tx_frame = argc > 3 ? atoi(argv[3]) : 32;
+
+    const size_t bytes = megabytes * 1e6;
+
+    printf("rx, %.0f MB in chunks of %d B:\n", megabytes, rx_chunk);
+    printResult("direct", benchmarkRx(false, false, bytes, rx_chunk));
+    printResult("reader thread", benchmarkRx(true, false, bytes, rx_chunk));
+    printResult("io_uring", benchmarkRx(true, true, bytes, rx_chunk));
+
+    printf("tx, %.0f MB in frames of %d B, %d frames per batch:\n", megabytes, tx_frame, TX_BATCH);
+    printResult("write", benchmarkTx(false, bytes, tx_frame));
+    printResult("io_uring", benchmarkTx(true, bytes, tx_frame));
+
+    return 0;
+}
+
+//}
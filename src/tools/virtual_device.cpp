@@ -0,0 +1,841 @@
+/*
+ * Plays serial devices on pseudo terminals, so that the nodelets and the whole ingest path
+ * can be run and benchmarked without the hardware. The node is pointed at the link of a
+ * port with its portname parameter.
+ *
+ *   rosrun mrs_serial virtual_device script.txt     (- reads the script from stdin)
+ *
+ * The script is run line by line, # starts a comment:
+ *
+ *   seed 7                                 the same script and seed give the same bytes (1 by default)
+ *   port garmin /tmp/ttyGARMIN 115200      pty with a link, the frames are paced as on a wire of that baudrate, 0 does not pace them
+ *   stream garmin garmin 100 noise=0.02    <port> <type> <rate [Hz]> [options], issued again for the same type and id it changes the stream
+ *   sleep 10                               [s], the streams run only meanwhile
+ *   stop garmin [type]                     all streams of the port or of the type
+ *   hangup garmin 2                        closes the pty as an unplugged adapter would, reopens it after [s], the frames meanwhile are lost
+ *   report                                 what every port sent and received since the last report
+ *   log /tmp/sent.csv                      port,type,sequence,wall time [ns],bytes of every frame sent from now on
+ *
+ * types:   garmin       Baca 0x00 range, value [m] (2)
+ *          vio_imu      Baca 0x30 imu, value is the acc z [g] (1), the noise applies to the acc [g] and the gyro [deg/s]
+ *          nmea         GPGGA sentences, noise of the position [m]
+ *          xbee         API frames of the IS responses expected by the estop
+ *          sbgc         SBGC realtime custom data with the fields requested by the gimbal nodelet, value is the pitch [deg]
+ *
+ * options: value=v      the measured value, see the types
+ *          noise=s      standard deviation of the measured value, in its units
+ *          id=n         message id of the Baca types, e.g. id=0x01 for the upward garmin
+ *          estop=p      xbee, probability of an estop response
+ *          drop=p       probability that a frame is not sent at all
+ *          corrupt=p    probability of a bit flip per byte
+ *          garbage=p    probability of 1 - 16 random bytes before a frame
+ *          jitter=t     [s] random delay of each frame, it does not accumulate
+ *
+ * The data received from the node are read and counted, so that its writes never block.
+ */
+
+#include <baca_messages.h>
+#include <pty_pair.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// a stream further behind its schedule (e.g. above the capacity of the wire) is not caught up
+#define MAX_LAG 1.0
+
+#define SBGC_CMD_REALTIME_DATA_CUSTOM 88
+
+namespace
+{
+
+    using Clock = std::chrono::steady_clock;
+
+    enum StreamType
+    {
+        GARMIN,
+        VIO_IMU,
+        NMEA,
+        XBEE,
+        SBGC,
+    };
+
+    const std::map<std::string, StreamType> stream_types = {
+        {"garmin", GARMIN}, {"vio_imu", VIO_IMU}, {"nmea", NMEA}, {"xbee", XBEE}, {"sbgc", SBGC},
+    };
+
+    struct StreamOptions {
+        double rate = 0;     // [Hz]
+        double value = NAN;  // default of the type
+        double noise = 0;
+        int id = -1;         // default of the type
+        double estop = 0;
+        double drop = 0;
+        double corrupt = 0;
+        double garbage = 0;
+        double jitter = 0;   // [s]
+    };
+
+    struct StreamStats {
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        uint64_t dropped = 0;     // by the drop option
+        uint64_t skipped = 0;     // behind the schedule by more than MAX_LAG, or while the port was hung up
+        uint64_t overflow = 0;    // [B] did not fit into the pty, the node does not read the port
+    };
+
+    struct Stream {
+        std::string type_name;
+        std::string label;            // the type, with the id if it was given
+        StreamType type;
+        StreamOptions options;
+        Clock::time_point scheduled;  // without the jitter
+        Clock::time_point due;
+        uint64_t sequence = 0;
+        StreamStats stats;
+    };
+
+    struct Port {
+        std::string name;
+        std::string link;
+        int baudrate = 0;
+        serial_port::PtyPair pty;
+        Clock::time_point reopen_at;  // while hung up
+        Clock::time_point wire_free;  // the last frame is on the wire until then
+        uint64_t received = 0;        // [B] from the node
+        std::vector<Stream> streams;
+    };
+
+    struct Command {
+        int line;
+        std::vector<std::string> args;
+    };
+
+    double seconds(Clock::duration d) {
+        return std::chrono::duration<double>(d).count();
+    }
+
+    Clock::duration duration(double s) {
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(s));
+    }
+
+    // key=value of the stream command
+    bool parseOption(const std::string &arg, StreamOptions &o) {
+
+        const size_t eq = arg.find('=');
+        if (eq == std::string::npos) {
+            return false;
+        }
+
+        const std::string key = arg.substr(0, eq);
+        const char *value = arg.c_str() + eq + 1;
+        char *end;
+
+        if (key == "id") {
+            const long id = strtol(value, &end, 0);
+            o.id = int(id);
+            return *value != '\0' && *end == '\0' && id >= 0 && id <= 255;
+        }
+
+        const double v = strtod(value, &end);
+        if (*value == '\0' || *end != '\0' || !std::isfinite(v)) {
+            return false;
+        }
+
+        if (key == "value") {
+            o.value = v;
+        } else if (key == "noise") {
+            o.noise = v;
+        } else if (key == "estop") {
+            o.estop = v;
+        } else if (key == "drop") {
+            o.drop = v;
+        } else if (key == "corrupt") {
+            o.corrupt = v;
+        } else if (key == "garbage") {
+            o.garbage = v;
+        } else if (key == "jitter") {
+            o.jitter = v;
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+    int16_t saturate(double v) {
+        return int16_t(std::max(-32768.0, std::min(32767.0, std::round(v))));
+    }
+
+}  // namespace
+
+/* class VirtualDevice //{ */
+
+class VirtualDevice {
+public:
+    // false with the error printed if the script is wrong, checked before anything runs
+    bool load(std::istream &script);
+
+    void run();
+
+private:
+    bool check(const Command &command, std::string &error) const;
+
+    void execute(const Command &command);
+
+    // sends the frames due and drains the ports until the deadline
+    void runUntil(Clock::time_point deadline);
+
+    // send_at is when the frame should have gone out, the wire is paced from it rather than from the late wakeup
+    void emit(Port &port, Stream &stream, Clock::time_point now, Clock::time_point send_at);
+
+    void encode(Stream &stream, std::vector<uint8_t> &frame);
+
+    void reopen(Port &port);
+
+    void report(Clock::time_point now);
+
+    double uniform() {
+        return std::uniform_real_distribution<double>(0.0, 1.0)(random_);
+    }
+
+    double gauss(double sigma) {
+        return sigma > 0 ? std::normal_distribution<double>(0.0, sigma)(random_) : 0.0;
+    }
+
+    std::vector<Command> commands_;
+    std::vector<std::unique_ptr<Port>> ports_;
+    std::mt19937_64 random_{1};
+    std::ofstream log_;
+    Clock::time_point last_report_ = Clock::now();
+};
+
+/* load() //{ */
+
+bool VirtualDevice::load(std::istream &script) {
+
+    std::string line;
+    std::vector<std::string> port_names;
+
+    for (int n = 1; std::getline(script, line); n++) {
+
+        line = line.substr(0, line.find('#'));
+
+        Command command{n, {}};
+        std::istringstream words(line);
+        for (std::string word; words >> word;) {
+            command.args.push_back(word);
+        }
+
+        if (command.args.empty()) {
+            continue;
+        }
+
+        if (command.args[0] == "port" && command.args.size() >= 2) {
+            port_names.push_back(command.args[1]);
+        }
+
+        std::string error;
+        if (!check(command, error)) {
+            std::cerr << "line " << n << ": " << error << std::endl;
+            return false;
+        }
+
+        // the ports are created before they are used
+        if (command.args[0] != "port" && command.args[0] != "seed" && command.args[0] != "sleep" && command.args[0] != "report" &&
+            command.args[0] != "log" && std::find(port_names.begin(), port_names.end(), command.args[1]) == port_names.end()) {
+            std::cerr << "line " << n << ": unknown port " << command.args[1] << std::endl;
+            return false;
+        }
+
+        commands_.push_back(command);
+    }
+
+    return true;
+}
+
+//}
+
+/* check() //{ */
+
+bool VirtualDevice::check(const Command &command, std::string &error) const {
+
+    const std::vector<std::string> &args = command.args;
+    const std::string &name = args[0];
+
+    auto number = [&](size_t i, double &value) {
+        char *end;
+        value = strtod(args[i].c_str(), &end);
+        if (*end != '\0' || !std::isfinite(value) || value < 0) {
+            error = "'" + args[i] + "' is not a number of " + name;
+            return false;
+        }
+        return true;
+    };
+
+    double value;
+
+    if (name == "seed") {
+        error = "usage: seed <n>";
+        return args.size() == 2 && number(1, value);
+    }
+
+    if (name == "port") {
+        error = "usage: port <name> <link> [baudrate]";
+        return (args.size() == 3 || (args.size() == 4 && number(3, value)));
+    }
+
+    if (name == "stream") {
+
+        if (args.size() < 4) {
+            error = "usage: stream <port> <type> <rate> [option=value ...]";
+            return false;
+        }
+
+        if (stream_types.count(args[2]) == 0) {
+            error = "unknown stream type " + args[2];
+            return false;
+        }
+
+        if (!number(3, value) || value <= 0) {
+            error = "the rate must be positive";
+            return false;
+        }
+
+        StreamOptions options;
+        for (size_t i = 4; i < args.size(); i++) {
+            if (!parseOption(args[i], options)) {
+                error = "invalid option " + args[i];
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    if (name == "stop") {
+        error = "usage: stop <port> [type]";
+        return args.size() == 2 || args.size() == 3;
+    }
+
+    if (name == "sleep") {
+        error = "usage: sleep <seconds>";
+        return args.size() == 2 && number(1, value);
+    }
+
+    if (name == "hangup") {
+        error = "usage: hangup <port> <seconds>";
+        return args.size() == 3 && number(2, value);
+    }
+
+    if (name == "report") {
+        error = "usage: report";
+        return args.size() == 1;
+    }
+
+    if (name == "log") {
+        error = "usage: log <file>";
+        return args.size() == 2;
+    }
+
+    error = "unknown command " + name;
+    return false;
+}
+
+//}
+
+/* run() //{ */
+
+void VirtualDevice::run() {
+
+    for (const Command &command : commands_) {
+        execute(command);
+    }
+
+    if (commands_.empty() || commands_.back().args[0] != "report") {
+        report(Clock::now());
+    }
+}
+
+//}
+
+/* execute() //{ */
+
+void VirtualDevice::execute(const Command &command) {
+
+    const std::vector<std::string> &args = command.args;
+    const std::string &name = args[0];
+    const Clock::time_point now = Clock::now();
+
+    Port *port = nullptr;
+    if (args.size() >= 2) {
+        for (auto &p : ports_) {
+            if (p->name == args[1]) {
+                port = p.get();
+            }
+        }
+    }
+
+    if (name == "seed") {
+        random_.seed(std::stoull(args[1]));
+
+    } else if (name == "port") {
+
+        if (port) {
+            std::cerr << "line " << command.line << ": port " << args[1] << " exists already" << std::endl;
+            exit(1);
+        }
+
+        auto p = std::make_unique<Port>();
+        p->name = args[1];
+        p->link = args[2];
+        p->baudrate = args.size() == 4 ? std::stoi(args[3]) : 0;
+        reopen(*p);
+        ports_.push_back(std::move(p));
+
+    } else if (name == "stream") {
+
+        Stream stream;
+        stream.type_name = args[2];
+        stream.type = stream_types.at(args[2]);
+        stream.options.rate = std::stod(args[3]);
+
+        for (size_t i = 4; i < args.size(); i++) {
+            parseOption(args[i], stream.options);
+        }
+
+        stream.label = stream.type_name;
+        if (stream.options.id >= 0) {
+            char id[16];
+            snprintf(id, sizeof(id), ":0x%02x", stream.options.id);
+            stream.label += id;
+        }
+
+        stream.scheduled = now;
+        stream.due = now;
+
+        // a changed stream keeps its sequence, statistics and schedule
+        for (Stream &s : port->streams) {
+            if (s.label == stream.label) {
+                s.options = stream.options;
+                return;
+            }
+        }
+
+        port->streams.push_back(stream);
+
+    } else if (name == "stop") {
+
+        for (auto it = port->streams.begin(); it != port->streams.end();) {
+            it = args.size() == 2 || it->type_name == args[2] ? port->streams.erase(it) : it + 1;
+        }
+
+    } else if (name == "sleep") {
+        runUntil(now + duration(std::stod(args[1])));
+
+    } else if (name == "hangup") {
+        port->pty.close();
+        port->reopen_at = now + duration(std::stod(args[2]));
+        printf("%s: hung up for %s s\n", port->name.c_str(), args[2].c_str());
+
+    } else if (name == "report") {
+        report(now);
+
+    } else if (name == "log") {
+
+        log_.close();
+        log_.open(args[1]);
+        if (!log_) {
+            std::cerr << "line " << command.line << ": could not open " << args[1] << std::endl;
+            exit(1);
+        }
+        log_ << "port,type,sequence,wall_time_ns,bytes\n";
+    }
+}
+
+//}
+
+/* reopen() //{ */
+
+void VirtualDevice::reopen(Port &port) {
+
+    if (!port.pty.open(port.link)) {
+        std::cerr << port.name << ": could not create the pty at " << port.link << ": " << strerror(errno) << std::endl;
+        exit(1);
+    }
+
+    // a node that does not read the port must not block the other devices
+    const int fd = port.pty.getDeviceFd();
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    const Clock::time_point now = Clock::now();
+    port.wire_free = now;
+
+    // the frames of the time the port was hung up are lost, not sent late
+    for (Stream &s : port.streams) {
+        if (s.scheduled < now) {
+            s.stats.skipped += uint64_t(seconds(now - s.scheduled) * s.options.rate);
+            s.scheduled = now;
+            s.due = now;
+        }
+    }
+
+    printf("%s: %s -> %s\n", port.name.c_str(), port.link.c_str(), port.pty.getPtsPath().c_str());
+    fflush(stdout);
+}
+
+//}
+
+/* runUntil() //{ */
+
+void VirtualDevice::runUntil(Clock::time_point deadline) {
+
+    std::vector<struct pollfd> fds;
+    std::vector<uint8_t> buffer(4096);
+
+    while (true) {
+
+        Clock::time_point now = Clock::now();
+
+        // everything due, a paced port sends one frame after the other as the wire frees up
+        Clock::time_point next = deadline;
+
+        for (auto &p : ports_) {
+
+            if (!p->pty.isOpen()) {
+                if (p->reopen_at <= now) {
+                    reopen(*p);
+                } else {
+                    next = std::min(next, p->reopen_at);
+                    continue;
+                }
+            }
+
+            while (true) {
+
+                Stream *first = nullptr;
+                for (Stream &s : p->streams) {
+                    if (!first || s.due < first->due) {
+                        first = &s;
+                    }
+                }
+
+                if (!first) {
+                    break;
+                }
+
+                const Clock::time_point send_at = std::max(first->due, p->wire_free);
+                if (send_at > now) {
+                    next = std::min(next, send_at);
+                    break;
+                }
+
+                emit(*p, *first, now, send_at);
+            }
+        }
+
+        if (now >= deadline) {
+            return;
+        }
+
+        // the data from the nodes are drained while waiting
+        fds.clear();
+        for (auto &p : ports_) {
+            if (p->pty.isOpen()) {
+                fds.push_back({p->pty.getDeviceFd(), POLLIN, 0});
+            }
+        }
+
+        const double wait = seconds(next - Clock::now());
+        struct timespec timeout{};
+        if (wait > 0) {
+            timeout.tv_sec = time_t(wait);
+            timeout.tv_nsec = long((wait - timeout.tv_sec) * 1e9);
+        }
+
+        if (ppoll(fds.data(), fds.size(), &timeout, nullptr) <= 0) {
+            continue;
+        }
+
+        for (auto &p : ports_) {
+            if (!p->pty.isOpen()) {
+                continue;
+            }
+            int n;
+            while ((n = read(p->pty.getDeviceFd(), buffer.data(), buffer.size())) > 0) {
+                p->received += n;
+            }
+        }
+    }
+}
+
+//}
+
+/* emit() //{ */
+
+void VirtualDevice::emit(Port &port, Stream &stream, Clock::time_point now, Clock::time_point send_at) {
+
+    const StreamOptions &o = stream.options;
+    const Clock::duration period = duration(1.0 / o.rate);
+
+    // the schedule does not drift with the jitter
+    stream.scheduled += period;
+    if (seconds(now - stream.scheduled) > MAX_LAG) {
+        const uint64_t behind = uint64_t(seconds(now - stream.scheduled) * o.rate);
+        stream.stats.skipped += behind;
+        stream.scheduled += behind * period;
+    }
+    stream.due = stream.scheduled + duration(o.jitter * uniform());
+
+    if (uniform() < o.drop) {
+        stream.stats.dropped++;
+        stream.sequence++;
+        return;
+    }
+
+    std::vector<uint8_t> frame;
+
+    if (uniform() < o.garbage) {
+        const int n = 1 + int(uniform() * 16);
+        for (int i = 0; i < n; i++) {
+            frame.push_back(uint8_t(random_()));
+        }
+    }
+
+    encode(stream, frame);
+
+    if (o.corrupt > 0) {
+        for (uint8_t &byte : frame) {
+            if (uniform() < o.corrupt) {
+                byte ^= uint8_t(1 << (random_() % 8));
+            }
+        }
+    }
+
+    const int written = write(port.pty.getDeviceFd(), frame.data(), frame.size());
+    const size_t sent = std::max(written, 0);
+
+    stream.stats.frames++;
+    stream.stats.bytes += sent;
+    stream.stats.overflow += frame.size() - sent;
+
+    if (port.baudrate > 0) {
+        port.wire_free = std::max(port.wire_free, send_at) + duration(frame.size() * 10.0 / port.baudrate);
+    }
+
+    if (log_.is_open()) {
+        struct timespec ts{};
+        clock_gettime(CLOCK_REALTIME, &ts);
+        log_ << port.name << ',' << stream.label << ',' << stream.sequence << ',' << (uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec) << ','
+             << sent << '\n';
+    }
+
+    stream.sequence++;
+}
+
+//}
+
+/* encode() //{ */
+
+void VirtualDevice::encode(Stream &stream, std::vector<uint8_t> &frame) {
+
+    namespace messages = baca_protocol::messages;
+
+    const StreamOptions &o = stream.options;
+
+    auto append = [&frame](const auto &bytes) { frame.insert(frame.end(), bytes.begin(), bytes.end()); };
+
+    switch (stream.type) {
+
+        case GARMIN: {
+            auto payload = messages::GarminRange::payload(o.id >= 0 ? o.id : 0x00);
+            const double range = std::isnan(o.value) ? 2.0 : o.value;
+            messages::GarminRange::range::write(payload.data(), saturate((range + gauss(o.noise)) * 100.0));
+            append(messages::GarminRange::frame(payload));
+            break;
+        }
+
+        case VIO_IMU: {
+            using Imu = messages::VioImuData;
+            auto payload = Imu::payload(o.id >= 0 ? o.id : 0x30);
+            const double acc_z = std::isnan(o.value) ? 1.0 : o.value;
+            Imu::acc_x::write(payload.data(), saturate(gauss(o.noise) * 4096.0));
+            Imu::acc_y::write(payload.data(), saturate(gauss(o.noise) * 4096.0));
+            Imu::acc_z::write(payload.data(), saturate((acc_z + gauss(o.noise)) * 4096.0));
+            Imu::gyro_x::write(payload.data(), saturate(gauss(o.noise) * 65.536));
+            Imu::gyro_y::write(payload.data(), saturate(gauss(o.noise) * 65.536));
+            Imu::gyro_z::write(payload.data(), saturate(gauss(o.noise) * 65.536));
+            append(Imu::frame(payload));
+            break;
+        }
+
+        case NMEA: {
+
+            const double lat = 50.0 + gauss(o.noise) / 111320.0;
+            const double lon = 14.0 + gauss(o.noise) / (111320.0 * std::cos(50.0 * M_PI / 180.0));
+
+            const time_t t = time(nullptr);
+            struct tm utc{};
+            gmtime_r(&t, &utc);
+
+            char body[128];
+            snprintf(body, sizeof(body), "GPGGA,%02d%02d%02d.00,%02d%08.5f,N,%03d%08.5f,E,4,12,0.8,300.000,M,45.000,M,1,0000", utc.tm_hour, utc.tm_min,
+                     utc.tm_sec, int(lat), (lat - int(lat)) * 60.0, int(lon), (lon - int(lon)) * 60.0);
+
+            uint8_t checksum = 0;
+            for (const char *c = body; *c; c++) {
+                checksum ^= uint8_t(*c);
+            }
+
+            char sentence[160];
+            const int len = snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, checksum);
+            frame.insert(frame.end(), sentence, sentence + len);
+            break;
+        }
+
+        case XBEE: {
+
+            // AT command response to IS (the poll of the estop), DIO1 is the estop button
+            const uint8_t dio = uniform() < o.estop ? 0x02 : 0x00;
+            const std::vector<uint8_t> data = {0x88, 0x01, 'I', 'S', 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, dio};
+
+            uint8_t sum = 0;
+            for (const uint8_t b : data) {
+                sum += b;
+            }
+
+            frame.push_back(0x7E);
+            frame.push_back(uint8_t(data.size() >> 8));
+            frame.push_back(uint8_t(data.size()));
+            append(data);
+            frame.push_back(uint8_t(0xFF - sum));
+            break;
+        }
+
+        case SBGC: {
+
+            // little-endian, in the order of SBGC_cmd_realtime_data_custom_unpack()
+            std::vector<uint8_t> payload;
+            auto word = [&payload](int16_t w) {
+                payload.push_back(uint8_t(w));
+                payload.push_back(uint8_t(uint16_t(w) >> 8));
+            };
+            auto real = [&payload](float f) {
+                uint8_t bytes[4];
+                memcpy(bytes, &f, 4);
+                payload.insert(payload.end(), bytes, bytes + 4);
+            };
+
+            // 0.02197265625 deg per unit
+            const double pitch = std::isnan(o.value) ? 0.0 : o.value;
+            const double units = 1.0 / 0.02197265625;
+
+            word(int16_t(stream.sequence));  // timestamp
+            for (int i = 0; i < 3; i++) {    // target speed
+                word(0);
+            }
+            word(saturate(gauss(o.noise) * units));            // roll
+            word(saturate((pitch + gauss(o.noise)) * units));  // pitch
+            word(saturate(gauss(o.noise) * units));            // yaw
+            for (const float f : {0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f}) {  // z and h vector
+                real(f);
+            }
+
+            uint8_t checksum = 0;
+            for (const uint8_t b : payload) {
+                checksum += b;
+            }
+
+            frame.push_back('>');
+            frame.push_back(SBGC_CMD_REALTIME_DATA_CUSTOM);
+            frame.push_back(uint8_t(payload.size()));
+            frame.push_back(uint8_t(SBGC_CMD_REALTIME_DATA_CUSTOM + payload.size()));
+            append(payload);
+            frame.push_back(checksum);
+            break;
+        }
+    }
+}
+
+//}
+
+/* report() //{ */
+
+void VirtualDevice::report(Clock::time_point now) {
+
+    const double elapsed = std::max(seconds(now - last_report_), 1e-9);
+    last_report_ = now;
+
+    printf("report over %.2f s:\n", elapsed);
+
+    for (auto &p : ports_) {
+
+        printf("  %s: received %lu B\n", p->name.c_str(), (unsigned long)p->received);
+        p->received = 0;
+
+        for (Stream &s : p->streams) {
+            const StreamStats &st = s.stats;
+            printf("    %-12s %9.1f Hz %10lu frames %12lu B  dropped %lu  skipped %lu  overflow %lu B\n", s.label.c_str(), st.frames / elapsed,
+                   (unsigned long)st.frames, (unsigned long)st.bytes, (unsigned long)st.dropped, (unsigned long)st.skipped, (unsigned long)st.overflow);
+            s.stats = StreamStats();
+        }
+    }
+
+    fflush(stdout);
+
+    if (log_.is_open()) {
+        log_.flush();
+    }
+}
+
+//}
+
+//}
+
+/* main() //{ */
+
+int main(int argc, char **argv) {
+
+    if (argc != 2) {
+        std::cerr << "usage: virtual_device <script> (- for stdin)" << std::endl;
+        return 1;
+    }
+
+    VirtualDevice device;
+
+    std::ifstream file;
+    std::istream *script = &std::cin;
+    if (std::string(argv[1]) != "-") {
+        file.open(argv[1]);
+        if (!file) {
+            std::cerr << "could not open " << argv[1] << std::endl;
+            return 1;
+        }
+        script = &file;
+    }
+
+    if (!device.load(*script)) {
+        return 1;
+    }
+
+    device.run();
+
+    return 0;
+}
+
+//}
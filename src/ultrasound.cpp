@@ -3,25 +3,37 @@
 #include <ros/package.h>
 #include <stdlib.h>
 #include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <sensor_msgs/Range.h>
+#include <mrs_serial/ClockSyncStatus.h>
 #include <std_msgs/Char.h>
 #include <std_srvs/SetBool.h>
 #include <std_srvs/SetBool.h>
 #include <mrs_msgs/SetInt.h>
 #include <std_msgs/Empty.h>
 #include <mutex>
+#include <chrono>
 
 #include <string>
 #include <mrs_msgs/BacaProtocol.h>
 #include <mrs_msgs/SerialRaw.h>
 
 #include <serial_port.h>
+#include <serial_reactor.h>
+#include <device_discovery.h>
+#include <port_supervisor.h>
+#include <serial_transmitter.h>
+#include <message_pool.h>
+#include <baca_framer.h>
+#include <baca_dispatcher.h>
+#include <baca_messages.h>
+#include <link_stats.h>
+#include <baca_clock_sync.h>
+#include <baca_batcher.h>
 
 #include <nodelet/nodelet.h>
 #include <pluginlib/class_list_macros.h>
 
-#define BUFFER_SIZE 256
-
 #define MAX_RANGE 764  // cm
 #define MIN_RANGE 21   // cm
 
@@ -38,21 +50,19 @@ public:
   virtual void onInit();
 
 private:
-  enum serial_receiver_state
-  {
-    WAITING_FOR_MESSSAGE,
-    EXPECTING_SIZE,
-    EXPECTING_PAYLOAD,
-    EXPECTING_CHECKSUM
-  };
-
-
   ros::Timer serial_timer_;
   ros::Timer maintainer_timer_;
+  ros::Timer diagnostics_timer_;
+  ros::Timer clock_sync_timer_;
+  ros::Timer batch_timer_;
 
-  void interpretSerialData(uint8_t data);
+  void interpretFrame(const baca_protocol::BacaFrame &frame);
+  void callbackSerialData(const uint8_t *data, int len);
   void callbackSerialTimer(const ros::TimerEvent &event);
   void callbackMaintainerTimer(const ros::TimerEvent &event);
+  void callbackDiagnosticsTimer(const ros::TimerEvent &event);
+  void callbackClockSyncTimer(const ros::TimerEvent &event);
+  void callbackBatchTimer(const ros::TimerEvent &event);
 
   bool callbackAll(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res);
   bool callbackUltrasound(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res);
@@ -60,43 +70,92 @@ private:
 
   void callbackSendRawMessage(const mrs_msgs::SerialRawConstPtr &msg);
 
-  uint8_t connectToSensor(void);
-  void    processMessage(uint8_t payload_size, uint8_t *input_buffer, uint8_t checksum, uint8_t checksum_rec, bool checksum_correct);
+  void    processClockSyncPong(const baca_protocol::BacaFrame &frame);
+  void    processUltrasound(const baca_protocol::BacaFrame &frame);
+  void    processGeneric(const baca_protocol::BacaFrame &frame);
 
   ros::NodeHandle nh_;
   ros::Publisher  range_publisher;
 
   ros::Publisher status_publisher;
   ros::Publisher baca_protocol_publisher_;
+  ros::Publisher baca_protocol_batch_publisher_;
+  ros::Publisher clock_sync_publisher_;
+  ros::Publisher diagnostics_publisher_;
   /* ros::Publisher baca_protocol_debug_publisher_; */
 
   ros::Subscriber raw_message_subscriber;
 
   serial_port::SerialPort serial_port_;
+  serial_port::SerialReactor serial_reactor_;
+  serial_port::SerialTransmitter serial_transmitter_{&serial_port_};
+  baca_protocol::BacaFramer baca_framer_;
+  baca_protocol::BacaDispatcher baca_dispatcher_;
+
+  // frame counters and latencies of the link, published on /diagnostics
+  serial_port::LinkStats link_stats_;
+
+  // stamps the measurements with the device clock mapped to ROS time
+  baca_protocol::ClockSync clock_sync_;
+
+  // published messages are recycled once the subscribers release them
+  serial_port::MessagePool<sensor_msgs::Range>     range_pool_;
+  serial_port::MessagePool<mrs_msgs::BacaProtocol> baca_protocol_pool_;
+
+  baca_protocol::BacaBatcher baca_batcher_;
 
   boost::function<void(uint8_t)> serial_data_callback_function_;
 
   bool publish_bad_checksum;
   bool use_timeout;
 
-  uint16_t received_msg_ok           = 0;
-  uint16_t received_msg_ok_ultra     = 0;
-  uint16_t received_msg_bad_checksum = 0;
 
   int serial_rate_        = 5000;
   int serial_buffer_size_ = 1024;
 
+  bool use_reactor_        = true;
+  bool use_shared_reactor_ = true;
+  bool use_hotplug_        = true;
+  bool use_reader_thread_  = false;
+  int  reader_ring_size_   = 65536;
+  bool use_io_uring_       = false;
+
+  int reconnect_backoff_min_ms_ = 100;
+  int reconnect_backoff_max_ms_ = 5000;
+
+  bool low_latency_      = true;
+  int  latency_timer_ms_ = 1;
+
+  int tx_queue_depth_        = 64;
+  int tx_kernel_queue_limit_ = 64;
+
+  bool resync_on_bad_checksum_ = true;
+
+  double diagnostics_rate_ = 1.0;
+
+  bool use_clock_sync_        = false;
+  int  clock_sync_rate_       = 10;
+  int  clock_sync_window_     = 32;
+  int  clock_sync_max_rtt_us_ = 10000;
+
+  bool use_batching_     = false;
+  int  batch_max_frames_ = 50;
+  int  batch_window_us_  = 20000;
+
   std::string portname_;
   int         baudrate_;
   std::string uav_name_;
 
-  std::mutex mutex_msg;
+  // looks the port up by the usb identity of the device instead, when set
+  serial_port::UsbDeviceFilter device_filter_;
+  std::string range_frame_;
 
-  ros::Time interval_      = ros::Time::now();
-  ros::Time last_received_ = ros::Time::now();
+  std::mutex mutex_msg;
 
-  bool is_connected_   = false;
   bool is_initialized_ = false;
+
+  // keeps the port open and publishes the state of the connection, declared last so that its threads stop first
+  serial_port::PortSupervisor port_supervisor_{&serial_port_};
 };
 
 //}
@@ -112,15 +171,47 @@ void Ultrasound::onInit() {
 
   nh_.param("uav_name", uav_name_, std::string("uav"));
   nh_.param("portname", portname_, std::string("/dev/ttyUSB0"));
+  nh_.param("device_vid", device_filter_.vid, std::string(""));
+  nh_.param("device_pid", device_filter_.pid, std::string(""));
+  nh_.param("device_serial", device_filter_.serial, std::string(""));
+  nh_.param("device_usb_path", device_filter_.usb_path, std::string(""));
   nh_.param("baudrate", baudrate_, 115200);
   nh_.param("publish_bad_checksum", publish_bad_checksum, false);
   nh_.param("use_timeout", use_timeout, true);
   nh_.param("serial_rate", serial_rate_, 5000);
   nh_.param("serial_buffer_size", serial_buffer_size_, 1024);
+  nh_.param("use_reactor", use_reactor_, true);
+  nh_.param("use_shared_reactor", use_shared_reactor_, true);
+  nh_.param("use_hotplug", use_hotplug_, true);
+  nh_.param("reconnect_backoff_min_ms", reconnect_backoff_min_ms_, 100);
+  nh_.param("reconnect_backoff_max_ms", reconnect_backoff_max_ms_, 5000);
+  nh_.param("use_reader_thread", use_reader_thread_, false);
+  nh_.param("reader_ring_size", reader_ring_size_, 65536);
+  nh_.param("use_io_uring", use_io_uring_, false);
+  nh_.param("low_latency", low_latency_, true);
+  nh_.param("latency_timer_ms", latency_timer_ms_, 1);
+  nh_.param("tx_queue_depth", tx_queue_depth_, 64);
+  nh_.param("tx_kernel_queue_limit", tx_kernel_queue_limit_, 64);
+  nh_.param("resync_on_bad_checksum", resync_on_bad_checksum_, true);
+  nh_.param("diagnostics_rate", diagnostics_rate_, 1.0);
+  nh_.param("use_clock_sync", use_clock_sync_, false);
+  nh_.param("clock_sync_rate", clock_sync_rate_, 10);
+  nh_.param("clock_sync_window", clock_sync_window_, 32);
+  nh_.param("clock_sync_max_rtt_us", clock_sync_max_rtt_us_, 10000);
+  nh_.param("use_batching", use_batching_, false);
+  nh_.param("batch_max_frames", batch_max_frames_, 50);
+  nh_.param("batch_window_us", batch_window_us_, 20000);
 
   // Publishers
   baca_protocol_publisher_ = nh_.advertise<mrs_msgs::BacaProtocol>("baca_protocol_out", 1);
+
+  // generic messages of high-rate streams are published in batches instead of one by one
+  if (use_batching_) {
+    baca_protocol_batch_publisher_ = nh_.advertise<mrs_serial::BacaProtocolArray>("baca_protocol_batch_out", 10);
+    baca_batcher_.init(baca_protocol_batch_publisher_, batch_max_frames_, ros::Duration(batch_window_us_ * 1e-6));
+  }
   range_publisher          = nh_.advertise<sensor_msgs::Range>("range", 1);
+  range_frame_             = uav_name_ + "/ultrasound";
 
   raw_message_subscriber = nh_.subscribe("raw_in", 10, &Ultrasound::callbackSendRawMessage, this, ros::TransportHints().tcpNoDelay());
 
@@ -128,14 +219,86 @@ void Ultrasound::onInit() {
   ROS_INFO_THROTTLE(1.0, "[%s] test test:", ros::this_node::getName().c_str());
   ROS_INFO_THROTTLE(1.0, "[%s] is up and running with the following parameters:", ros::this_node::getName().c_str());
   ROS_INFO_THROTTLE(1.0, "[%s] portname: %s", ros::this_node::getName().c_str(), portname_.c_str());
+  if (!device_filter_.empty()) {
+    ROS_INFO_THROTTLE(1.0, "[%s] device: %s", ros::this_node::getName().c_str(), device_filter_.toString().c_str());
+  }
   ROS_INFO_THROTTLE(1.0, "[%s] baudrate: %i", ros::this_node::getName().c_str(), baudrate_);
   ROS_INFO_STREAM_THROTTLE(1.0, "[" << ros::this_node::getName().c_str() << "] publishing messages with wrong checksum: " << publish_bad_checksum);
 
-  connectToSensor();
+  // the reactor delivers the data as soon as the port becomes readable, polling timer is only a fallback
+  if (use_reactor_) {
+    // one I/O thread for all nodelets of the manager, the data are read and handled in the callback queue of this nodelet
+    if (use_shared_reactor_) {
+      serial_reactor_.setCallbackQueue(&getMTCallbackQueue());
+      serial_reactor_.startShared();
+    } else {
+      serial_reactor_.start();
+    }
+  }
+
+  // outbound frames are written by one thread in the order of their priority
+  serial_transmitter_.start(tx_queue_depth_, tx_kernel_queue_limit_);
+
+  // drain the port from a dedicated thread, so that slow callbacks cannot overrun the kernel buffer
+  if (use_reader_thread_) {
+    serial_port_.enableReaderThread(reader_ring_size_);
+  }
+
+  // io_uring for the reads of the reader thread and the frames of the transmitter, poll() and write() where the kernel does not have it
+  serial_port_.setIoUring(use_io_uring_);
+
+  // small frames would otherwise wait up to 16 ms in the buffer of an FTDI adapter
+  serial_port_.setLowLatency(low_latency_, latency_timer_ms_);
+
+  // rescan the bytes of a frame with a bad checksum, a false start byte in noise would otherwise swallow the following good frames
+  baca_framer_.setResync(resync_on_bad_checksum_);
+
+  clock_sync_.init(clock_sync_window_, 4, clock_sync_max_rtt_us_ * 1e-6);
+
+  // handlers of the messages this node understands, everything else is published as a generic BacaProtocol message
+  baca_dispatcher_.registerHandler<baca_protocol::messages::UltrasoundRange>([this](const baca_protocol::BacaFrame &frame) { processUltrasound(frame); });
+  baca_dispatcher_.registerHandler<baca_protocol::messages::UltrasoundRangeStamped>([this](const baca_protocol::BacaFrame &frame) { processUltrasound(frame); });
+  // without clock sync, 0x73 stays free for the messages of the device
+  if (use_clock_sync_) {
+    baca_dispatcher_.registerHandler<baca_protocol::messages::ClockSyncPong>([this](const baca_protocol::BacaFrame &frame) { processClockSyncPong(frame); });
+  }
+  baca_dispatcher_.setDefaultHandler([this](const baca_protocol::BacaFrame &frame) { processGeneric(frame); });
+
+  serial_port::PortSupervisor::Options port_options;
+  port_options.portname      = portname_;
+  port_options.device_filter = device_filter_;
+  port_options.baudrate      = baudrate_;
+  port_options.buffer_size   = serial_buffer_size_;
+  port_options.use_timeout   = use_timeout;
+  port_options.timeout       = MAXIMAL_TIME_INTERVAL;
+  port_options.backoff_min   = reconnect_backoff_min_ms_ * 1e-3;
+  port_options.backoff_max   = reconnect_backoff_max_ms_ * 1e-3;
+  port_options.use_hotplug   = use_hotplug_;
+
+  port_supervisor_.start(nh_, port_options, use_reactor_ ? &serial_reactor_ : nullptr,
+                         [this](const uint8_t *data, int len) { callbackSerialData(data, len); });
+
+  if (!use_reactor_) {
+    serial_timer_ = nh_.createTimer(ros::Rate(serial_rate_), &Ultrasound::callbackSerialTimer, this);
+  }
 
-  serial_timer_     = nh_.createTimer(ros::Rate(serial_rate_), &Ultrasound::callbackSerialTimer, this);
   maintainer_timer_ = nh_.createTimer(ros::Rate(1), &Ultrasound::callbackMaintainerTimer, this);
 
+  if (diagnostics_rate_ > 0) {
+    diagnostics_publisher_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
+    diagnostics_timer_     = nh_.createTimer(ros::Rate(diagnostics_rate_), &Ultrasound::callbackDiagnosticsTimer, this);
+  }
+
+  // the device answers the pings with its clock, measurements carrying the clock are then stamped with it
+  if (use_clock_sync_) {
+    clock_sync_publisher_ = nh_.advertise<mrs_serial::ClockSyncStatus>("clock_sync", 10);
+    clock_sync_timer_     = nh_.createTimer(ros::Rate(clock_sync_rate_), &Ultrasound::callbackClockSyncTimer, this);
+  }
+
+  if (use_batching_) {
+    batch_timer_ = nh_.createTimer(ros::Duration(batch_window_us_ * 1e-6), &Ultrasound::callbackBatchTimer, this);
+  }
+
   is_initialized_ = true;
 }
 //}
@@ -153,49 +316,96 @@ void Ultrasound::callbackSerialTimer(const ros::TimerEvent &event) {
 
   bytes_read = serial_port_.readSerial(read_buffer, serial_buffer_size_);
 
+  if (bytes_read > 0) {
+    callbackSerialData(read_buffer, bytes_read);
+  }
+}
+
+//}
+
+/* callbackSerialData() //{ */
+
+void Ultrasound::callbackSerialData(const uint8_t *data, int len) {
+
+  const uint64_t zero_size_before = baca_framer_.stats().frames_zero_size;
+  const uint64_t recovered_before = baca_framer_.stats().frames_recovered;
+
+  baca_framer_.decode(data, len, [this](const baca_protocol::BacaFrame &frame) { interpretFrame(frame); });
+
+  const baca_protocol::BacaFramerStats &stats = baca_framer_.stats();
+  link_stats_.setDecoderTotals(stats.bytes, stats.frames_ok, stats.frames_bad_checksum, stats.frames_zero_size, stats.frames_recovered);
+
+  if (baca_framer_.stats().frames_zero_size != zero_size_before) {
+    ROS_ERROR_THROTTLE(1.0, "[%s]: Message with 0 payload_size received, discarding.", ros::this_node::getName().c_str());
+  }
 
-  for (int i = 0; i < bytes_read; i++) {
-    interpretSerialData(read_buffer[i]);
+  if (baca_framer_.stats().frames_recovered != recovered_before) {
+    ROS_WARN_STREAM_THROTTLE(1.0, "[" << ros::this_node::getName().c_str() << "] Resynchronized after a bad checksum, "
+                                      << baca_framer_.stats().frames_recovered << " frames recovered so far");
   }
-  /* processMessage */
 }
 
 //}
 
-/* callbackMaintainerTimer() //{ */
+/* callbackBatchTimer() //{ */
 
-void Ultrasound::callbackMaintainerTimer(const ros::TimerEvent &event) {
+// publishes the last batch when the stream stops before the batch fills up
+void Ultrasound::callbackBatchTimer(const ros::TimerEvent &event) {
+  baca_batcher_.flushStale(ros::Time::now());
+}
 
-  if (is_connected_) {
+//}
 
-    if (!serial_port_.checkConnected()) {
-      is_connected_ = false;
-      ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial device is disconnected! ");
-    }
+/* callbackClockSyncTimer() //{ */
+
+void Ultrasound::callbackClockSyncTimer(const ros::TimerEvent &event) {
+
+  if (!port_supervisor_.isConnected()) {
+    return;
   }
 
-  if (((ros::Time::now() - last_received_).toSec() > MAXIMAL_TIME_INTERVAL) && use_timeout && is_connected_) {
+  const auto ping = clock_sync_.makePing(ros::Time::now());
+
+  // the round trip is measured from now, so the ping must not wait behind other frames
+  serial_transmitter_.send(ping.data(), ping.size(), serial_port::TX_SAFETY);
+}
+
+//}
+
+/* callbackDiagnosticsTimer() //{ */
 
-    is_connected_ = false;
+void Ultrasound::callbackDiagnosticsTimer(const ros::TimerEvent &event) {
 
-    ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial port timed out - no messages were received in " << MAXIMAL_TIME_INTERVAL
-                         << " seconds");
+  // replaced on reconnect when the port is looked up by its usb identity
+  const std::string portname = port_supervisor_.getPortname();
+
+  // kernel counters, to tell data lost in the driver from noise on the line
+  link_stats_.setUartCounters(serial_port_.getUartCounters());
+  link_stats_.setLowLatencyState(serial_port_.getLowLatencyState());
+
+  const diagnostic_msgs::DiagnosticArray diagnostics =
+      link_stats_.makeDiagnostics(ros::this_node::getName() + ": serial link", portname, port_supervisor_.isConnected(), ros::Time::now());
+
+  try {
+    diagnostics_publisher_.publish(diagnostics);
   }
+  catch (...) {
+    ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", diagnostics_publisher_.getTopic().c_str());
+  }
+}
 
-  if (is_connected_) {
+//}
 
-    ROS_INFO_STREAM("Got msgs - Ultrasound: " << received_msg_ok_ultra << " Generic msg: " << received_msg_ok << "  Wrong checksum: "
-                                              << received_msg_bad_checksum << "; in the last " << (ros::Time::now() - interval_).toSec() << " s");
-    received_msg_ok_ultra     = 0;
-    received_msg_ok           = 0;
-    received_msg_bad_checksum = 0;
+/* callbackMaintainerTimer() //{ */
 
-    interval_ = ros::Time::now();
+void Ultrasound::callbackMaintainerTimer(const ros::TimerEvent &event) {
 
-  } else {
+  if (port_supervisor_.isConnected()) {
 
-    connectToSensor();
+    ROS_INFO_STREAM_THROTTLE(10.0, "[" << ros::this_node::getName().c_str() << "] Tx queue: " << serial_transmitter_.getStatsSummary());
   }
+
+  port_supervisor_.checkConnection();
 }
 
 //}
@@ -208,11 +418,8 @@ void Ultrasound::callbackSendRawMessage(const mrs_msgs::SerialRawConstPtr &msg)
     return;
   }
 
-  uint8_t payload_size = msg->payload.size();
-  uint8_t out_buffer[payload_size];
-
   ROS_INFO_STREAM("SENDING");
-  serial_port_.sendCharArray(out_buffer, payload_size);
+  serial_transmitter_.send(msg->payload.data(), msg->payload.size(), serial_port::TX_BULK);
 }
 
 //}
@@ -220,145 +427,118 @@ void Ultrasound::callbackSendRawMessage(const mrs_msgs::SerialRawConstPtr &msg)
 
 // | ------------------------ routines ------------------------ |
 
-/* interpretSerialData() //{ */
-
-void Ultrasound::interpretSerialData(uint8_t single_character) {
-
-  static serial_receiver_state rec_state    = WAITING_FOR_MESSSAGE;
-  static uint8_t               payload_size = 0;
-  static uint8_t               input_buffer[BUFFER_SIZE];
-  static uint8_t               buffer_counter = 0;
-  static uint8_t               checksum       = 0;
-
-  switch (rec_state) {
-    case WAITING_FOR_MESSSAGE:
-
-      if (single_character == 'b' ||
-          single_character == 'a') {  // the 'a' is there for backwards-compatibility, going forwards all messages should start with 'b'
-        checksum       = single_character;
-        buffer_counter = 0;
-        rec_state      = EXPECTING_SIZE;
-      }
-      break;
-
-    case EXPECTING_SIZE:
-
-      if (single_character == 0) {
-        ROS_ERROR_THROTTLE(1.0, "[%s]: Message with 0 payload_size received, discarding.", ros::this_node::getName().c_str());
-        rec_state = WAITING_FOR_MESSSAGE;
-      } else {
-        payload_size = single_character;
-        checksum += single_character;
-        rec_state = EXPECTING_PAYLOAD;
-      }
-      break;
-
-    case EXPECTING_PAYLOAD:
-
-      input_buffer[buffer_counter] = single_character;
-      checksum += single_character;
-      buffer_counter++;
-      if (buffer_counter >= payload_size) {
-        rec_state = EXPECTING_CHECKSUM;
-      }
-      break;
-
-    case EXPECTING_CHECKSUM:
-
-      if (checksum == single_character) {
-        processMessage(payload_size, input_buffer, checksum, single_character, true);
-        last_received_ = ros::Time::now();
-        rec_state      = WAITING_FOR_MESSSAGE;
-      } else {
-        if (publish_bad_checksum) {
-          processMessage(payload_size, input_buffer, checksum, single_character, false);
-        }
-        received_msg_bad_checksum++;
-        rec_state = WAITING_FOR_MESSSAGE;
-      }
-      break;
+/* interpretFrame() //{ */
+
+void Ultrasound::interpretFrame(const baca_protocol::BacaFrame &frame) {
+
+  const auto parsed = std::chrono::steady_clock::now();
+
+  if (frame.checksum_correct) {
+    baca_dispatcher_.dispatch(frame);
+    const ros::Time now = ros::Time::now();
+    port_supervisor_.dataReceived(now);
+    link_stats_.recordFrame(frame.messageId(), std::chrono::duration<double>(std::chrono::steady_clock::now() - parsed).count(),
+                            (now - serial_port_.getByteStamp(frame.bytes_after)).toSec());
+  } else if (publish_bad_checksum) {
+    baca_dispatcher_.dispatch(frame);
   }
 }
 
 //}
 
-/* processMessage() //{ */
+/* processUltrasound() //{ */
 
-void Ultrasound::processMessage(uint8_t payload_size, uint8_t *input_buffer, uint8_t checksum, uint8_t checksum_rec, bool checksum_correct) {
+void Ultrasound::processUltrasound(const baca_protocol::BacaFrame &frame) {
 
-  if (payload_size == 3 && (input_buffer[0] == 0x33) && checksum_correct) {
-    /* Special message reserved for ultrasound rangefinder */
-    received_msg_ok_ultra++;
-    uint8_t message_id = input_buffer[0];
-    int16_t range      = input_buffer[1] << 8;
-    range |= input_buffer[2];
+  using baca_protocol::messages::UltrasoundRange;
+  using baca_protocol::messages::UltrasoundRangeStamped;
 
-    sensor_msgs::Range range_msg;
-    range_msg.field_of_view  = 0.26;  // +-15 degree
-    range_msg.max_range      = MAX_RANGE * 0.01;
-    range_msg.min_range      = MIN_RANGE * 0.01;
-    range_msg.radiation_type = sensor_msgs::Range::INFRARED;
-    range_msg.header.stamp   = ros::Time::now();
+  // measurements carrying the device clock are stamped with it once the clock is synchronized, the rest with the arrival of their last byte
+  ros::Time stamp = serial_port_.getByteStamp(frame.bytes_after);
+  if (UltrasoundRangeStamped::matches(frame)) {
+    clock_sync_.toHostTime(UltrasoundRangeStamped::tick::read(frame.payload), stamp);
+  }
 
-    range_msg.range = range * 0.01;  // convert to m
+  int16_t range = UltrasoundRange::range::read(frame.payload);
 
-    if (range > MAX_RANGE) {
-      range_msg.range = std::numeric_limits<double>::infinity();
-    } else if (range < MIN_RANGE) {
-      range_msg.range = -std::numeric_limits<double>::infinity();
-    }
+  boost::shared_ptr<sensor_msgs::Range> range_msg = range_pool_.acquire();
+  range_msg->field_of_view  = 0.26;  // +-15 degree
+  range_msg->max_range      = MAX_RANGE * 0.01;
+  range_msg->min_range      = MIN_RANGE * 0.01;
+  range_msg->radiation_type = sensor_msgs::Range::INFRARED;
+  range_msg->header.stamp   = stamp;
 
-    range_msg.header.frame_id = uav_name_ + "/ultrasound";
+  range_msg->range = UltrasoundRange::range::get(frame.payload);  // convert to m
 
-    try {
-      range_publisher.publish(range_msg);
-    }
-    catch (...) {
-      ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", range_publisher.getTopic().c_str());
-    }
+  if (range > MAX_RANGE) {
+    range_msg->range = std::numeric_limits<double>::infinity();
+  } else if (range < MIN_RANGE) {
+    range_msg->range = -std::numeric_limits<double>::infinity();
+  }
 
-  } else {
-    /* General serial message */
+  range_msg->header.frame_id = range_frame_;
 
-    if (checksum_correct) {
-      received_msg_ok++;
-    }
-    mrs_msgs::BacaProtocol msg;
-    msg.stamp = ros::Time::now();
-    for (uint8_t i = 0; i < payload_size; i++) {
-      msg.payload.push_back(input_buffer[i]);
-    }
-    msg.checksum_received   = checksum_rec;
-    msg.checksum_calculated = checksum;
-    msg.checksum_correct    = checksum_correct;
-    try {
-      baca_protocol_publisher_.publish(msg);
-    }
-    catch (...) {
-      ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", baca_protocol_publisher_.getTopic().c_str());
-    }
+  try {
+    range_publisher.publish(sensor_msgs::RangeConstPtr(range_msg));
+  }
+  catch (...) {
+    ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", range_publisher.getTopic().c_str());
   }
 }
 
 //}
 
-/* connectToSensors() //{ */
+/* processGeneric() //{ */
 
-uint8_t Ultrasound::connectToSensor(void) {
+void Ultrasound::processGeneric(const baca_protocol::BacaFrame &frame) {
 
-  ROS_INFO_THROTTLE(1.0, "[%s]: Openning the serial port.", ros::this_node::getName().c_str());
+  if (use_batching_) {
+    baca_batcher_.add(frame, serial_port_.getByteStamp(frame.bytes_after));
+    return;
+  }
 
-  if (!serial_port_.connect(portname_, baudrate_)) {
-    ROS_ERROR_THROTTLE(1.0, "[%s]: Could not connect to sensor.", ros::this_node::getName().c_str());
-    is_connected_ = false;
-    return 0;
+  boost::shared_ptr<mrs_msgs::BacaProtocol> msg = baca_protocol_pool_.acquire();
+  msg->stamp = serial_port_.getByteStamp(frame.bytes_after);
+  msg->payload.assign(frame.payload, frame.payload + frame.payload_size);
+  msg->checksum_received   = frame.checksum_received;
+  msg->checksum_calculated = frame.checksum_calculated;
+  msg->checksum_correct    = frame.checksum_correct;
+  try {
+    baca_protocol_publisher_.publish(mrs_msgs::BacaProtocolConstPtr(msg));
   }
+  catch (...) {
+    ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", baca_protocol_publisher_.getTopic().c_str());
+  }
+}
+
+//}
+
+/* processClockSyncPong() //{ */
+
+void Ultrasound::processClockSyncPong(const baca_protocol::BacaFrame &frame) {
 
-  ROS_INFO_THROTTLE(1.0, "[%s]: Connected to sensor.", ros::this_node::getName().c_str());
-  is_connected_  = true;
-  last_received_ = ros::Time::now();
+  if (!clock_sync_.handlePong(frame, serial_port_.getByteStamp(frame.bytes_after))) {
+    return;
+  }
+
+  const baca_protocol::ClockSyncState state = clock_sync_.getState();
 
-  return 1;
+  mrs_serial::ClockSyncStatus msg;
+  msg.header.stamp    = ros::Time::now();
+  msg.valid           = state.valid;
+  msg.samples         = state.samples;
+  msg.offset          = state.offset;
+  msg.drift           = state.drift;
+  msg.residual        = state.residual;
+  msg.residual_rms    = state.residual_rms;
+  msg.round_trip_time = state.round_trip_time;
+
+  try {
+    clock_sync_publisher_.publish(msg);
+  }
+  catch (...) {
+    ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", clock_sync_publisher_.getTopic().c_str());
+  }
 }
 
 //}
@@ -0,0 +1,248 @@
+#include "uring_queue.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// an empty translation unit without io_uring, see uring_queue.h
+#ifdef HAVE_IO_URING
+
+namespace serial_port {
+
+    // newer than the 5.4 kernel headers, as in uring_queue.h
+    constexpr unsigned URING_SETUP_COOP_TASKRUN = 1U << 8;    // 5.19
+    constexpr unsigned URING_SETUP_SINGLE_ISSUER = 1U << 12;  // 6.0
+    constexpr unsigned URING_SETUP_DEFER_TASKRUN = 1U << 13;  // 6.1
+    constexpr unsigned URING_REGISTER_PROBE = 8;              // 5.6
+    constexpr uint16_t URING_OP_SUPPORTED = 1U << 0;
+
+    // struct io_uring_probe_op and io_uring_probe of 5.6
+    struct UringProbeOp {
+        uint8_t op;
+        uint8_t resv;
+        uint16_t flags;
+        uint32_t resv2;
+    };
+
+    struct UringProbe {
+        uint8_t last_op;
+        uint8_t ops_len;
+        uint16_t resv;
+        uint32_t resv2[3];
+        UringProbeOp ops[];
+    };
+
+/* UringQueue() //{ */
+
+    UringQueue::UringQueue() {
+    }
+
+//}
+
+/* ~UringQueue() //{ */
+
+    UringQueue::~UringQueue() {
+        close();
+    }
+
+//}
+
+/* init() //{ */
+
+    bool UringQueue::init(unsigned entries, bool single_issuer) {
+
+        close();
+
+        struct io_uring_params params{};
+        int fd = -1;
+
+        if (single_issuer) {
+            params.flags = URING_SETUP_SINGLE_ISSUER | URING_SETUP_DEFER_TASKRUN;
+            fd = syscall(__NR_io_uring_setup, entries, &params);
+        }
+
+        // completions are only reaped by the thread that waits for them, it does not need to be interrupted for them
+        if (fd == -1) {
+            params = {};
+            params.flags = URING_SETUP_COOP_TASKRUN;
+            fd = syscall(__NR_io_uring_setup, entries, &params);
+        }
+
+        // kernels before 5.19 do not know the flags
+        if (fd == -1 && errno == EINVAL) {
+            params = {};
+            fd = syscall(__NR_io_uring_setup, entries, &params);
+        }
+
+        if (fd == -1) {
+            return false;
+        }
+
+        ring_fd_ = fd;
+
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sq_size_ = std::max(sq_size_, cq_size_);
+            cq_size_ = sq_size_;
+        }
+
+        sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) {
+            sq_ptr_ = nullptr;
+            close();
+            return false;
+        }
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            cq_ptr_ = sq_ptr_;
+        } else {
+            cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cq_ptr_ == MAP_FAILED) {
+                cq_ptr_ = nullptr;
+                close();
+                return false;
+            }
+        }
+
+        sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+        void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            close();
+            return false;
+        }
+        sqes_ = (struct io_uring_sqe *)sqes;
+
+        uint8_t *sq = (uint8_t *)sq_ptr_;
+        sq_head_ = (unsigned *)(sq + params.sq_off.head);
+        sq_tail_ = (unsigned *)(sq + params.sq_off.tail);
+        sq_mask_ = (unsigned *)(sq + params.sq_off.ring_mask);
+        sq_array_ = (unsigned *)(sq + params.sq_off.array);
+        sq_entries_ = params.sq_entries;
+        sq_local_tail_ = *sq_tail_;
+        to_submit_ = 0;
+
+        uint8_t *cq = (uint8_t *)cq_ptr_;
+        cq_head_ = (unsigned *)(cq + params.cq_off.head);
+        cq_tail_ = (unsigned *)(cq + params.cq_off.tail);
+        cq_mask_ = (unsigned *)(cq + params.cq_off.ring_mask);
+        cqes_ = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+        // which operations the kernel has, the probe itself exists since 5.6
+        const unsigned n_ops = 256;
+        std::vector<uint8_t> probe_data(sizeof(UringProbe) + n_ops * sizeof(UringProbeOp));
+        UringProbe *probe = (UringProbe *)probe_data.data();
+
+        supported_ops_.assign(n_ops, false);
+        if (syscall(__NR_io_uring_register, fd, URING_REGISTER_PROBE, probe, n_ops) == 0) {
+            for (unsigned i = 0; i < std::min<unsigned>(probe->ops_len, n_ops); i++) {
+                supported_ops_[probe->ops[i].op] = probe->ops[i].flags & URING_OP_SUPPORTED;
+            }
+        }
+
+        return true;
+    }
+
+//}
+
+/* close() //{ */
+
+    void UringQueue::close() {
+
+        if (sqes_) {
+            munmap(sqes_, sqes_size_);
+            sqes_ = nullptr;
+        }
+
+        if (cq_ptr_ && cq_ptr_ != sq_ptr_) {
+            munmap(cq_ptr_, cq_size_);
+        }
+        cq_ptr_ = nullptr;
+
+        if (sq_ptr_) {
+            munmap(sq_ptr_, sq_size_);
+            sq_ptr_ = nullptr;
+        }
+
+        if (ring_fd_ != -1) {
+            ::close(ring_fd_);
+            ring_fd_ = -1;
+        }
+
+        supported_ops_.clear();
+    }
+
+//}
+
+/* isOpen() //{ */
+
+    bool UringQueue::isOpen() const {
+        return ring_fd_ != -1;
+    }
+
+//}
+
+/* supportsOp() //{ */
+
+    bool UringQueue::supportsOp(uint8_t op) const {
+        return op < supported_ops_.size() && supported_ops_[op];
+    }
+
+//}
+
+/* getSqe() //{ */
+
+    struct io_uring_sqe *UringQueue::getSqe() {
+
+        if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+            return nullptr;
+        }
+
+        const unsigned index = sq_local_tail_ & *sq_mask_;
+        struct io_uring_sqe *sqe = &sqes_[index];
+        memset(sqe, 0, sizeof(*sqe));
+
+        sq_array_[index] = index;
+        sq_local_tail_++;
+        to_submit_++;
+
+        return sqe;
+    }
+
+//}
+
+/* submit() //{ */
+
+    int UringQueue::submit(unsigned wait_nr) {
+
+        __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+
+        const unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+        const int ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit_, wait_nr, flags, nullptr, 0);
+
+        // also when the wait was interrupted, the submitted entries are gone
+        if (ret > 0) {
+            to_submit_ -= std::min<unsigned>(ret, to_submit_);
+        }
+
+        return ret;
+    }
+
+//}
+
+/* registerBuffers() //{ */
+
+    bool UringQueue::registerBuffers(const struct iovec *iovecs, unsigned count) {
+        return syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS, iovecs, count) == 0;
+    }
+
+//}
+
+}  // namespace serial_port
+
+#endif  // HAVE_IO_URING
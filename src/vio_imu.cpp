@@ -1,22 +1,31 @@
 #include <ros/package.h>
 #include <stdlib.h>
 #include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 
 #include <sensor_msgs/Imu.h>
+#include <mrs_serial/ClockSyncStatus.h>
 #include <std_srvs/Trigger.h>
 #include <mutex>
+#include <chrono>
 
 #include <mrs_lib/param_loader.h>
 
 #include <string>
 
 #include <serial_port.h>
+#include <serial_reactor.h>
+#include <device_discovery.h>
+#include <port_supervisor.h>
+#include <baca_framer.h>
+#include <baca_dispatcher.h>
+#include <baca_messages.h>
+#include <link_stats.h>
+#include <baca_clock_sync.h>
 
 #include <nodelet/nodelet.h>
 #include <pluginlib/class_list_macros.h>
 
-#define BUFFER_SIZE 256
-
 #define MAXIMAL_TIME_INTERVAL 1
 
 const double G       = 9.80665;
@@ -33,58 +42,87 @@ public:
   virtual void onInit();
 
 private:
-  enum serial_receiver_state
-  {
-    WAITING_FOR_MESSSAGE,
-    EXPECTING_SIZE,
-    EXPECTING_PAYLOAD,
-    EXPECTING_CHECKSUM
-  };
-
-
   ros::Timer serial_timer_;
   ros::Timer maintainer_timer_;
+  ros::Timer diagnostics_timer_;
+  ros::Timer clock_sync_timer_;
 
   ros::ServiceServer netgun_arm;
   ros::ServiceServer netgun_safe;
   ros::ServiceServer netgun_fire;
 
 
-  void interpretSerialData(uint8_t data);
+  void interpretFrame(const baca_protocol::BacaFrame &frame);
+  void callbackSerialData(const uint8_t *data, int len);
   void callbackSerialTimer(const ros::TimerEvent &event);
   void callbackMaintainerTimer(const ros::TimerEvent &event);
+  void callbackDiagnosticsTimer(const ros::TimerEvent &event);
+  void callbackClockSyncTimer(const ros::TimerEvent &event);
 
-  uint8_t connectToSensor(void);
-  void    processMessage(uint8_t payload_size, uint8_t *input_buffer, uint8_t checksum, uint8_t checksum_rec, bool checksum_correct);
+  void    processClockSyncPong(const baca_protocol::BacaFrame &frame);
+  void    processImu(const baca_protocol::BacaFrame &frame);
 
 
   ros::NodeHandle nh_;
 
   ros::Publisher imu_publisher_;
   ros::Publisher imu_publisher_sync_;
+  ros::Publisher clock_sync_publisher_;
+  ros::Publisher diagnostics_publisher_;
 
   serial_port::SerialPort serial_port_;
+  serial_port::SerialReactor serial_reactor_;
+  baca_protocol::BacaFramer baca_framer_{false};
+  baca_protocol::BacaDispatcher baca_dispatcher_;
+
+  // frame counters and latencies of the link, published on /diagnostics
+  serial_port::LinkStats link_stats_;
+
+  // stamps the measurements with the device clock mapped to ROS time
+  baca_protocol::ClockSync clock_sync_;
 
   boost::function<void(uint8_t)> serial_data_callback_function_;
 
   bool     publish_bad_checksum;
   bool     _use_timeout_;
   bool     _verbose_;
-  uint16_t received_msg_ok           = 0;
-  uint16_t received_msg_bad_checksum = 0;
 
   int serial_rate_        = 5000;
   int serial_buffer_size_ = 1024;
 
+  bool use_reactor_        = true;
+  bool use_shared_reactor_ = true;
+  bool use_hotplug_        = true;
+  bool use_reader_thread_  = false;
+  int  reader_ring_size_   = 65536;
+  bool use_io_uring_       = false;
+
+  int reconnect_backoff_min_ms_ = 100;
+  int reconnect_backoff_max_ms_ = 5000;
+
+  bool low_latency_      = true;
+  int  latency_timer_ms_ = 1;
+
+  bool resync_on_bad_checksum_ = true;
+
+  double diagnostics_rate_ = 1.0;
+
+  bool use_clock_sync_        = false;
+  int  clock_sync_rate_       = 10;
+  int  clock_sync_window_     = 32;
+  int  clock_sync_max_rtt_us_ = 10000;
+
   std::string _portname_;
   int baudrate_;
   std::string _uav_name_;
 
-  ros::Time interval_      = ros::Time::now();
-  ros::Time last_received_ = ros::Time::now();
+  // looks the port up by the usb identity of the device instead, when set
+  serial_port::UsbDeviceFilter device_filter_;
 
-  bool is_connected_   = false;
   bool is_initialized_ = false;
+
+  // keeps the port open and publishes the state of the connection, declared last so that its threads stop first
+  serial_port::PortSupervisor port_supervisor_{&serial_port_};
 };
 
 //}
@@ -103,9 +141,29 @@ void VioImu::onInit() {
 
   param_loader.loadParam("uav_name", _uav_name_);
   param_loader.loadParam("portname", _portname_, std::string("/dev/vio_imu"));
+  param_loader.loadParam("device_vid", device_filter_.vid, std::string(""));
+  param_loader.loadParam("device_pid", device_filter_.pid, std::string(""));
+  param_loader.loadParam("device_serial", device_filter_.serial, std::string(""));
+  param_loader.loadParam("device_usb_path", device_filter_.usb_path, std::string(""));
   param_loader.loadParam("baudrate", baudrate_);
   param_loader.loadParam("use_timeout", _use_timeout_, true);
   param_loader.loadParam("serial_rate", serial_rate_, 115200);
+  param_loader.loadParam("use_reactor", use_reactor_, true);
+  param_loader.loadParam("use_shared_reactor", use_shared_reactor_, true);
+  param_loader.loadParam("use_hotplug", use_hotplug_, true);
+  param_loader.loadParam("reconnect_backoff_min_ms", reconnect_backoff_min_ms_, 100);
+  param_loader.loadParam("reconnect_backoff_max_ms", reconnect_backoff_max_ms_, 5000);
+  param_loader.loadParam("use_reader_thread", use_reader_thread_, false);
+  param_loader.loadParam("reader_ring_size", reader_ring_size_, 65536);
+  param_loader.loadParam("use_io_uring", use_io_uring_, false);
+  param_loader.loadParam("low_latency", low_latency_, true);
+  param_loader.loadParam("latency_timer_ms", latency_timer_ms_, 1);
+  param_loader.loadParam("resync_on_bad_checksum", resync_on_bad_checksum_, true);
+  param_loader.loadParam("diagnostics_rate", diagnostics_rate_, 1.0);
+  param_loader.loadParam("use_clock_sync", use_clock_sync_, false);
+  param_loader.loadParam("clock_sync_rate", clock_sync_rate_, 10);
+  param_loader.loadParam("clock_sync_window", clock_sync_window_, 32);
+  param_loader.loadParam("clock_sync_max_rtt_us", clock_sync_max_rtt_us_, 10000);
   param_loader.loadParam("verbose", _verbose_, true);
 
   if (!param_loader.loadedSuccessfully()) {
@@ -123,13 +181,77 @@ void VioImu::onInit() {
   // Output loaded parameters to console for double checking
   ROS_INFO_THROTTLE(1.0, "[%s] is up and running with the following parameters:", ros::this_node::getName().c_str());
   ROS_INFO_THROTTLE(1.0, "[%s] portname: %s", ros::this_node::getName().c_str(), _portname_.c_str());
+  if (!device_filter_.empty()) {
+    ROS_INFO_THROTTLE(1.0, "[%s] device: %s", ros::this_node::getName().c_str(), device_filter_.toString().c_str());
+  }
   ROS_INFO_THROTTLE(1.0, "[%s] baudrate: %i", ros::this_node::getName().c_str(), baudrate_);
 
-  connectToSensor();
+  // the reactor delivers the data as soon as the port becomes readable, polling timer is only a fallback
+  if (use_reactor_) {
+    // one I/O thread for all nodelets of the manager, the data are read and handled in the callback queue of this nodelet
+    if (use_shared_reactor_) {
+      serial_reactor_.setCallbackQueue(&getMTCallbackQueue());
+      serial_reactor_.startShared();
+    } else {
+      serial_reactor_.start();
+    }
+  }
+
+  // drain the port from a dedicated thread, so that slow callbacks cannot overrun the kernel buffer
+  if (use_reader_thread_) {
+    serial_port_.enableReaderThread(reader_ring_size_);
+  }
+
+  // io_uring for the reads of the reader thread, poll() where the kernel does not have it
+  serial_port_.setIoUring(use_io_uring_);
+
+  // small frames would otherwise wait up to 16 ms in the buffer of an FTDI adapter
+  serial_port_.setLowLatency(low_latency_, latency_timer_ms_);
+
+  // rescan the bytes of a frame with a bad checksum, a false start byte in noise would otherwise swallow the following good frames
+  baca_framer_.setResync(resync_on_bad_checksum_);
+
+  clock_sync_.init(clock_sync_window_, 4, clock_sync_max_rtt_us_ * 1e-6);
+
+  // handlers of the messages this node understands
+  baca_dispatcher_.registerHandler<baca_protocol::messages::VioImuData>([this](const baca_protocol::BacaFrame &frame) { processImu(frame); });
+  baca_dispatcher_.registerHandler<baca_protocol::messages::VioImuDataStamped>([this](const baca_protocol::BacaFrame &frame) { processImu(frame); });
+  // without clock sync, 0x73 stays free for the messages of the device
+  if (use_clock_sync_) {
+    baca_dispatcher_.registerHandler<baca_protocol::messages::ClockSyncPong>([this](const baca_protocol::BacaFrame &frame) { processClockSyncPong(frame); });
+  }
+
+  serial_port::PortSupervisor::Options port_options;
+  port_options.portname      = _portname_;
+  port_options.device_filter = device_filter_;
+  port_options.baudrate      = baudrate_;
+  port_options.buffer_size   = serial_buffer_size_;
+  port_options.use_timeout   = _use_timeout_;
+  port_options.timeout       = MAXIMAL_TIME_INTERVAL;
+  port_options.backoff_min   = reconnect_backoff_min_ms_ * 1e-3;
+  port_options.backoff_max   = reconnect_backoff_max_ms_ * 1e-3;
+  port_options.use_hotplug   = use_hotplug_;
+
+  port_supervisor_.start(nh_, port_options, use_reactor_ ? &serial_reactor_ : nullptr,
+                         [this](const uint8_t *data, int len) { callbackSerialData(data, len); });
+
+  if (!use_reactor_) {
+    serial_timer_ = nh_.createTimer(ros::Rate(serial_rate_), &VioImu::callbackSerialTimer, this);
+  }
 
-  serial_timer_     = nh_.createTimer(ros::Rate(serial_rate_), &VioImu::callbackSerialTimer, this);
   maintainer_timer_ = nh_.createTimer(ros::Rate(1), &VioImu::callbackMaintainerTimer, this);
 
+  if (diagnostics_rate_ > 0) {
+    diagnostics_publisher_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
+    diagnostics_timer_     = nh_.createTimer(ros::Rate(diagnostics_rate_), &VioImu::callbackDiagnosticsTimer, this);
+  }
+
+  // the device answers the pings with its clock, measurements carrying the clock are then stamped with it
+  if (use_clock_sync_) {
+    clock_sync_publisher_ = nh_.advertise<mrs_serial::ClockSyncStatus>("clock_sync", 10);
+    clock_sync_timer_     = nh_.createTimer(ros::Rate(clock_sync_rate_), &VioImu::callbackClockSyncTimer, this);
+  }
+
   is_initialized_ = true;
 }
 //}
@@ -148,173 +270,170 @@ void VioImu::callbackSerialTimer(const ros::TimerEvent &event) {
 
   bytes_read = serial_port_.readSerial(read_buffer, serial_buffer_size_);
 
-  for (int i = 0; i < bytes_read; i++) {
-    interpretSerialData(read_buffer[i]);
+  if (bytes_read > 0) {
+    callbackSerialData(read_buffer, bytes_read);
   }
-  /* processMessage */
 }
 
 //}
 
-/* callbackMaintainerTimer() //{ */
+/* callbackSerialData() //{ */
 
-void VioImu::callbackMaintainerTimer(const ros::TimerEvent &event) {
+void VioImu::callbackSerialData(const uint8_t *data, int len) {
 
-  if (is_connected_) {
+  const uint64_t zero_size_before = baca_framer_.stats().frames_zero_size;
+  const uint64_t recovered_before = baca_framer_.stats().frames_recovered;
 
-    if (!serial_port_.checkConnected()) {
-      is_connected_ = false;
-      ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial device is disconnected! ");
-    }
+  baca_framer_.decode(data, len, [this](const baca_protocol::BacaFrame &frame) { interpretFrame(frame); });
+
+  const baca_protocol::BacaFramerStats &stats = baca_framer_.stats();
+  link_stats_.setDecoderTotals(stats.bytes, stats.frames_ok, stats.frames_bad_checksum, stats.frames_zero_size, stats.frames_recovered);
+
+  if (baca_framer_.stats().frames_zero_size != zero_size_before) {
+    ROS_ERROR_THROTTLE(1.0, "[%s]: Message with 0 payload_size received, discarding.", ros::this_node::getName().c_str());
   }
 
-  if (((ros::Time::now() - last_received_).toSec() > MAXIMAL_TIME_INTERVAL) && _use_timeout_ && is_connected_) {
+  if (baca_framer_.stats().frames_recovered != recovered_before) {
+    ROS_WARN_STREAM_THROTTLE(1.0, "[" << ros::this_node::getName().c_str() << "] Resynchronized after a bad checksum, "
+                                      << baca_framer_.stats().frames_recovered << " frames recovered so far");
+  }
+}
+
+//}
+
+/* callbackClockSyncTimer() //{ */
 
-    is_connected_ = false;
+void VioImu::callbackClockSyncTimer(const ros::TimerEvent &event) {
 
-    ROS_ERROR_STREAM("[" << ros::this_node::getName().c_str() << "] Serial port timed out - no messages were received in " << MAXIMAL_TIME_INTERVAL
-                         << " seconds");
+  if (!port_supervisor_.isConnected()) {
+    return;
   }
 
-  if (is_connected_) {
+  const auto ping = clock_sync_.makePing(ros::Time::now());
+  serial_port_.sendFrame(ping.data(), ping.size());
+}
+
+//}
 
-    received_msg_ok           = 0;
-    received_msg_bad_checksum = 0;
+/* callbackDiagnosticsTimer() //{ */
 
-    interval_ = ros::Time::now();
+void VioImu::callbackDiagnosticsTimer(const ros::TimerEvent &event) {
 
-  } else {
+  // replaced on reconnect when the port is looked up by its usb identity
+  const std::string portname = port_supervisor_.getPortname();
 
-    connectToSensor();
+  // kernel counters, to tell data lost in the driver from noise on the line
+  link_stats_.setUartCounters(serial_port_.getUartCounters());
+  link_stats_.setLowLatencyState(serial_port_.getLowLatencyState());
+
+  const diagnostic_msgs::DiagnosticArray diagnostics =
+      link_stats_.makeDiagnostics(ros::this_node::getName() + ": serial link", portname, port_supervisor_.isConnected(), ros::Time::now());
+
+  try {
+    diagnostics_publisher_.publish(diagnostics);
+  }
+  catch (...) {
+    ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", diagnostics_publisher_.getTopic().c_str());
   }
 }
 
 //}
 
-// | ------------------------ routines ------------------------ |
+/* callbackMaintainerTimer() //{ */
+
+void VioImu::callbackMaintainerTimer(const ros::TimerEvent &event) {
+
+  port_supervisor_.checkConnection();
+}
 
-/* interpretSerialData() //{ */
+//}
 
-void VioImu::interpretSerialData(uint8_t single_character) {
+// | ------------------------ routines ------------------------ |
 
-  static serial_receiver_state rec_state    = WAITING_FOR_MESSSAGE;
-  static uint8_t               payload_size = 0;
-  static uint8_t               input_buffer[BUFFER_SIZE];
-  static uint8_t               buffer_counter = 0;
-  static uint8_t               checksum       = 0;
+/* interpretFrame() //{ */
+
+void VioImu::interpretFrame(const baca_protocol::BacaFrame &frame) {
 
   if (_verbose_)
     ROS_INFO_STREAM_THROTTLE(1.0, "[VioImu]: receiving IMU ok");
 
-  switch (rec_state) {
-    case WAITING_FOR_MESSSAGE:
-
-      if (single_character == 'b') {
-        checksum       = single_character;
-        buffer_counter = 0;
-        rec_state      = EXPECTING_SIZE;
-      }
-      break;
-
-    case EXPECTING_SIZE:
-
-      if (single_character == 0) {
-        ROS_ERROR_THROTTLE(1.0, "[%s]: Message with 0 payload_size received, discarding.", ros::this_node::getName().c_str());
-        rec_state = WAITING_FOR_MESSSAGE;
-      } else {
-        payload_size = single_character;
-        checksum += single_character;
-        rec_state = EXPECTING_PAYLOAD;
-      }
-      break;
-
-    case EXPECTING_PAYLOAD:
-
-      input_buffer[buffer_counter] = single_character;
-      checksum += single_character;
-      buffer_counter++;
-      if (buffer_counter >= payload_size) {
-        rec_state = EXPECTING_CHECKSUM;
-      }
-      break;
-
-    case EXPECTING_CHECKSUM:
-
-      if (checksum == single_character) {
-        processMessage(payload_size, input_buffer, checksum, single_character, true);
-        last_received_ = ros::Time::now();
-        rec_state      = WAITING_FOR_MESSSAGE;
-      } else {
-        if (publish_bad_checksum) {
-          processMessage(payload_size, input_buffer, checksum, single_character, false);
-        }
-        received_msg_bad_checksum++;
-        rec_state = WAITING_FOR_MESSSAGE;
-      }
-      break;
+  const auto parsed = std::chrono::steady_clock::now();
+
+  if (frame.checksum_correct) {
+    baca_dispatcher_.dispatch(frame);
+    const ros::Time now = ros::Time::now();
+    port_supervisor_.dataReceived(now);
+    link_stats_.recordFrame(frame.messageId(), std::chrono::duration<double>(std::chrono::steady_clock::now() - parsed).count(),
+                            (now - serial_port_.getByteStamp(frame.bytes_after)).toSec());
+  } else if (publish_bad_checksum) {
+    baca_dispatcher_.dispatch(frame);
   }
 }
 
 //}
 
-/* processMessage() //{ */
+/* processImu() //{ */
 
-void VioImu::processMessage(uint8_t payload_size, uint8_t *input_buffer, uint8_t checksum, uint8_t checksum_rec, bool checksum_correct) {
+void VioImu::processImu(const baca_protocol::BacaFrame &frame) {
 
-  if (payload_size == 13 && (input_buffer[0] == 0x30 || input_buffer[0] == 0x31) && checksum_correct) {
+  using baca_protocol::messages::VioImuData;
+  using baca_protocol::messages::VioImuDataStamped;
 
-    int32_t acc_x, acc_y, acc_z    = 0;
-    int32_t gyro_x, gyro_y, gyro_z = 0;
-
-    acc_x = int16_t(input_buffer[1] << 8) | (input_buffer[2] & 0xff);
-    acc_y = int16_t(input_buffer[3] << 8) | (input_buffer[4] & 0xff);
-    acc_z = int16_t(input_buffer[5] << 8) | (input_buffer[6] & 0xff);
-
-    gyro_x = int16_t(input_buffer[7] << 8) | (input_buffer[8] & 0xff);
-    gyro_y = int16_t(input_buffer[9] << 8) | (input_buffer[10] & 0xff);
-    gyro_z = int16_t(input_buffer[11] << 8) | (input_buffer[12] & 0xff);
+  // measurements carrying the device clock are stamped with it once the clock is synchronized, the rest with the arrival of their last byte
+  ros::Time stamp = serial_port_.getByteStamp(frame.bytes_after);
+  if (VioImuDataStamped::matches(frame)) {
+    clock_sync_.toHostTime(VioImuDataStamped::tick::read(frame.payload), stamp);
+  }
 
-    sensor_msgs::Imu imu;
+  sensor_msgs::Imu imu;
 
-    imu.linear_acceleration.x = (double(acc_x) / 4096) * G;
-    imu.linear_acceleration.y = (double(acc_y) / 4096) * G;
-    imu.linear_acceleration.z = (double(acc_z) / 4096) * G;
+  imu.linear_acceleration.x = VioImuData::acc_x::get(frame.payload) * G;
+  imu.linear_acceleration.y = VioImuData::acc_y::get(frame.payload) * G;
+  imu.linear_acceleration.z = VioImuData::acc_z::get(frame.payload) * G;
 
-    imu.angular_velocity.x = (double(gyro_x) / 65.536) / DEG2RAD;
-    imu.angular_velocity.y = (double(gyro_y) / 65.536) / DEG2RAD;
-    imu.angular_velocity.z = (double(gyro_z) / 65.536) / DEG2RAD;
+  imu.angular_velocity.x = VioImuData::gyro_x::get(frame.payload) / DEG2RAD;
+  imu.angular_velocity.y = VioImuData::gyro_y::get(frame.payload) / DEG2RAD;
+  imu.angular_velocity.z = VioImuData::gyro_z::get(frame.payload) / DEG2RAD;
 
-    imu.header.stamp    = ros::Time::now();
-    imu.header.frame_id = _uav_name_ + "/vio_imu";
-    if (input_buffer[0] == 0x30) {
+  imu.header.stamp    = stamp;
+  imu.header.frame_id = _uav_name_ + "/vio_imu";
+  if (frame.messageId() == 0x30) {
 
-      imu_publisher_.publish(imu);
-    } else {
-      imu_publisher_.publish(imu);
-      imu_publisher_sync_.publish(imu);
-    }
+    imu_publisher_.publish(imu);
+  } else {
+    imu_publisher_.publish(imu);
+    imu_publisher_sync_.publish(imu);
   }
-}  // namespace vio_imu
+}
 
 //}
 
-/* connectToSensors() //{ */
+/* processClockSyncPong() //{ */
 
-uint8_t VioImu::connectToSensor(void) {
+void VioImu::processClockSyncPong(const baca_protocol::BacaFrame &frame) {
 
-  ROS_INFO_THROTTLE(1.0, "[%s]: Openning the serial port.", ros::this_node::getName().c_str());
-
-  if (!serial_port_.connect(_portname_, baudrate_)) {
-    ROS_ERROR_THROTTLE(1.0, "[%s]: Could not connect to sensor.", ros::this_node::getName().c_str());
-    is_connected_ = false;
-    return 0;
+  if (!clock_sync_.handlePong(frame, serial_port_.getByteStamp(frame.bytes_after))) {
+    return;
   }
 
-  ROS_INFO_THROTTLE(1.0, "[%s]: Connected to sensor.", ros::this_node::getName().c_str());
-  is_connected_  = true;
-  last_received_ = ros::Time::now();
+  const baca_protocol::ClockSyncState state = clock_sync_.getState();
+
+  mrs_serial::ClockSyncStatus msg;
+  msg.header.stamp    = ros::Time::now();
+  msg.valid           = state.valid;
+  msg.samples         = state.samples;
+  msg.offset          = state.offset;
+  msg.drift           = state.drift;
+  msg.residual        = state.residual;
+  msg.residual_rms    = state.residual_rms;
+  msg.round_trip_time = state.round_trip_time;
 
-  return 1;
+  try {
+    clock_sync_publisher_.publish(msg);
+  }
+  catch (...) {
+    ROS_ERROR("[MrsSerial]: exception caught during publishing topic %s", clock_sync_publisher_.getTopic().c_str());
+  }
 }
 
 //}